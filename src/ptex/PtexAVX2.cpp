@@ -0,0 +1,923 @@
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+/**
+  @file PtexAVX2.cpp
+  @brief AVX2 kernels (see PtexSIMD.h).  Compiled with AVX2 and F16C enabled.
+
+  Byte shuffles and unpacks only operate within each 128-bit lane, so
+  the kernels either process two independent blocks at once (one per
+  lane) or rearrange the lanes before or after the in-lane work.
+*/
+
+#include <immintrin.h>
+#include "PtexSIMD.h"
+
+PTEX_NAMESPACE_BEGIN
+
+namespace {
+    using namespace PtexSIMD;
+
+    // same 16 byte mask in both lanes
+    inline __m256i broadcast(const char m[16])
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*) m);
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(v), v, 1);
+    }
+
+    template<int s>
+    inline __m256i interleave3Mask(int c, int k)
+    {
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = interleave3Byte(s, c, k, j);
+        return broadcast(m);
+    }
+
+    template<int s>
+    inline __m256i deinterleave3Mask(int c, int k)
+    {
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = deinterleave3Byte(s, c, k, j);
+        return broadcast(m);
+    }
+
+    template<int s>
+    inline __m256i group4Mask(bool group)
+    {
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = group ? group4Byte(s, j) : ungroup4Byte(s, j);
+        return broadcast(m);
+    }
+
+    // transpose a 4x4 matrix of 32-bit values in each lane
+    inline void transpose4(__m256i& a, __m256i& b, __m256i& c, __m256i& d)
+    {
+        __m256i x0 = _mm256_unpacklo_epi32(a, b), x1 = _mm256_unpackhi_epi32(a, b);
+        __m256i x2 = _mm256_unpacklo_epi32(c, d), x3 = _mm256_unpackhi_epi32(c, d);
+        a = _mm256_unpacklo_epi64(x0, x2);
+        b = _mm256_unpackhi_epi64(x0, x2);
+        c = _mm256_unpacklo_epi64(x1, x3);
+        d = _mm256_unpackhi_epi64(x1, x3);
+    }
+
+    // shuffle masks for interleave3, [output vector][channel]
+    template<int s>
+    struct Interleave3Masks {
+        __m256i m[3][3];
+        Interleave3Masks()
+        {
+            for (int k = 0; k < 3; k++)
+                for (int c = 0; c < 3; c++) m[k][c] = interleave3Mask<s>(c, k);
+        }
+    };
+
+    template<int s>
+    void interleave3(const Interleave3Masks<s>& masks, const void* srcArg, int planestride, void* dstArg, int n)
+    {
+        const char* src = (const char*) srcArg;
+        char* dst = (char*) dstArg;
+        const __m256i (&m)[3][3] = masks.m;
+
+        // each lane makes 48 bytes of pixels from 16 bytes of each channel
+        int i = 0;
+        for (const int block = 32 / s; i + block <= n; i += block) {
+            const char* sp = src + i * s;
+            __m256i c0 = _mm256_loadu_si256((const __m256i*) sp);
+            __m256i c1 = _mm256_loadu_si256((const __m256i*) (sp + planestride));
+            __m256i c2 = _mm256_loadu_si256((const __m256i*) (sp + 2 * planestride));
+            __m256i v[3];
+            for (int k = 0; k < 3; k++)
+                v[k] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(c0, m[k][0]),
+                                                       _mm256_shuffle_epi8(c1, m[k][1])),
+                                       _mm256_shuffle_epi8(c2, m[k][2]));
+            // lane 0 holds bytes 0-47 and lane 1 bytes 48-95
+            char* dp = dst + i * 3 * s;
+            _mm256_storeu_si256((__m256i*) dp, _mm256_permute2x128_si256(v[0], v[1], 0x20));
+            _mm256_storeu_si256((__m256i*) (dp + 32), _mm256_permute2x128_si256(v[2], v[0], 0x30));
+            _mm256_storeu_si256((__m256i*) (dp + 64), _mm256_permute2x128_si256(v[1], v[2], 0x31));
+        }
+        interleaveTail<s, 3>(src, planestride, dst, i, n);
+    }
+
+    template<int s>
+    void interleave3(const void* src, int planestride, void* dst, int n)
+    {
+        interleave3(Interleave3Masks<s>(), src, planestride, dst, n);
+    }
+
+    // shuffle masks for deinterleave3, [channel][input vector]
+    template<int s>
+    struct Deinterleave3Masks {
+        __m256i m[3][3];
+        Deinterleave3Masks()
+        {
+            for (int c = 0; c < 3; c++)
+                for (int k = 0; k < 3; k++) m[c][k] = deinterleave3Mask<s>(c, k);
+        }
+    };
+
+    template<int s>
+    void deinterleave3(const Deinterleave3Masks<s>& masks, const void* srcArg, void* dstArg, int planestride, int n)
+    {
+        const char* src = (const char*) srcArg;
+        char* dst = (char*) dstArg;
+        const __m256i (&m)[3][3] = masks.m;
+
+        // each lane makes 16 bytes of each channel from 48 bytes of pixels
+        int i = 0;
+        for (const int block = 32 / s; i + block <= n; i += block) {
+            const char* sp = src + i * 3 * s;
+            __m256i v0 = _mm256_loadu_si256((const __m256i*) sp);
+            __m256i v1 = _mm256_loadu_si256((const __m256i*) (sp + 32));
+            __m256i v2 = _mm256_loadu_si256((const __m256i*) (sp + 64));
+            // move bytes 0-47 to lane 0 and bytes 48-95 to lane 1
+            __m256i a = _mm256_permute2x128_si256(v0, v1, 0x30);
+            __m256i b = _mm256_permute2x128_si256(v0, v2, 0x21);
+            __m256i c = _mm256_permute2x128_si256(v1, v2, 0x30);
+            char* dp = dst + i * s;
+            for (int ch = 0; ch < 3; ch++) {
+                __m256i v = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, m[ch][0]),
+                                                            _mm256_shuffle_epi8(b, m[ch][1])),
+                                            _mm256_shuffle_epi8(c, m[ch][2]));
+                _mm256_storeu_si256((__m256i*) (dp + ch * planestride), v);
+            }
+        }
+        deinterleaveTail<s, 3>(src, dst, planestride, i, n);
+    }
+
+    template<int s>
+    void deinterleave3(const void* src, void* dst, int planestride, int n)
+    {
+        deinterleave3(Deinterleave3Masks<s>(), src, dst, planestride, n);
+    }
+
+    template<int s>
+    void interleave4(const void* srcArg, int planestride, void* dstArg, int n)
+    {
+        const char* src = (const char*) srcArg;
+        char* dst = (char*) dstArg;
+        const __m256i m = group4Mask<s>(false);
+
+        // transpose 4 byte groups of each channel, then
+        // interleave the channels within each group
+        int i = 0;
+        for (const int block = 32 / s; i + block <= n; i += block) {
+            const char* sp = src + i * s;
+            __m256i v0 = _mm256_loadu_si256((const __m256i*) sp);
+            __m256i v1 = _mm256_loadu_si256((const __m256i*) (sp + planestride));
+            __m256i v2 = _mm256_loadu_si256((const __m256i*) (sp + 2 * planestride));
+            __m256i v3 = _mm256_loadu_si256((const __m256i*) (sp + 3 * planestride));
+            transpose4(v0, v1, v2, v3);
+            if (s != 4) {
+                v0 = _mm256_shuffle_epi8(v0, m);
+                v1 = _mm256_shuffle_epi8(v1, m);
+                v2 = _mm256_shuffle_epi8(v2, m);
+                v3 = _mm256_shuffle_epi8(v3, m);
+            }
+            // lane 0 of vector k holds output block k, lane 1 block k+4
+            char* dp = dst + i * 4 * s;
+            _mm256_storeu_si256((__m256i*) dp, _mm256_permute2x128_si256(v0, v1, 0x20));
+            _mm256_storeu_si256((__m256i*) (dp + 32), _mm256_permute2x128_si256(v2, v3, 0x20));
+            _mm256_storeu_si256((__m256i*) (dp + 64), _mm256_permute2x128_si256(v0, v1, 0x31));
+            _mm256_storeu_si256((__m256i*) (dp + 96), _mm256_permute2x128_si256(v2, v3, 0x31));
+        }
+        interleaveTail<s, 4>(src, planestride, dst, i, n);
+    }
+
+    template<int s>
+    void deinterleave4(const void* srcArg, void* dstArg, int planestride, int n)
+    {
+        const char* src = (const char*) srcArg;
+        char* dst = (char*) dstArg;
+        const __m256i m = group4Mask<s>(true);
+
+        // group the channels within each 16 bytes, then transpose the groups
+        int i = 0;
+        for (const int block = 32 / s; i + block <= n; i += block) {
+            const char* sp = src + i * 4 * s;
+            __m256i b01 = _mm256_loadu_si256((const __m256i*) sp);
+            __m256i b23 = _mm256_loadu_si256((const __m256i*) (sp + 32));
+            __m256i b45 = _mm256_loadu_si256((const __m256i*) (sp + 64));
+            __m256i b67 = _mm256_loadu_si256((const __m256i*) (sp + 96));
+            // put input block k in lane 0 and block k+4 in lane 1 of vector k
+            __m256i v0 = _mm256_permute2x128_si256(b01, b45, 0x20);
+            __m256i v1 = _mm256_permute2x128_si256(b01, b45, 0x31);
+            __m256i v2 = _mm256_permute2x128_si256(b23, b67, 0x20);
+            __m256i v3 = _mm256_permute2x128_si256(b23, b67, 0x31);
+            if (s != 4) {
+                v0 = _mm256_shuffle_epi8(v0, m);
+                v1 = _mm256_shuffle_epi8(v1, m);
+                v2 = _mm256_shuffle_epi8(v2, m);
+                v3 = _mm256_shuffle_epi8(v3, m);
+            }
+            transpose4(v0, v1, v2, v3);
+            char* dp = dst + i * s;
+            _mm256_storeu_si256((__m256i*) dp, v0);
+            _mm256_storeu_si256((__m256i*) (dp + planestride), v1);
+            _mm256_storeu_si256((__m256i*) (dp + 2 * planestride), v2);
+            _mm256_storeu_si256((__m256i*) (dp + 3 * planestride), v3);
+        }
+        deinterleaveTail<s, 4>(src, dst, planestride, i, n);
+    }
+
+    template<int s> inline __m256i add(__m256i a, __m256i b)
+    { return s == 1 ? _mm256_add_epi8(a, b) : _mm256_add_epi16(a, b); }
+
+    template<int s> inline __m256i sub(__m256i a, __m256i b)
+    { return s == 1 ? _mm256_sub_epi8(a, b) : _mm256_sub_epi16(a, b); }
+
+    template<typename T>
+    void encodeDifference(void* data, int size)
+    {
+        const int s = sizeof(T), block = 32 / s;
+        T* p = (T*) data, * end = p + size / s;
+
+        // subtract each vector shifted up one element, with the last
+        // (original) element of the previous vector shifted in; the
+        // in-lane alignr gets the element below each lane from the
+        // lanes of [prev.hi, v.lo]
+        __m256i prev = _mm256_setzero_si256();
+        for (; end - p >= block; p += block) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) p);
+            __m256i below = _mm256_permute2x128_si256(prev, v, 0x21);
+            _mm256_storeu_si256((__m256i*) p, sub<s>(v, _mm256_alignr_epi8(v, below, 16 - s)));
+            prev = v;
+        }
+        T last[block];
+        _mm256_storeu_si256((__m256i*) last, prev);
+        encodeDifferenceTail(p, end, last[block-1]);
+    }
+
+    template<typename T>
+    void decodeDifference(void* data, int size)
+    {
+        const int s = sizeof(T), block = 32 / s;
+        T* p = (T*) data, * end = p + size / s;
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = lastElemByte(s, j);
+        const __m256i lastMask = broadcast(m);
+
+        // running sum within each lane by adding shifted copies, then
+        // add the last sum of the low lane to the high lane, and the
+        // last sum of the previous vector to both
+        __m256i carry = _mm256_setzero_si256();
+        for (; end - p >= block; p += block) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) p);
+            v = add<s>(v, _mm256_slli_si256(v, s));
+            v = add<s>(v, _mm256_slli_si256(v, 2 * s));
+            v = add<s>(v, _mm256_slli_si256(v, 4 * s));
+            if (s == 1) v = add<s>(v, _mm256_slli_si256(v, 8));
+            __m256i last = _mm256_shuffle_epi8(v, lastMask);
+            v = add<s>(v, _mm256_permute2x128_si256(last, last, 0x08));
+            v = add<s>(v, carry);
+            _mm256_storeu_si256((__m256i*) p, v);
+            last = _mm256_shuffle_epi8(v, lastMask);
+            carry = _mm256_permute2x128_si256(last, last, 0x11);
+        }
+        decodeDifferenceTail(p, end, p == (T*) data ? T(0) : p[-1]);
+    }
+    /* Mipmap reductions.  Each block of pixel pairs is split into its
+       even and odd pixels so that the averages are element-wise, using
+       the same arithmetic (and rounding) as the scalar code. */
+
+    struct Half { uint16_t bits; }; // half float elements
+
+    inline __m256i set1(int v) { return _mm256_set1_epi32(v); }
+
+    // float to half for values that aren't normal halves (see floatToHalf)
+    inline __m256i floatToHalfSpecial(__m256i a, __m256i r)
+    {
+        // denormal: round |f| * 2^24 to an integer, ties up (exactly, unlike adding 0.5)
+        __m256 x = _mm256_mul_ps(_mm256_castsi256_ps(a), _mm256_set1_ps(16777216.0f));
+        __m256i d = _mm256_cvttps_epi32(x);
+        __m256 frac = _mm256_sub_ps(x, _mm256_cvtepi32_ps(d));
+        d = _mm256_sub_epi32(d, _mm256_castps_si256(_mm256_cmp_ps(frac, _mm256_set1_ps(0.5f), _CMP_GE_OQ)));
+        r = _mm256_blendv_epi8(r, d, _mm256_cmpgt_epi32(set1(113 << 23), a));
+        // overflow to inf, and inf/nan keeping the high mantissa bits
+        r = _mm256_blendv_epi8(r, set1(0x7c00), _mm256_cmpgt_epi32(a, set1((143 << 23) - 1)));
+        __m256i nan = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(a, 13), set1(0x3ff)), set1(0x7c00));
+        return _mm256_blendv_epi8(r, nan, _mm256_cmpgt_epi32(a, set1((255 << 23) - 1)));
+    }
+
+    // float to half bits (in each 32-bit element), same as PtexHalf::fromFloat
+    inline __m256i floatToHalf(__m256 f)
+    {
+        __m256i i = _mm256_castps_si256(f);
+        __m256i a = _mm256_and_si256(i, set1(0x7fffffff));
+        __m256i s = _mm256_and_si256(_mm256_srli_epi32(i, 16), set1(0x8000));
+        // normal: rebias the exponent and round the mantissa, ties away from zero
+        __m256i r = _mm256_srli_epi32(_mm256_add_epi32(a, set1(0x1000 - (112 << 23))), 13);
+        __m256i special = _mm256_or_si256(_mm256_cmpgt_epi32(set1(113 << 23), a),
+                                          _mm256_cmpgt_epi32(a, set1((143 << 23) - 1)));
+        if (!_mm256_testz_si256(special, special)) {
+            r = floatToHalfSpecial(a, r);
+            // zero of either sign is +0
+            s = _mm256_andnot_si256(_mm256_cmpeq_epi32(a, _mm256_setzero_si256()), s);
+        }
+        return _mm256_or_si256(r, s);
+    }
+
+    // 16 floats to halves
+    inline __m256i floatToHalf(__m256 lo, __m256 hi)
+    {
+        // packus works within each lane
+        return _mm256_permute4x64_epi64(_mm256_packus_epi32(floatToHalf(lo), floatToHalf(hi)), 0xd8);
+    }
+
+    // 8 halves to floats, same as PtexHalf::toFloat
+    inline __m256 halfToFloat(__m128i h)
+    {
+        // F16C sets the quiet bit of signaling nans; put back the bit from the half
+        __m256 f = _mm256_cvtph_ps(h);
+        __m256i h32 = _mm256_cvtepu16_epi32(h);
+        __m256i nan = _mm256_cmpgt_epi32(_mm256_and_si256(h32, set1(0x7fff)), set1(0x7c00));
+        if (_mm256_testz_si256(nan, nan)) return f;
+        __m256i q = _mm256_and_si256(_mm256_slli_epi32(h32, 13), set1(0x400000));
+        __m256i fixed = _mm256_or_si256(_mm256_andnot_si256(set1(0x400000), _mm256_castps_si256(f)), q);
+        return _mm256_castsi256_ps(_mm256_blendv_epi8(_mm256_castps_si256(f), fixed, nan));
+    }
+
+    // one half to float (for the elements after the last vector)
+    inline float halfToFloat(uint16_t h)
+    {
+        __m128 f = _mm_cvtph_ps(_mm_cvtsi32_si128(h));
+        if ((h & 0x7fff) > 0x7c00 && !(h & 0x200))
+            f = _mm_castsi128_ps(_mm_andnot_si128(_mm_cvtsi32_si128(0x400000), _mm_castps_si128(f)));
+        return _mm_cvtss_f32(f);
+    }
+
+    void halfToFloat(float* dst, const uint16_t* src, int n)
+    {
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dst + i, halfToFloat(_mm_loadu_si128((const __m128i*) (src + i))));
+        for (; i < n; i++) dst[i] = halfToFloat(src[i]);
+    }
+
+    void floatToHalf(uint16_t* dst, const float* src, int n)
+    {
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm256_storeu_si256((__m256i*) (dst + i),
+                                floatToHalf(_mm256_loadu_ps(src + i), _mm256_loadu_ps(src + i + 8)));
+        if (i < n) {
+            float f[16] = { 0 };
+            uint16_t h[16];
+            memcpy(f, src + i, (n - i) * sizeof(float));
+            _mm256_storeu_si256((__m256i*) h, floatToHalf(_mm256_loadu_ps(f), _mm256_loadu_ps(f + 8)));
+            memcpy(dst + i, h, (n - i) * sizeof(uint16_t));
+        }
+    }
+
+    // averages of 2 and 4 vectors, same as halve and quarter in PtexUtils
+    template<typename T> struct Avg {};
+
+    template<> struct Avg<uint8_t> {
+        static __m256i avg2(__m256i a, __m256i b)
+        {
+            // (a & b) + ((a ^ b) >> 1) doesn't overflow
+            __m256i h = _mm256_and_si256(_mm256_srli_epi16(_mm256_xor_si256(a, b), 1), _mm256_set1_epi8(0x7f));
+            return _mm256_add_epi8(_mm256_and_si256(a, b), h);
+        }
+        static __m256i avg4(__m256i a, __m256i b, __m256i c, __m256i d)
+        {
+            const __m256i z = _mm256_setzero_si256();
+            __m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(a, z), _mm256_unpacklo_epi8(b, z)),
+                                       _mm256_add_epi16(_mm256_unpacklo_epi8(c, z), _mm256_unpacklo_epi8(d, z)));
+            __m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(a, z), _mm256_unpackhi_epi8(b, z)),
+                                       _mm256_add_epi16(_mm256_unpackhi_epi8(c, z), _mm256_unpackhi_epi8(d, z)));
+            return _mm256_packus_epi16(_mm256_srli_epi16(lo, 2), _mm256_srli_epi16(hi, 2));
+        }
+    };
+
+    template<> struct Avg<uint16_t> {
+        static __m256i avg2(__m256i a, __m256i b)
+        {
+            return _mm256_add_epi16(_mm256_and_si256(a, b), _mm256_srli_epi16(_mm256_xor_si256(a, b), 1));
+        }
+        static __m256i avg4(__m256i a, __m256i b, __m256i c, __m256i d)
+        {
+            const __m256i z = _mm256_setzero_si256();
+            __m256i lo = _mm256_add_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(a, z), _mm256_unpacklo_epi16(b, z)),
+                                       _mm256_add_epi32(_mm256_unpacklo_epi16(c, z), _mm256_unpacklo_epi16(d, z)));
+            __m256i hi = _mm256_add_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(a, z), _mm256_unpackhi_epi16(b, z)),
+                                       _mm256_add_epi32(_mm256_unpackhi_epi16(c, z), _mm256_unpackhi_epi16(d, z)));
+            return _mm256_packus_epi32(_mm256_srli_epi32(lo, 2), _mm256_srli_epi32(hi, 2));
+        }
+    };
+
+    template<> struct Avg<float> {
+        static __m128 avg2f(__m128 a, __m128 b)
+        {
+            return _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(a, b));
+        }
+        static __m128 avg4f(__m128 a, __m128 b, __m128 c, __m128 d)
+        {
+            return _mm_mul_ps(_mm_set1_ps(0.25f), _mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d));
+        }
+        static __m256 avg2f(__m256 a, __m256 b)
+        {
+            return _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_add_ps(a, b));
+        }
+        static __m256 avg4f(__m256 a, __m256 b, __m256 c, __m256 d)
+        {
+            // same order of additions as the scalar code
+            return _mm256_mul_ps(_mm256_set1_ps(0.25f), _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(a, b), c), d));
+        }
+        static __m256i avg2(__m256i a, __m256i b)
+        {
+            return _mm256_castps_si256(avg2f(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+        }
+        static __m256i avg4(__m256i a, __m256i b, __m256i c, __m256i d)
+        {
+            return _mm256_castps_si256(avg4f(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b),
+                                          _mm256_castsi256_ps(c), _mm256_castsi256_ps(d)));
+        }
+    };
+
+    // halves are averaged as floats, 8 at a time; F16C converts to float
+    // exactly (only quieting signaling nans, as any arithmetic does), but
+    // rounds ties to even when converting back
+    template<> struct Avg<Half> {
+        static __m256 lo(__m256i v) { return _mm256_cvtph_ps(_mm256_castsi256_si128(v)); }
+        static __m256 hi(__m256i v) { return _mm256_cvtph_ps(_mm256_extracti128_si256(v, 1)); }
+        static __m256i pack(__m256 lo, __m256 hi) { return floatToHalf(lo, hi); }
+        static __m256i avg2(__m256i a, __m256i b)
+        {
+            return pack(Avg<float>::avg2f(lo(a), lo(b)), Avg<float>::avg2f(hi(a), hi(b)));
+        }
+        static __m256i avg4(__m256i a, __m256i b, __m256i c, __m256i d)
+        {
+            return pack(Avg<float>::avg4f(lo(a), lo(b), lo(c), lo(d)),
+                        Avg<float>::avg4f(hi(a), hi(b), hi(c), hi(d)));
+        }
+    };
+
+    template<int P>
+    inline __m256i splitMask()
+    {
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = P < 8 ? splitPixelsByte(P, j) : char(j);
+        return broadcast(m);
+    }
+
+    // split 64 bytes of P byte pixels into the even and the odd pixels;
+    // unless P is 16, the 8 byte groups of each are in the order 0 2 1 3
+    template<int P>
+    inline void split(const char* src, __m256i m, __m256i& even, __m256i& odd)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*) src);
+        __m256i b = _mm256_loadu_si256((const __m256i*) (src + 32));
+        if (P == 16) {
+            even = _mm256_permute2x128_si256(a, b, 0x20);
+            odd = _mm256_permute2x128_si256(a, b, 0x31);
+            return;
+        }
+        if (P < 8) { a = _mm256_shuffle_epi8(a, m); b = _mm256_shuffle_epi8(b, m); }
+        even = _mm256_unpacklo_epi64(a, b);
+        odd = _mm256_unpackhi_epi64(a, b);
+    }
+
+    // 32 output bytes from 64 bytes of pixel pairs in rows a (and b), and
+    // for reduce_tri, 32 bytes of pixels from the diagonal in g
+    template<typename T, int P, ReduceMode mode>
+    inline void reduceBlock(const char* a, const char* b, const char* g, char* dst, __m256i m)
+    {
+        __m256i e0, o0, e1, o1, r;
+        split<P>(a, m, e0, o0);
+        if (mode == reduce_u) r = Avg<T>::avg2(e0, o0);
+        else {
+            split<P>(b, m, e1, o1);
+            if (mode == reduce_tri) {
+                o1 = _mm256_loadu_si256((const __m256i*) g);
+                if (P != 16) o1 = _mm256_permute4x64_epi64(o1, 0xd8);
+            }
+            r = Avg<T>::avg4(e0, o0, e1, o1);
+        }
+        if (P != 16) r = _mm256_permute4x64_epi64(r, 0xd8);
+        _mm256_storeu_si256((__m256i*) dst, r);
+    }
+
+    // n output bytes of a row
+    template<typename T, int P, ReduceMode mode>
+    void reduceRow(const char* a, const char* b, const char* g, char* dst, int n, __m256i m)
+    {
+        int i = 0;
+        for (; i + 32 <= n; i += 32)
+            reduceBlock<T, P, mode>(a + 2 * i, b + 2 * i, g + i, dst + i, m);
+        if (i < n) {
+            // pad the last partial block
+            char ta[64] = { 0 }, tb[64] = { 0 }, tg[32] = { 0 }, td[32];
+            memcpy(ta, a + 2 * i, 2 * (n - i));
+            if (mode != reduce_u) memcpy(tb, b + 2 * i, 2 * (n - i));
+            if (mode == reduce_tri) memcpy(tg, g + i, n - i);
+            reduceBlock<T, P, mode>(ta, tb, tg, td, m);
+            memcpy(dst + i, td, n - i);
+        }
+    }
+
+    // gather the pixels that reduceTri takes from the other triangle for
+    // output row r, pixels x0 to x0+np (moving up two rows per pixel)
+    inline void gatherTri(const char* src, int sstride, int w, int P, int r, int x0, int np, char* g)
+    {
+        const char* p = src + (w - 1 - 2 * x0) * sstride + (w - 1 - 2 * r) * P;
+        for (int x = 0; x < np; x++, p -= 2 * sstride) memcpy(g + x * P, p, P);
+    }
+
+    // faces of P byte pixels (1, 2 or 4 channels)
+    template<typename T, int P, ReduceMode mode>
+    void reducePixels(const char* src, int sstride, int uw, int vw, char* dst, int dstride)
+    {
+        const __m256i m = splitMask<P>();
+        const int chunk = 64; // pixels gathered at a time for reduce_tri
+        char g[chunk * P];
+        int rows = mode == reduce_u ? vw : mode == reduce_tri ? uw / 2 : vw / 2;
+        int rowstep = mode == reduce_u ? sstride : 2 * sstride;
+        const char* s = src;
+        for (int r = 0; r < rows; r++, s += rowstep, dst += dstride) {
+            const char* s2 = mode == reduce_u ? s : s + sstride;
+            if (mode != reduce_tri) {
+                reduceRow<T, P, mode>(s, s2, g, dst, uw / 2 * P, m);
+                continue;
+            }
+            for (int x0 = 0; x0 < uw / 2; x0 += chunk) {
+                int np = uw / 2 - x0 < chunk ? uw / 2 - x0 : chunk;
+                gatherTri(src, sstride, uw, P, r, x0, np, g);
+                reduceRow<T, P, mode>(s + 2 * x0 * P, s2 + 2 * x0 * P, g, dst + x0 * P, np * P, m);
+            }
+        }
+    }
+
+    // faces of 3 channel pixels, reduced one channel at a time
+    template<typename T, ReduceMode mode>
+    void reducePlanes(const char* src, int sstride, int uw, int vw, char* dst, int dstride)
+    {
+        const int s = sizeof(T), P = 3 * s;
+        const __m256i m = splitMask<s>();
+        const Interleave3Masks<s> im;
+        const Deinterleave3Masks<s> dm;
+        const int chunk = 128; // output pixels at a time
+        const int astride = 2 * chunk * s, gstride = chunk * s;
+        char a[3 * astride], b[3 * astride], g[3 * gstride], pixels[chunk * P], d[3 * gstride];
+        int rows = mode == reduce_u ? vw : mode == reduce_tri ? uw / 2 : vw / 2;
+        int rowstep = mode == reduce_u ? sstride : 2 * sstride;
+        const char* sp = src;
+        for (int r = 0; r < rows; r++, sp += rowstep, dst += dstride) {
+            for (int x0 = 0; x0 < uw / 2; x0 += chunk) {
+                int np = uw / 2 - x0 < chunk ? uw / 2 - x0 : chunk;
+                deinterleave3(dm, sp + 2 * x0 * P, a, astride, 2 * np);
+                if (mode != reduce_u)
+                    deinterleave3(dm, sp + sstride + 2 * x0 * P, b, astride, 2 * np);
+                if (mode == reduce_tri) {
+                    gatherTri(src, sstride, uw, P, r, x0, np, pixels);
+                    deinterleave3(dm, pixels, g, gstride, np);
+                }
+                for (int c = 0; c < 3; c++)
+                    reduceRow<T, s, mode>(a + c * astride, b + c * astride, g + c * gstride,
+                                          d + c * gstride, np * s, m);
+                interleave3(im, d, gstride, dst + x0 * P, np);
+            }
+        }
+    }
+
+    // 3 channel float pixels, in the low 3 elements of a vector
+    inline __m128 load3(const char* p)
+    {
+        return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double*) p)),
+                             _mm_load_ss((const float*) p + 2));
+    }
+
+    inline void store3(char* p, __m128 v)
+    {
+        _mm_storel_pi((__m64*) p, v);
+        _mm_store_ss((float*) p + 2, _mm_movehl_ps(v, v));
+    }
+
+    // faces of 3 channel floats, a pixel at a time (the fourth element
+    // overlaps the next pixel, except at the end of a row)
+    template<ReduceMode mode>
+    void reduceFloat3(const char* src, int sstride, int uw, int vw, char* dst, int dstride)
+    {
+        const int P = 12, nx = uw / 2;
+        int rows = mode == reduce_u ? vw : mode == reduce_tri ? uw / 2 : vw / 2;
+        int rowstep = mode == reduce_u ? sstride : 2 * sstride;
+        const char* sp = src;
+        for (int r = 0; r < rows; r++, sp += rowstep, dst += dstride) {
+            const char* a = sp, * b = sp + sstride;
+            const char* g = src + (uw - 1) * sstride + (uw - 1 - 2 * r) * P;
+            char* d = dst;
+            for (int x = 0; x < nx; x++, a += 2 * P, b += 2 * P, g -= 2 * sstride, d += P) {
+                bool last = x == nx - 1;
+                __m128 a0 = _mm_loadu_ps((const float*) a);
+                __m128 a1 = last ? load3(a + P) : _mm_loadu_ps((const float*) (a + P));
+                __m128 v;
+                if (mode == reduce_u) v = Avg<float>::avg2f(a0, a1);
+                else {
+                    __m128 b0 = _mm_loadu_ps((const float*) b);
+                    __m128 b1 = mode == reduce_tri ? load3(g)
+                        : last ? load3(b + P) : _mm_loadu_ps((const float*) (b + P));
+                    v = Avg<float>::avg4f(a0, a1, b0, b1);
+                }
+                if (last) store3(d, v);
+                else _mm_storeu_ps((float*) d, v);
+            }
+        }
+    }
+
+    template<typename T, ReduceMode mode>
+    void reduce(const void* src, int sstride, int uw, int vw, void* dst, int dstride, int nchan)
+    {
+        const char* s = (const char*) src;
+        char* d = (char*) dst;
+        const int size = sizeof(T);
+        switch (nchan) {
+        case 1: reducePixels<T, size, mode>(s, sstride, uw, vw, d, dstride); break;
+        case 2: reducePixels<T, 2 * size, mode>(s, sstride, uw, vw, d, dstride); break;
+        case 3:
+            if (size == 4) reduceFloat3<mode>(s, sstride, uw, vw, d, dstride);
+            else reducePlanes<T, mode>(s, sstride, uw, vw, d, dstride);
+            break;
+        case 4: reducePixels<T, 4 * size, mode>(s, sstride, uw, vw, d, dstride); break;
+        }
+    }
+
+    template<typename T>
+    void reducev(const void* src, int sstride, int uw, int vw,
+                 void* dst, int dstride, int nchan)
+    {
+        // element-wise, whatever the number of channels
+        const char* s = (const char*) src;
+        char* d = (char*) dst;
+        int n = uw * nchan * int(sizeof(T));
+        for (int v = 0; v < vw / 2; v++, s += 2 * sstride, d += dstride) {
+            const char* a = s, * b = s + sstride;
+            int i = 0;
+            for (; i + 32 <= n; i += 32) {
+                __m256i r = Avg<T>::avg2(_mm256_loadu_si256((const __m256i*) (a + i)),
+                                         _mm256_loadu_si256((const __m256i*) (b + i)));
+                _mm256_storeu_si256((__m256i*) (d + i), r);
+            }
+            if (i < n) {
+                char ta[32] = { 0 }, tb[32] = { 0 };
+                memcpy(ta, a + i, n - i);
+                memcpy(tb, b + i, n - i);
+                __m256i r = Avg<T>::avg2(_mm256_loadu_si256((const __m256i*) ta),
+                                         _mm256_loadu_si256((const __m256i*) tb));
+                _mm256_storeu_si256((__m256i*) ta, r);
+                memcpy(d + i, ta, n - i);
+            }
+        }
+    }
+
+    /* Conversions of uint8 and uint16 data to and from float, with the
+       same arithmetic as ConvertToFloat and ConvertFromFloat. */
+
+    template<typename T>
+    void toFloat(float* dst, const void* srcArg, int n)
+    {
+        const T* src = (const T*) srcArg;
+        const int s = sizeof(T), block = 16 / s;
+        const __m256 scale = _mm256_set1_ps(s == 1 ? 1.f/255.f : 1.f/65535.f);
+        int i = 0;
+        for (; i + block <= n; i += block) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+            for (int j = 0; j < block; j += 8, v = _mm_srli_si128(v, 8)) {
+                __m256i w = s == 1 ? _mm256_cvtepu8_epi32(v) : _mm256_cvtepu16_epi32(v);
+                _mm256_storeu_ps(dst + i + j, _mm256_mul_ps(_mm256_cvtepi32_ps(w), scale));
+            }
+        }
+        toFloatTail(dst, src, i, n);
+    }
+
+    // 8 floats clamped to [0,1] (max and min return the second operand
+    // for nans, like PtexUtils::clamp), scaled and rounded
+    inline __m256i fromFloat(const float* p, __m256 scale)
+    {
+        __m256 f = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(p), _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(f, scale), _mm256_set1_ps(0.5f)));
+    }
+
+    template<typename T>
+    void fromFloat(void* dstArg, const float* src, int n)
+    {
+        T* dst = (T*) dstArg;
+        const int s = sizeof(T), block = 32 / s;
+        const __m256 scale = _mm256_set1_ps(s == 1 ? 255.0f : 65535.0f);
+        int i = 0;
+        for (; i + block <= n; i += block) {
+            // the packs work within each lane, leaving 4 byte groups out of order
+            const float* p = src + i;
+            __m256i r = _mm256_packus_epi32(fromFloat(p, scale), fromFloat(p + 8, scale));
+            if (s == 1) {
+                r = _mm256_packus_epi16(r, _mm256_packus_epi32(fromFloat(p + 16, scale), fromFloat(p + 24, scale)));
+                r = _mm256_permutevar8x32_epi32(r, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+            }
+            else r = _mm256_permute4x64_epi64(r, 0xd8);
+            _mm256_storeu_si256((__m256i*) (dst + i), r);
+        }
+        fromFloatTail(dst, src, i, n);
+    }
+
+    /* Separable filter kernels.  To give exactly the same results as the
+       scalar code, each row is summed in u order (then multiplied by its
+       weight and added to the result in v order), so the vectors hold
+       either the channels of a pixel, or the same channel of several
+       rows. */
+
+    const int maxKernelWidth = 10; // PtexSeparableKernel::kmax
+    const int maxRowLen = maxKernelWidth * 4 + 8; // with 4 channels, and padding
+
+    // 4 values converted to float (without the scale that ConvertToFloat applies)
+    template<typename T> inline __m128 load4(const T* p);
+
+    template<> inline __m128 load4(const uint8_t* p)
+    {
+        int v; memcpy(&v, p, 4);
+        return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)));
+    }
+
+    template<> inline __m128 load4(const uint16_t* p)
+    { return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) p))); }
+
+    // (signaling nans get quieted, but so does the product with the weight)
+    template<> inline __m128 load4(const Half* p)
+    { return _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*) p)); }
+
+    template<> inline __m128 load4(const float* p)
+    { return _mm_loadu_ps(p); }
+
+    inline __m256 combine(__m128 lo, __m128 hi)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+    }
+
+    // the kernel rows, where any row that the 4 value loads could read past
+    // end from is copied to buf, zero padded
+    template<typename T>
+    void kernelRows(const T* data, const T* end, int rowlen, int span, int vw,
+                    const T* rows[maxKernelWidth], T buf[][maxRowLen])
+    {
+        for (int j = 0; j < vw; j++) {
+            const T* p = data + j * rowlen;
+            rows[j] = p;
+            if (end - p < span + 4) {
+                memset(buf[j], 0, sizeof(buf[j]));
+                memcpy(buf[j], p, (end - p < span ? end - p : span) * sizeof(T));
+                rows[j] = buf[j];
+            }
+        }
+    }
+
+    // 1 or 2 channels: a row per element, up to 8 rows at a time (the
+    // first 4 in the low lane), from 4x4 blocks of values transposed in
+    // each lane
+    template<typename T>
+    void applyRows(float* result, const void* data, const void* end, int rowlen,
+                   int nTxChan, int nChan, int uw, int vw, const float* ku, const float* kv)
+    {
+        const T* rows[maxKernelWidth];
+        T buf[maxKernelWidth][maxRowLen];
+        int span = uw * nTxChan;
+        kernelRows((const T*) data, (const T*) end, rowlen, span, vw, rows, buf);
+
+        const __m128 zero = _mm_setzero_ps();
+        for (int j0 = 0; j0 < vw; j0 += 8) {
+            int nrows = vw - j0 < 8 ? vw - j0 : 8;
+            const T* const* r = rows + j0;
+            __m256 acc[2] = { _mm256_setzero_ps(), _mm256_setzero_ps() };
+            for (int q0 = 0, u = 0, c = 0; q0 < span; q0 += 4) {
+                __m256 v[4];
+                for (int i = 0; i < 4; i++) {
+                    __m128 lo = i < nrows ? load4(r[i] + q0) : zero;
+                    v[i] = nrows > 4 ? combine(lo, i + 4 < nrows ? load4(r[i+4] + q0) : zero)
+                                     : _mm256_castps128_ps256(lo);
+                }
+                // transpose: v[q] is value q0+q of each row
+                __m256 t0 = _mm256_unpacklo_ps(v[0], v[1]), t1 = _mm256_unpackhi_ps(v[0], v[1]);
+                __m256 t2 = _mm256_unpacklo_ps(v[2], v[3]), t3 = _mm256_unpackhi_ps(v[2], v[3]);
+                v[0] = _mm256_shuffle_ps(t0, t2, 0x44);
+                v[1] = _mm256_shuffle_ps(t0, t2, 0xee);
+                v[2] = _mm256_shuffle_ps(t1, t3, 0x44);
+                v[3] = _mm256_shuffle_ps(t1, t3, 0xee);
+                for (int q = 0; q < 4 && q0 + q < span; q++) {
+                    if (c < nChan) {
+                        __m256 m = _mm256_mul_ps(v[q], _mm256_set1_ps(ku[u]));
+                        acc[c] = u ? _mm256_add_ps(acc[c], m) : m;
+                    }
+                    if (++c == nTxChan) { c = 0; u++; }
+                }
+            }
+            // result[c] += row[c] * kv[j], a row at a time
+            __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(nrows), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            __m256 w = _mm256_maskload_ps(kv + j0, mask);
+            for (int c = 0; c < nChan; c++) {
+                float m[8];
+                _mm256_storeu_ps(m, _mm256_mul_ps(acc[c], w));
+                for (int j = 0; j < nrows; j++) result[c] += m[j];
+            }
+        }
+    }
+
+    // 3 or 4 channels: a pixel per 128 bits, two rows at a time
+    template<typename T>
+    void applyPixels(float* result, const void* data, const void* end, int rowlen,
+                     int nTxChan, int nChan, int uw, int vw, const float* ku, const float* kv)
+    {
+        const T* rows[maxKernelWidth];
+        T buf[maxKernelWidth][maxRowLen];
+        kernelRows((const T*) data, (const T*) end, rowlen, uw * nTxChan, vw, rows, buf);
+
+        __m128 res = nChan == 4 ? _mm_loadu_ps(result) : _mm_setr_ps(result[0], result[1], result[2], 0);
+        int j = 0;
+        for (; j + 2 <= vw; j += 2) {
+            const T* a = rows[j], * b = rows[j+1];
+            __m256 acc = _mm256_mul_ps(combine(load4(a), load4(b)), _mm256_set1_ps(ku[0]));
+            for (int u = 1; u < uw; u++) {
+                a += nTxChan; b += nTxChan;
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(combine(load4(a), load4(b)), _mm256_set1_ps(ku[u])));
+            }
+            res = _mm_add_ps(res, _mm_mul_ps(_mm256_castps256_ps128(acc), _mm_set1_ps(kv[j])));
+            res = _mm_add_ps(res, _mm_mul_ps(_mm256_extractf128_ps(acc, 1), _mm_set1_ps(kv[j+1])));
+        }
+        if (j < vw) {
+            const T* a = rows[j];
+            __m128 acc = _mm_mul_ps(load4(a), _mm_set1_ps(ku[0]));
+            for (int u = 1; u < uw; u++) {
+                a += nTxChan;
+                acc = _mm_add_ps(acc, _mm_mul_ps(load4(a), _mm_set1_ps(ku[u])));
+            }
+            res = _mm_add_ps(res, _mm_mul_ps(acc, _mm_set1_ps(kv[j])));
+        }
+        if (nChan == 4) _mm_storeu_ps(result, res);
+        else {
+            float r[4];
+            _mm_storeu_ps(r, res);
+            result[0] = r[0]; result[1] = r[1]; result[2] = r[2];
+        }
+    }
+}
+
+
+namespace PtexSIMD {
+
+const Kernels avx2Kernels = {
+    { { interleave3<1>, interleave4<1> },
+      { interleave3<2>, interleave4<2> },
+      { interleave3<4>, interleave4<4> } },
+    { { deinterleave3<1>, deinterleave4<1> },
+      { deinterleave3<2>, deinterleave4<2> },
+      { deinterleave3<4>, deinterleave4<4> } },
+    { encodeDifference<uint8_t>, encodeDifference<uint16_t> },
+    { decodeDifference<uint8_t>, decodeDifference<uint16_t> },
+    { { reduce<uint8_t, reduce_uv>, reduce<uint16_t, reduce_uv>,
+        reduce<Half, reduce_uv>, reduce<float, reduce_uv> },
+      { reduce<uint8_t, reduce_u>, reduce<uint16_t, reduce_u>,
+        reduce<Half, reduce_u>, reduce<float, reduce_u> },
+      { reducev<uint8_t>, reducev<uint16_t>, reducev<Half>, reducev<float> },
+      { reduce<uint8_t, reduce_tri>, reduce<uint16_t, reduce_tri>,
+        reduce<Half, reduce_tri>, reduce<float, reduce_tri> } },
+    halfToFloat, floatToHalf,
+    { toFloat<uint8_t>, toFloat<uint16_t> },
+    { fromFloat<uint8_t>, fromFloat<uint16_t> },
+    // 1 and 2 channel rows only pay off for the cost of half conversion
+    { { 0, 0, applyRows<Half>, 0 },
+      { 0, 0, applyRows<Half>, 0 },
+      { applyPixels<uint8_t>, applyPixels<uint16_t>, applyPixels<Half>, applyPixels<float> },
+      { applyPixels<uint8_t>, applyPixels<uint16_t>, applyPixels<Half>, applyPixels<float> } }
+};
+
+} // namespace PtexSIMD
+
+PTEX_NAMESPACE_END
@@ -0,0 +1,107 @@
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#include "PtexPlatform.h"
+#include "PtexBlockCache.h"
+
+PTEX_NAMESPACE_BEGIN
+
+void PtexBlockCache::setMaxMem(size_t maxMem)
+{
+    AutoMutex locker(_lock);
+    _maxMem = maxMem;
+    trim(maxMem);
+}
+
+
+bool PtexBlockCache::get(const void* owner, FilePos pos, std::vector<char>& data)
+{
+    AutoMutex locker(_lock);
+    BlockMap::iterator i = _blocks.find(Key(owner, pos));
+    if (i == _blocks.end()) return false;
+    _lru.splice(_lru.begin(), _lru, i->second.lruItem);
+    data = i->second.data;
+    _hits++;
+    return true;
+}
+
+
+bool PtexBlockCache::contains(const void* owner, FilePos pos)
+{
+    AutoMutex locker(_lock);
+    return _blocks.find(Key(owner, pos)) != _blocks.end();
+}
+
+
+void PtexBlockCache::add(const void* owner, FilePos pos, const char* data, int size)
+{
+    size_t blockMem = size_t(size) + BlockOverhead;
+    AutoMutex locker(_lock);
+    if (size <= 0 || blockMem > _maxMem) return;
+    Key key(owner, pos);
+    if (_blocks.find(key) != _blocks.end()) return; // added by another thread
+    trim(_maxMem - blockMem);
+    Block& block = _blocks[key];
+    block.data.assign(data, data + size);
+    _lru.push_front(key);
+    block.lruItem = _lru.begin();
+    _memUsed += blockMem;
+}
+
+
+void PtexBlockCache::remove(const void* owner)
+{
+    AutoMutex locker(_lock);
+    BlockMap::iterator i = _blocks.lower_bound(Key(owner, 0));
+    while (i != _blocks.end() && i->first.owner == owner) erase(i++);
+}
+
+
+void PtexBlockCache::trim(size_t maxMem)
+{
+    // free least recently used blocks until within maxMem (lock must be held)
+    while (_memUsed > maxMem && !_lru.empty())
+        erase(_blocks.find(_lru.back()));
+}
+
+
+void PtexBlockCache::erase(BlockMap::iterator i)
+{
+    _memUsed -= i->second.data.size() + BlockOverhead;
+    _lru.erase(i->second.lruItem);
+    _blocks.erase(i);
+}
+
+PTEX_NAMESPACE_END
@@ -0,0 +1,115 @@
+#ifndef PtexBlockCache_h
+#define PtexBlockCache_h
+
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+/**
+  @file PtexBlockCache.h
+  @brief Contains PtexBlockCache, a byte-limited lru cache of compressed face data.
+*/
+
+#include <list>
+#include <map>
+#include <vector>
+#include "PtexPlatform.h"
+#include "PtexMutex.h"
+
+PTEX_NAMESPACE_BEGIN
+
+/** Byte-limited cache of compressed data blocks, keyed by owner and
+    file position.  Blocks are freed in lru order when the limit is
+    exceeded.  All access is serialized with a mutex; the cache is only
+    consulted when face data isn't already loaded, where the cost of
+    the lock is small relative to decompression.
+ */
+class PtexBlockCache
+{
+public:
+    PtexBlockCache() : _maxMem(0), _memUsed(0), _hits(0) {}
+
+    /** Set the memory limit, freeing blocks as needed.  Zero disables the cache. */
+    void setMaxMem(size_t maxMem);
+    size_t maxMem() const { return _maxMem; }
+
+    /** Copy the block at pos into data.  Returns false if not cached. */
+    bool get(const void* owner, FilePos pos, std::vector<char>& data);
+
+    /** True if the block at pos is cached. */
+    bool contains(const void* owner, FilePos pos);
+
+    /** Add a copy of a block, freeing the least recently used blocks
+        as needed to stay within the limit. */
+    void add(const void* owner, FilePos pos, const char* data, int size);
+
+    /** Free all blocks of an owner (e.g. when its file is purged). */
+    void remove(const void* owner);
+
+    size_t memUsed() const { return _memUsed; }
+    uint64_t hits() const { return _hits; }
+
+private:
+    PtexBlockCache(const PtexBlockCache&);
+    void operator=(const PtexBlockCache&);
+
+    struct Key {
+        const void* owner;
+        FilePos pos;
+        Key(const void* ownerArg, FilePos posArg) : owner(ownerArg), pos(posArg) {}
+        bool operator<(const Key& k) const { return owner < k.owner || (owner == k.owner && pos < k.pos); }
+    };
+    typedef std::list<Key> LruList;
+    struct Block {
+        std::vector<char> data;
+        LruList::iterator lruItem;
+    };
+    typedef std::map<Key, Block> BlockMap;
+
+    // memory accounted per block in addition to its data (map and list nodes)
+    enum { BlockOverhead = sizeof(BlockMap::value_type) + sizeof(Key) + 8*sizeof(void*) };
+
+    void trim(size_t maxMem);
+    void erase(BlockMap::iterator i);
+
+    Mutex _lock;
+    BlockMap _blocks;
+    LruList _lru;                   // most recently used at front
+    volatile size_t _maxMem;
+    volatile size_t _memUsed;
+    volatile uint64_t _hits;
+};
+
+PTEX_NAMESPACE_END
+
+#endif
@@ -41,7 +41,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
    The cache owns all files and data.  If a texture is in use, the
    cache will not touch it.  When it is no longer in use, it may be
    kept or deleted to keep resource usage under the set limits.
-   Deletions are done in lru order.
+   Files are closed in lru order.  Data is freed a face (or tile) at
+   a time, using a clock over the faces of all files not in use.  The
+   clock either frees data not used recently (the default) or, with
+   cp_frequency, also counts uses so that data used only once is freed
+   before frequently used data (see setCachePolicy).  Optionally, the
+   compressed blocks of faces are kept beneath the decoded data, within
+   a separate limit (see setBlockCacheSize and PtexBlockCache), and
+   decoded face data is shared with other processes on the node through
+   shared memory (see setSharedCache and PtexSharedCache) and kept on
+   local disk across runs (see setDiskCache and PtexDiskCache).
 
    <b> Resource Tracking.</b>
    All textures are created as part of the cache and have a ptr back to
@@ -88,6 +97,30 @@ void PtexCachedReader::release()
 }
 
 
+int PtexCachedReader::submitTileTasks(TileLoader* loader, int maxTasks)
+{
+    return _cache->submitTileTasks(loader, maxTasks);
+}
+
+
+PtexBlockCache* PtexCachedReader::blockCache()
+{
+    return _cache->blockCache();
+}
+
+
+PtexSharedCache* PtexCachedReader::sharedCache()
+{
+    return _cache->sharedCache();
+}
+
+
+PtexDiskCache* PtexCachedReader::diskCache()
+{
+    return _cache->diskCache();
+}
+
+
 bool PtexReaderCache::findFile(const char*& filename, std::string& buffer, Ptex::String& error)
 {
     bool isAbsolute = (filename[0] == '/'
@@ -134,6 +167,8 @@ PtexTexture* PtexReaderCache::get(const char* filename, Ptex::String& error)
         reader->ref();
     } else {
         reader = new PtexCachedReader(_premultiply, _io, _err, this);
+        reader->setIndexCachePath(_indexcachepath.c_str());
+        reader->setOpenReadSize(_openReadSize);
         isNew = true;
     }
 
@@ -269,17 +304,44 @@ void PtexReaderCache::pruneFiles()
 
 void PtexReaderCache::pruneData()
 {
+    // evict unused face data from files that aren't in use, starting with
+    // the least recently released (see PtexReader::evictUnused).  Files
+    // that were visited go to the back of the list, so the list and the
+    // faces within each file together act as one clock over all faces.
     size_t memUsedChangeTotal = 0;
     size_t memUsed = _memUsed;
+    std::vector<PtexCachedReader*> visited;
+    CachePolicy policy = _cachePolicy;
     while (memUsed + memUsedChangeTotal > _maxMem) {
         PtexCachedReader* reader = _activeFiles.pop();
         if (!reader) break;
         size_t memUsedChange;
-        if (reader->tryPrune(memUsedChange)) {
-            // Note: after clearing, memUsedChange is negative
+        if (reader->tryEvict(memUsed + memUsedChangeTotal - _maxMem, policy, memUsedChange)) {
+            // Note: after evicting, memUsedChange is negative
             memUsedChangeTotal += memUsedChange;
+            visited.push_back(reader);
         }
     }
+
+    // go around again (uses of data kept on the previous visit have been
+    // counted down); with cp_frequency, data may be kept for a visit per use
+    int turns = policy == cp_frequency ? int(PtexReader::MaxUses) : 2;
+    for (int turn = 1; turn < turns && memUsed + memUsedChangeTotal > _maxMem; turn++) {
+        for (size_t i = 0; i < visited.size() && memUsed + memUsedChangeTotal > _maxMem; i++) {
+            size_t memUsedChange;
+            if (visited[i]->tryEvict(memUsed + memUsedChangeTotal - _maxMem, policy, memUsedChange))
+                memUsedChangeTotal += memUsedChange;
+        }
+    }
+
+    // if still over, drop everything else held by the files (levels, meta data, etc.)
+    for (size_t i = 0; i < visited.size() && memUsed + memUsedChangeTotal > _maxMem; i++) {
+        size_t memUsedChange;
+        if (visited[i]->tryPrune(memUsedChange))
+            memUsedChangeTotal += memUsedChange;
+    }
+
+    for (size_t i = 0; i < visited.size(); i++) _activeFiles.push(visited[i]);
     adjustMemUsed(memUsedChangeTotal);
 }
 
@@ -323,6 +385,142 @@ void PtexReaderCache::purgeAll()
     adjustMemUsed(purger.memUsedChangeTotal);
 }
 
+PtexPrefetch* PtexReaderCache::prefetch(const char* path, int nfaces, const int* faceids,
+                                        const Ptex::Res* res)
+{
+    Ptex::String error;
+    PtexTexture* texture = get(path, error);
+    if (!texture) {
+        if (error.empty()) return 0;
+        if (_err) _err->reportError(error.c_str());
+        else std::cerr << error.c_str() << std::endl;
+        return 0;
+    }
+
+    PtexPrefetchRequest* request = new PtexPrefetchRequest(this, texture, nfaces, faceids, res);
+    AutoMutex locker(_workerPoolLock);
+    if (!_workerPool && _numWorkerThreads > 0)
+        _workerPool = new PtexThreadPool(_numWorkerThreads);
+    request->submitTasks(_workerPool);
+    return request;
+}
+
+
+int PtexReaderCache::submitTileTasks(PtexReader::TileLoader* loader, int maxTasks)
+{
+    if (!_parallelTileLoading || _stopping) return 0;
+    AutoMutex locker(_workerPoolLock);
+    int ntasks = std::min(maxTasks, _numWorkerThreads);
+    if (ntasks <= 0) return 0;
+    if (!_workerPool)
+        _workerPool = new PtexThreadPool(_numWorkerThreads);
+    for (int i = 0; i < ntasks; i++)
+        _workerPool->submit(loader->newTask());
+    return ntasks;
+}
+
+
+bool PtexReaderCache::setSharedCache(const char* name, size_t size, Ptex::String& error)
+{
+    if (_sharedCache || _files.size()) {
+        error = "Shared cache must be set once, before any files are opened";
+        return false;
+    }
+    std::string errstr;
+    _sharedCache = PtexSharedCache::open(name, size, errstr);
+    if (!_sharedCache) error = errstr.c_str();
+    return _sharedCache != 0;
+}
+
+
+void PtexReaderCache::setNumWorkerThreads(int numThreads)
+{
+    AutoMutex locker(_workerPoolLock);
+    if (numThreads < 0) numThreads = 0;
+    if (numThreads == _numWorkerThreads) return;
+    _numWorkerThreads = numThreads;
+    // new pool will be created on demand
+    delete _workerPool;
+    _workerPool = 0;
+}
+
+
+PtexPrefetchRequest::PtexPrefetchRequest(PtexReaderCache* cache, PtexTexture* texture,
+                                         int nfaces, const int* faceids, const Ptex::Res* res)
+    : _cache(cache), _texture(texture),
+      _faceids(faceids, faceids + (nfaces > 0 ? nfaces : 0)),
+      _refCount(1), _pending(0)
+{
+    if (res) _res.assign(res, res + _faceids.size());
+}
+
+
+void PtexPrefetchRequest::submitTasks(PtexThreadPool* pool)
+{
+    int nfaces = int(_faceids.size());
+    int ntasks = (nfaces + facesPerTask - 1) / facesPerTask;
+    if (ntasks == 0) {
+        // nothing to load
+        _texture->release();
+        return;
+    }
+
+    // each task holds a ref to the request until it is finished
+    _pending = ntasks;
+    for (int i = 0; i < ntasks; i++) {
+        ref();
+        LoadTask* task = new LoadTask(this, i * facesPerTask,
+                                      PtexUtils::min(nfaces, (i+1) * facesPerTask));
+        if (pool) pool->submit(task);
+        else { task->run(); delete task; }
+    }
+}
+
+
+void PtexPrefetchRequest::LoadTask::run()
+{
+    _request->load(_begin, _end);
+    _request->taskDone();
+    _request->unref();
+}
+
+
+void PtexPrefetchRequest::load(int begin, int end)
+{
+    int nfaces = _texture->numFaces();
+    for (int i = begin; i < end; i++) {
+        if (_cache->stopping()) return;
+        int faceid = _faceids[i];
+        if (faceid < 0 || faceid >= nfaces) continue;
+        PtexPtr<PtexFaceData> data ( _res.empty() ? _texture->getData(faceid)
+                                     : _texture->getData(faceid, _res[i]) );
+        if (data->isTiled()) {
+            for (int tile = 0, ntiles = data->res().ntiles(data->tileRes()); tile < ntiles; tile++) {
+                PtexPtr<PtexFaceData> tiledata ( data->getTile(tile) );
+            }
+        }
+    }
+}
+
+
+void PtexPrefetchRequest::taskDone()
+{
+    if (0 == AtomicDecrement(&_pending)) {
+        // all done, return texture to cache and wake up any waiting threads
+        _texture->release();
+        AutoMonitor locker(_monitor);
+        _monitor.notifyAll();
+    }
+}
+
+
+void PtexPrefetchRequest::wait()
+{
+    AutoMonitor locker(_monitor);
+    while (_pending) _monitor.wait();
+}
+
+
 void PtexReaderCache::getStats(Stats& stats)
 {
     stats.memUsed = _memUsed;
@@ -334,4 +532,18 @@ void PtexReaderCache::getStats(Stats& stats)
     stats.blockReads = _blockReads;
 }
 
+void PtexReaderCache::getTierStats(TierStats& stats)
+{
+    TierStats all;
+    all.blockCacheMemUsed = _blockCache.memUsed();
+    all.blockCacheHits = _blockCache.hits();
+    all.sharedCacheHits = _sharedCache ? _sharedCache->hits() : 0;
+    all.diskCacheHits = _diskCache.hits();
+
+    // copy only the fields the caller was compiled with
+    size_t start = (char*)&all.blockCacheMemUsed - (char*)&all;
+    size_t end = PtexUtils::min(size_t(stats.__structSize), sizeof(TierStats));
+    if (end > start) memcpy((char*)&stats + start, (char*)&all + start, end - start);
+}
+
 PTEX_NAMESPACE_END
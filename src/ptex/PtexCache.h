@@ -42,6 +42,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include "PtexMutex.h"
 #include "PtexHashMap.h"
 #include "PtexReader.h"
+#include "PtexThreadPool.h"
+#include "PtexBlockCache.h"
+#include "PtexSharedCache.h"
+#include "PtexDiskCache.h"
 
 PTEX_NAMESPACE_BEGIN
 
@@ -147,6 +151,11 @@ public:
         return AtomicDecrement(&_refCount);
     }
 
+    virtual int submitTileTasks(TileLoader* loader, int maxTasks);
+    virtual PtexBlockCache* blockCache();
+    virtual PtexSharedCache* sharedCache();
+    virtual PtexDiskCache* diskCache();
+
     virtual void release();
 
     bool tryPrune(size_t& memUsedChange) {
@@ -159,6 +168,16 @@ public:
         return false;
     }
 
+    bool tryEvict(size_t target, CachePolicy policy, size_t& memUsedChange) {
+        if (trylock()) {
+            evictUnused(target, policy);
+            memUsedChange = getMemUsedChange();
+            unlock();
+            return true;
+        }
+        return false;
+    }
+
     bool tryPurge(size_t& memUsedChange) {
         if (trylock()) {
             purge();
@@ -193,14 +212,63 @@ public:
 };
 
 
+/** Asynchronous prefetch request (see PtexCache::prefetch).
+    Faces are loaded in batches by the cache's worker threads; the
+    texture is held open until the last batch is finished. */
+class PtexPrefetchRequest : public PtexPrefetch
+{
+public:
+    PtexPrefetchRequest(PtexReaderCache* cache, PtexTexture* texture,
+                        int nfaces, const int* faceids, const Ptex::Res* res);
+
+    virtual void release() { unref(); }
+    virtual bool isDone() { return _pending == 0; }
+    virtual void wait();
+
+    /// Create the tasks that load the faces (one per batch).
+    void submitTasks(PtexThreadPool* pool);
+
+private:
+    class LoadTask : public PtexThreadPool::Task
+    {
+        PtexPrefetchRequest* _request;
+        int _begin, _end;
+    public:
+        LoadTask(PtexPrefetchRequest* request, int begin, int end)
+            : _request(request), _begin(begin), _end(end) {}
+        virtual void run();
+    };
+
+    // number of faces loaded by each task
+    static const int facesPerTask = 16;
+
+    virtual ~PtexPrefetchRequest() {}
+    void ref() { AtomicIncrement(&_refCount); }
+    void unref() { if (0 == AtomicDecrement(&_refCount)) delete this; }
+    void load(int begin, int end);
+    void taskDone();
+
+    PtexReaderCache* _cache;
+    PtexTexture* _texture;
+    std::vector<int> _faceids;
+    std::vector<Ptex::Res> _res;
+    volatile int32_t _refCount;
+    volatile int32_t _pending;
+    Monitor _monitor;
+};
+
+
 /** Cache for reading Ptex texture files */
 class PtexReaderCache : public PtexCache
 {
 public:
     PtexReaderCache(int maxFiles, size_t maxMem, bool premultiply, PtexInputHandler* inputHandler, PtexErrorHandler* errorHandler)
-        : _maxFiles(maxFiles), _maxMem(maxMem), _io(inputHandler), _err(errorHandler), _premultiply(premultiply),
+        : _maxFiles(maxFiles), _maxMem(maxMem), _io(inputHandler), _err(errorHandler),
+          _openReadSize(OpenReadSize), _premultiply(premultiply),
           _memUsed(sizeof(*this)), _filesOpen(0), _mruList(&_mruLists[0]), _prevMruList(&_mruLists[1]),
-          _peakMemUsed(0), _peakFilesOpen(0), _fileOpens(0), _blockReads(0)
+          _peakMemUsed(0), _peakFilesOpen(0), _fileOpens(0), _blockReads(0),
+          _numWorkerThreads(2), _workerPool(0), _parallelTileLoading(false), _stopping(false),
+          _cachePolicy(cp_recency), _sharedCache(0)
     {
         memset((void*)&_mruLists[0], 0, sizeof(_mruLists));
         CACHE_LINE_PAD_INIT(_memUsed); // keep cppcheck happy
@@ -209,7 +277,14 @@ public:
     }
 
     ~PtexReaderCache()
-    {}
+    {
+        // finish (or skip) pending async requests before destroying files
+        _stopping = true;
+        delete _workerPool;
+        // faces may be pinned in the shared cache until their files are deleted
+        _files.clear();
+        delete _sharedCache;
+    }
 
     virtual void release() { delete this; }
 
@@ -247,6 +322,31 @@ public:
     virtual void purge(const char* /*filename*/);
     virtual void purgeAll();
     virtual void getStats(Stats& stats);
+    virtual PtexPrefetch* prefetch(const char* path, int nfaces, const int* faceids,
+                                   const Ptex::Res* res);
+    virtual void setNumWorkerThreads(int numThreads);
+    virtual void setIndexCachePath(const char* path) { _indexcachepath = path ? path : ""; }
+    virtual void setOpenReadSize(size_t size) { _openReadSize = size; }
+    virtual void setParallelTileLoading(bool enable) { _parallelTileLoading = enable; }
+    virtual void setCachePolicy(Ptex::CachePolicy policy) { _cachePolicy = policy; }
+    virtual void setBlockCacheSize(size_t maxMem) { _blockCache.setMaxMem(maxMem); }
+    virtual bool setSharedCache(const char* name, size_t size, Ptex::String& error);
+    virtual void setDiskCache(const char* path, size_t maxSize) { _diskCache.setPath(path, maxSize); }
+    virtual void getTierStats(TierStats& stats);
+
+    bool stopping() const { return _stopping; }
+
+    /// Submit tile loading tasks to the worker threads (see PtexReader::submitTileTasks).
+    int submitTileTasks(PtexReader::TileLoader* loader, int maxTasks);
+
+    /// Compressed face data of all files (see PtexReader::blockCache), or null if disabled.
+    PtexBlockCache* blockCache() { return _blockCache.maxMem() ? &_blockCache : 0; }
+
+    /// Decoded face data shared with other processes (see PtexReader::sharedCache), or null.
+    PtexSharedCache* sharedCache() { return _sharedCache; }
+
+    /// Decoded face data on local disk (see PtexReader::diskCache), or null if disabled.
+    PtexDiskCache* diskCache() { return _diskCache.enabled() ? &_diskCache : 0; }
 
     void purge(PtexCachedReader* reader);
 
@@ -281,6 +381,8 @@ private:
     PtexErrorHandler* _err;
     std::string _searchpath;
     std::vector<std::string> _searchdirs;
+    std::string _indexcachepath;
+    size_t _openReadSize;
     typedef PtexHashMap<StringKey,PtexCachedReader*> FileMap;
     FileMap _files;
     bool _premultiply;
@@ -304,6 +406,16 @@ private:
     size_t _peakFilesOpen;
     size_t _fileOpens;
     size_t _blockReads;
+
+    Mutex _workerPoolLock;
+    int _numWorkerThreads;
+    PtexThreadPool* _workerPool;    // created on demand
+    volatile bool _parallelTileLoading;
+    volatile bool _stopping;        // true when cache is being destroyed
+    volatile Ptex::CachePolicy _cachePolicy;
+    PtexBlockCache _blockCache;
+    PtexSharedCache* _sharedCache;
+    PtexDiskCache _diskCache;
 };
 
 PTEX_NAMESPACE_END
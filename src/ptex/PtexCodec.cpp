@@ -0,0 +1,404 @@
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#include "PtexPlatform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#ifdef PTEX_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#include "PtexCodec.h"
+#include "PtexMutex.h"
+#include "PtexUtils.h"
+
+PTEX_NAMESPACE_BEGIN
+
+namespace {
+    // Pool of decompressor objects shared by all readers.  Objects are only
+    // held for the duration of a single block decompression which allows
+    // blocks to be decompressed concurrently without keeping state per reader.
+    template <class T>
+    class Pool
+    {
+        SpinLock _lock;
+        std::vector<T*> _items;
+    public:
+        ~Pool()
+        {
+            for (size_t i = 0, n = _items.size(); i < n; i++) destroy(_items[i]);
+        }
+
+        T* acquire()
+        {
+            T* item = 0;
+            _lock.lock();
+            if (!_items.empty()) {
+                item = _items.back();
+                _items.pop_back();
+            }
+            _lock.unlock();
+            return item ? item : create();
+        }
+
+        void release(T* item)
+        {
+            _lock.lock();
+            _items.push_back(item);
+            _lock.unlock();
+        }
+
+    private:
+        static T* create();
+        static void destroy(T* item);
+    };
+
+    template<> z_stream* Pool<z_stream>::create()
+    {
+        z_stream* zstream = new z_stream;
+        memset(zstream, 0, sizeof(*zstream));
+        inflateInit(zstream);
+        return zstream;
+    }
+
+    template<> void Pool<z_stream>::destroy(z_stream* zstream)
+    {
+        inflateEnd(zstream);
+        delete zstream;
+    }
+
+    Pool<z_stream> inflateStreams;
+
+#ifdef PTEX_USE_LIBDEFLATE
+    template<> libdeflate_decompressor* Pool<libdeflate_decompressor>::create()
+    {
+        return libdeflate_alloc_decompressor();
+    }
+
+    template<> void Pool<libdeflate_decompressor>::destroy(libdeflate_decompressor* d)
+    {
+        libdeflate_free_decompressor(d);
+    }
+
+    Pool<libdeflate_decompressor> decompressors;
+
+    // compressors are allocated on first use since the level isn't known here
+    struct Compressor {
+        libdeflate_compressor* compressor;
+    };
+
+    template<> Compressor* Pool<Compressor>::create()
+    {
+        Compressor* c = new Compressor;
+        c->compressor = 0;
+        return c;
+    }
+
+    template<> void Pool<Compressor>::destroy(Compressor* c)
+    {
+        if (c->compressor) libdeflate_free_compressor(c->compressor);
+        delete c;
+    }
+
+    Pool<Compressor> compressors[2]; // uncompressed and compressed
+#endif
+
+    bool available(ZipBackend backend)
+    {
+        switch (backend) {
+        case zb_zlibStream:
+        case zb_zlib:
+            return true;
+        case zb_libdeflate:
+#ifdef PTEX_USE_LIBDEFLATE
+            return true;
+#else
+            return false;
+#endif
+        }
+        return false;
+    }
+
+    ZipBackend initialBackend()
+    {
+        // can be overridden with $PTEX_ZIP_BACKEND (set to a backend name)
+        const char* name = getenv("PTEX_ZIP_BACKEND");
+        if (name) {
+            for (int i = 0; i <= zb_libdeflate; i++) {
+                ZipBackend backend = ZipBackend(i);
+                if (strcmp(name, ZipBackendName(backend)) == 0 && available(backend))
+                    return backend;
+            }
+        }
+#ifdef PTEX_USE_LIBDEFLATE
+        return zb_libdeflate;
+#else
+        return zb_zlib;
+#endif
+    }
+
+    volatile ZipBackend currentBackend = initialBackend();
+}
+
+
+bool SetZipBackend(ZipBackend backend)
+{
+    if (!available(backend)) return false;
+    currentBackend = backend;
+    return true;
+}
+
+
+ZipBackend GetZipBackend()
+{
+    return currentBackend;
+}
+
+
+namespace PtexCodec {
+
+bool inflateBlock(void* data, int unzipsize, const void* zipdata, int zipsize)
+{
+    if (zipsize < 0 || unzipsize < 0) return false;
+    if (isLz4Block(zipdata, zipsize))
+        return decompressLz4(data, unzipsize, zipdata, zipsize);
+#ifdef PTEX_USE_LIBDEFLATE
+    if (currentBackend == zb_libdeflate) {
+        libdeflate_decompressor* d = decompressors.acquire();
+        if (!d) return false;
+        libdeflate_result result =
+            libdeflate_zlib_decompress(d, zipdata, size_t(zipsize), data, size_t(unzipsize), 0);
+        decompressors.release(d);
+        return result == LIBDEFLATE_SUCCESS;
+    }
+#endif
+    z_stream* zstream = acquireInflateStream();
+    zstream->next_in = (Bytef*) const_cast<void*>(zipdata);
+    zstream->avail_in = zipsize;
+    zstream->next_out = (Bytef*) data;
+    zstream->avail_out = unzipsize;
+    int zresult = inflate(zstream, Z_FINISH);
+    int total = (int)zstream->total_out;
+    releaseInflateStream(zstream);
+    return (zresult == Z_STREAM_END || zresult == Z_OK) && total == unzipsize;
+}
+
+
+int deflateBlock(std::vector<char>& zipdata, const void* data, int size, bool compress)
+{
+#ifdef PTEX_USE_LIBDEFLATE
+    if (currentBackend == zb_libdeflate && size > 0) {
+        Pool<Compressor>& pool = compressors[compress];
+        Compressor* c = pool.acquire();
+        if (!c->compressor) c->compressor = libdeflate_alloc_compressor(compress ? 6 : 0);
+        size_t zipsize = 0;
+        if (c->compressor) {
+            zipdata.resize(libdeflate_zlib_compress_bound(c->compressor, size_t(size)));
+            zipsize = libdeflate_zlib_compress(c->compressor, data, size_t(size),
+                                               &zipdata[0], zipdata.size());
+        }
+        pool.release(c);
+        return zipsize ? int(zipsize) : -1;
+    }
+#endif
+    (void)zipdata; (void)data; (void)size; (void)compress;
+    return -1;
+}
+
+
+// LZ4 block format (as in lz4_Block_format.md; read and written by all lz4
+// 1.x releases): a sequence of (literals, match) pairs, each starting
+// with a token holding the literal length (high nibble) and match length
+// minus 4 (low nibble); a nibble of 15 is followed by extra length bytes.
+// The literals follow, then a 2-byte little-endian match offset.  The last
+// sequence has only literals.  The compressor below is a greedy single-probe
+// hash matcher (like LZ4's fast mode) which favors speed over ratio.
+namespace {
+    const int Lz4MinMatch = 4;
+    const int Lz4LastLiterals = 5;    // last bytes are always literals
+    const int Lz4MatchLimit = 12;     // last match must start this far from the end
+    const int Lz4MaxOffset = 65535;
+    const int Lz4HashLog = 12;
+
+    inline uint32_t read32(const uint8_t* p)
+    {
+        uint32_t val; memcpy(&val, p, sizeof(val)); return val;
+    }
+
+    inline uint32_t lz4Hash(uint32_t val)
+    {
+        return (val * 2654435761U) >> (32 - Lz4HashLog);
+    }
+
+    inline uint8_t* writeLength(uint8_t* op, int len)
+    {
+        // extra length bytes for a nibble of 15
+        for (len -= 15; len >= 255; len -= 255) *op++ = 255;
+        *op++ = uint8_t(len);
+        return op;
+    }
+
+    inline bool readLength(const uint8_t*& ip, const uint8_t* iend, int& len, ptrdiff_t limit)
+    {
+        // stop as soon as the length can't fit in the output so that a
+        // corrupt run of 255 bytes can't overflow len
+        uint8_t b;
+        do {
+            if (ip >= iend) return false;
+            b = *ip++;
+            len += b;
+            if (len > limit) return false;
+        } while (b == 255);
+        return true;
+    }
+
+    uint8_t* writeSequence(uint8_t* op, const uint8_t* literals, int nliterals,
+                           int offset, int matchlen)
+    {
+        uint8_t* token = op++;
+        int ml = matchlen - Lz4MinMatch;
+        *token = uint8_t((PtexUtils::min(nliterals, 15) << 4) | (offset ? PtexUtils::min(ml, 15) : 0));
+        if (nliterals >= 15) op = writeLength(op, nliterals);
+        memcpy(op, literals, nliterals);
+        op += nliterals;
+        if (offset) {
+            *op++ = uint8_t(offset);
+            *op++ = uint8_t(offset >> 8);
+            if (ml >= 15) op = writeLength(op, ml);
+        }
+        return op;
+    }
+}
+
+
+int compressLz4(std::vector<char>& zipdata, const void* dataArg, int size)
+{
+    // worst case is all literals
+    zipdata.resize(1 + size + size / 255 + 16);
+    uint8_t* op = (uint8_t*) &zipdata[0];
+    *op++ = Lz4BlockMarker;
+
+    const uint8_t* src = (const uint8_t*) dataArg;
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* iend = src + size;
+    if (size > Lz4MatchLimit) {
+        const uint8_t* mflimit = iend - Lz4MatchLimit;
+        const uint8_t* matchlimit = iend - Lz4LastLiterals;
+        int table[1 << Lz4HashLog];
+        memset(table, 0, sizeof(table));
+        while (ip < mflimit) {
+            uint32_t val = read32(ip);
+            uint32_t h = lz4Hash(val);
+            const uint8_t* ref = src + table[h];
+            table[h] = int(ip - src);
+            if (ref >= ip || ip - ref > Lz4MaxOffset || read32(ref) != val) {
+                ip++;
+                continue;
+            }
+            // extend match backward over pending literals, then forward
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) { ip--; ref--; }
+            const uint8_t* mp = ip + Lz4MinMatch;
+            const uint8_t* rp = ref + Lz4MinMatch;
+            while (mp < matchlimit && *mp == *rp) { mp++; rp++; }
+            op = writeSequence(op, anchor, int(ip - anchor), int(ip - ref), int(mp - ip));
+            ip = anchor = mp;
+        }
+    }
+    op = writeSequence(op, anchor, int(iend - anchor), 0, 0);
+    return int(op - (uint8_t*) &zipdata[0]);
+}
+
+
+bool decompressLz4(void* dataArg, int size, const void* zipdata, int zipsize)
+{
+    if (!isLz4Block(zipdata, zipsize) || size < 0) return false;
+    const uint8_t* ip = (const uint8_t*) zipdata + 1;
+    const uint8_t* iend = (const uint8_t*) zipdata + zipsize;
+    uint8_t* dst = (uint8_t*) dataArg;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + size;
+    while (ip < iend) {
+        int token = *ip++;
+
+        // copy literals
+        int nliterals = token >> 4;
+        if (nliterals == 15 && !readLength(ip, iend, nliterals, oend - op)) return false;
+        if (nliterals < 0 || nliterals > iend - ip || nliterals > oend - op) return false;
+        memcpy(op, ip, nliterals);
+        ip += nliterals;
+        op += nliterals;
+        if (ip == iend) break; // last sequence
+
+        // copy match (which may overlap the output)
+        if (iend - ip < 2) return false;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dst) return false;
+        int matchlen = token & 15;
+        if (matchlen == 15 && !readLength(ip, iend, matchlen, oend - op)) return false;
+        matchlen += Lz4MinMatch;
+        if (matchlen < 0 || matchlen > oend - op) return false;
+        const uint8_t* ref = op - offset;
+        if (offset >= matchlen) memcpy(op, ref, matchlen);
+        else for (int i = 0; i < matchlen; i++) op[i] = ref[i];
+        op += matchlen;
+    }
+    return op == oend;
+}
+
+
+bool streaming()
+{
+    return currentBackend == zb_zlibStream;
+}
+
+
+z_stream* acquireInflateStream()
+{
+    return inflateStreams.acquire();
+}
+
+
+void releaseInflateStream(z_stream* zstream)
+{
+    inflateReset(zstream);
+    inflateStreams.release(zstream);
+}
+
+}
+
+PTEX_NAMESPACE_END
@@ -0,0 +1,94 @@
+#ifndef PtexCodec_h
+#define PtexCodec_h
+
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+/**
+  @file PtexCodec.h
+  @brief Zip block compression backends shared by the reader and writer.
+*/
+
+#include <vector>
+#include <zlib.h>
+#include "Ptexture.h"
+
+PTEX_NAMESPACE_BEGIN
+
+namespace PtexCodec {
+
+/** Inflate a whole zip block held in memory using the current backend
+    (or decompress it if it is an LZ4 block).  Returns false if the block
+    is corrupt or doesn't inflate to exactly unzipsize bytes. */
+bool inflateBlock(void* data, int unzipsize, const void* zipdata, int zipsize);
+
+/** Deflate a whole block in memory into zipdata if the current backend
+    supports it.  Returns the compressed size, or -1 if the caller should
+    compress with a zlib stream instead. */
+int deflateBlock(std::vector<char>& zipdata, const void* data, int size, bool compress);
+
+/** First byte of an LZ4 face data block.  Never the first byte of a zlib
+    block (the low nibble of a zlib header is always 8) so both kinds of
+    blocks can be mixed in a file. */
+const uint8_t Lz4BlockMarker = 0x04;
+
+/** True if the block (given at least its first byte) is an LZ4 block. */
+inline bool isLz4Block(const void* zipdata, int zipsize)
+{
+    return zipsize > 0 && *(const uint8_t*)zipdata == Lz4BlockMarker;
+}
+
+/** Compress a block in LZ4 block format (preceded by Lz4BlockMarker) into
+    zipdata.  Returns the compressed size. */
+int compressLz4(std::vector<char>& zipdata, const void* data, int size);
+
+/** Decompress an LZ4 block (including the marker).  Returns false if the
+    block is corrupt or doesn't decompress to exactly size bytes. */
+bool decompressLz4(void* data, int size, const void* zipdata, int zipsize);
+
+/** True if blocks that aren't already in memory should be inflated in
+    BlockSize chunks (rather than read and inflated as a whole). */
+bool streaming();
+
+/** Get a reset inflate stream from a pool shared by all readers. */
+z_stream* acquireInflateStream();
+
+/** Return an inflate stream to the pool. */
+void releaseInflateStream(z_stream* zstream);
+
+}
+
+PTEX_NAMESPACE_END
+
+#endif
@@ -0,0 +1,254 @@
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#include "PtexPlatform.h"
+#include <algorithm>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef PTEX_PLATFORM_WINDOWS
+#include <dirent.h>
+#include <unistd.h>
+#endif
+#include "PtexDiskCache.h"
+
+PTEX_NAMESPACE_BEGIN
+
+namespace {
+    const uint32_t Magic = 0x64747870; // "pxtd"
+    const uint32_t Version = 2;
+    const char* const Suffix = ".ptxd";
+    const size_t DiskBlockSize = 4096; // space used by a file is rounded up to this
+    volatile uint32_t tmpFileCount = 0;
+
+    size_t diskSize(size_t size) { return (size + DiskBlockSize - 1) & ~(DiskBlockSize - 1); }
+
+    struct FoundFile {
+        int64_t mtime;
+        std::string name;
+        size_t size;
+        bool operator<(const FoundFile& f) const { return mtime > f.mtime; } // newest first
+    };
+
+    void findFiles(const std::string& path, std::vector<FoundFile>& files)
+    {
+        // list the cache files in the directory
+#ifdef PTEX_PLATFORM_WINDOWS
+        struct __finddata64_t fd;
+        std::string pattern = path + "/*" + Suffix;
+        intptr_t handle = _findfirst64(pattern.c_str(), &fd);
+        if (handle == -1) return;
+        do {
+            FoundFile f;
+            f.mtime = int64_t(fd.time_write);
+            f.name = fd.name;
+            f.size = size_t(fd.size);
+            files.push_back(f);
+        } while (_findnext64(handle, &fd) == 0);
+        _findclose(handle);
+#else
+        DIR* dir = opendir(path.c_str());
+        if (!dir) return;
+        size_t suffixlen = strlen(Suffix);
+        while (struct dirent* entry = readdir(dir)) {
+            size_t len = strlen(entry->d_name);
+            if (len <= suffixlen || strcmp(entry->d_name + len - suffixlen, Suffix) != 0) continue;
+            struct stat st;
+            std::string filepath = path + "/" + entry->d_name;
+            if (stat(filepath.c_str(), &st) != 0) continue;
+            FoundFile f;
+            f.mtime = int64_t(st.st_mtime);
+            f.name = entry->d_name;
+            f.size = size_t(st.st_size);
+            files.push_back(f);
+        }
+        closedir(dir);
+#endif
+    }
+}
+
+struct PtexDiskCache::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t fileKey;               // texture file the data is from
+    int64_t fileSize;               // size of the texture file
+    int64_t fileTime;               // modification time of the texture file (in nanoseconds)
+    uint64_t pos;                   // file position of block
+    uint64_t size;                  // size of data (following the header)
+};
+
+
+void PtexDiskCache::setPath(const char* path, size_t maxSize)
+{
+    AutoMutex locker(_lock);
+    _path = path ? path : "";
+    _maxSize = maxSize;
+    _entries.clear();
+    _lru.clear();
+    _size = 0;
+
+    // count the files already there, most recently written first
+    std::vector<FoundFile> files;
+    if (!_path.empty()) findFiles(_path, files);
+    std::sort(files.begin(), files.end());
+    for (size_t i = 0; i < files.size(); i++) {
+        Entry& e = _entries[files[i].name];
+        e.size = diskSize(files[i].size);
+        e.lruItem = _lru.insert(_lru.end(), files[i].name);
+        _size += e.size;
+    }
+    trim();
+    AtomicStore(&_enabled, !_path.empty() && _maxSize > 0);
+}
+
+
+std::string PtexDiskCache::fileName(uint64_t fileKey, FilePos pos)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "%08x%08x-%08x%08x%s", uint32_t(fileKey >> 32), uint32_t(fileKey),
+             uint32_t(uint64_t(pos) >> 32), uint32_t(pos), Suffix);
+    return name;
+}
+
+
+bool PtexDiskCache::get(uint64_t fileKey, int64_t fileSize, int64_t fileTime,
+                        FilePos pos, void* data, int size)
+{
+    std::string name = fileName(fileKey, pos), dir;
+    {
+        AutoMutex locker(_lock);
+        dir = _path;
+    }
+    FILE* fp = fopen((dir + "/" + name).c_str(), "rb");
+    if (!fp) return false;
+    Header h;
+    bool ok = fread(&h, sizeof(h), 1, fp) == 1 && h.magic == Magic && h.version == Version &&
+        h.fileKey == fileKey && h.fileSize == fileSize && h.fileTime == fileTime &&
+        h.pos == uint64_t(pos) && h.size == uint64_t(size) &&
+        fread(data, size, 1, fp) == 1;
+    fclose(fp);
+    if (!ok) return false;
+
+    AutoMutex locker(_lock);
+    if (_path != dir) return true;
+    EntryMap::iterator i = _entries.find(name);
+    if (i != _entries.end()) _lru.splice(_lru.begin(), _lru, i->second.lruItem);
+    else insert(name, sizeof(h) + size); // written by another process
+    _hits++;
+    return true;
+}
+
+
+bool PtexDiskCache::contains(uint64_t fileKey, FilePos pos)
+{
+    std::string name = fileName(fileKey, pos);
+    AutoMutex locker(_lock);
+    return _entries.find(name) != _entries.end();
+}
+
+
+void PtexDiskCache::add(uint64_t fileKey, int64_t fileSize, int64_t fileTime,
+                        FilePos pos, const void* data, int size)
+{
+    Header h;
+    h.magic = Magic;
+    h.version = Version;
+    h.fileKey = fileKey;
+    h.fileSize = fileSize;
+    h.fileTime = fileTime;
+    h.pos = uint64_t(pos);
+    h.size = uint64_t(size);
+    std::string dir;
+    {
+        AutoMutex locker(_lock);
+        if (size <= 0 || diskSize(sizeof(h) + size) > _maxSize) return;
+        dir = _path;
+    }
+
+    // write to a temp file and rename so that other readers never see a
+    // partial file; the temp name is unique to the process and the write
+    std::string name = fileName(fileKey, pos);
+    std::string path = dir + "/" + name;
+    char suffix[32];
+    uint32_t count = AtomicIncrement(&tmpFileCount);
+#ifdef PTEX_PLATFORM_WINDOWS
+    snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", int(_getpid()), count);
+#else
+    snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", int(getpid()), count);
+#endif
+    std::string tmppath = path + suffix;
+    FILE* fp = fopen(tmppath.c_str(), "wb");
+    if (!fp) return;
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 && fwrite(data, size, 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+#ifdef PTEX_PLATFORM_WINDOWS
+    // rename won't replace an existing file
+    if (ok) remove(path.c_str());
+#endif
+    if (!ok || rename(tmppath.c_str(), path.c_str()) != 0) {
+        remove(tmppath.c_str());
+        return;
+    }
+
+    AutoMutex locker(_lock);
+    if (_path != dir) return;
+    if (_entries.find(name) == _entries.end()) insert(name, sizeof(h) + size);
+    trim();
+}
+
+
+void PtexDiskCache::insert(const std::string& name, size_t size)
+{
+    // add as most recently used, counting the disk space used (lock must be held)
+    Entry& e = _entries[name];
+    e.size = diskSize(size);
+    e.lruItem = _lru.insert(_lru.begin(), name);
+    _size += e.size;
+}
+
+
+void PtexDiskCache::trim()
+{
+    // delete least recently used files until within the limit (lock must be held)
+    while (_size > _maxSize && !_lru.empty()) {
+        EntryMap::iterator i = _entries.find(_lru.back());
+        remove((_path + "/" + i->first).c_str());
+        _size -= i->second.size;
+        _entries.erase(i);
+        _lru.pop_back();
+    }
+}
+
+PTEX_NAMESPACE_END
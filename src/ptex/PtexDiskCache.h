@@ -0,0 +1,121 @@
+#ifndef PtexDiskCache_h
+#define PtexDiskCache_h
+
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+/**
+  @file PtexDiskCache.h
+  @brief Contains PtexDiskCache, a persistent cache of decoded face data on local disk.
+*/
+
+#include <list>
+#include <map>
+#include <string>
+#include "PtexPlatform.h"
+#include "PtexMutex.h"
+
+PTEX_NAMESPACE_BEGIN
+
+/** Size-limited cache of decoded face data in a local directory, for
+    textures on slow (e.g. network) storage.  Each block of face data is
+    kept in its own file, named after the block's file position and a
+    key identifying the texture file by path, size, and modification
+    time, so data of a changed file is never used.  The file's size and
+    modification time are also stored with the data and checked when it
+    is read, in case two versions of the file hash to the same key.  Files are written to
+    a temporary name and renamed into place, so the directory may be
+    shared by several processes.
+
+    Files are deleted in lru order (by last use in this process, and by
+    modification time for files found when the cache is set up) to stay
+    within the size limit.  Each file is counted as using a whole number
+    of 4KB disk blocks, since faces are often much smaller than that.
+    Files written by other processes after setup aren't counted, so the
+    limit is per process.
+ */
+class PtexDiskCache
+{
+public:
+    PtexDiskCache() : _enabled(false), _maxSize(0), _size(0), _hits(0) {}
+
+    /** Set the cache directory (which must exist) and size limit,
+        counting the files already there.  An empty path disables the cache. */
+    void setPath(const char* path, size_t maxSize);
+    bool enabled() const { return _enabled; }
+
+    /** Read the data of the block at pos of the given file (with the given
+        size and modification time) into data.  Returns false if not cached. */
+    bool get(uint64_t fileKey, int64_t fileSize, int64_t fileTime, FilePos pos, void* data, int size);
+
+    /** True if the data of the block at pos of the given file is known to be cached. */
+    bool contains(uint64_t fileKey, FilePos pos);
+
+    /** Write the data of the block at pos of the given file, deleting
+        the least recently used files as needed to stay within the limit. */
+    void add(uint64_t fileKey, int64_t fileSize, int64_t fileTime, FilePos pos,
+             const void* data, int size);
+
+    size_t size() const { return _size; }
+    uint64_t hits() const { return _hits; }
+
+private:
+    PtexDiskCache(const PtexDiskCache&);
+    void operator=(const PtexDiskCache&);
+
+    struct Header;
+    typedef std::list<std::string> LruList;
+    struct Entry {
+        size_t size;
+        LruList::iterator lruItem;
+    };
+    typedef std::map<std::string, Entry> EntryMap;
+
+    std::string fileName(uint64_t fileKey, FilePos pos);
+    void insert(const std::string& name, size_t size);
+    void trim();
+
+    Mutex _lock;
+    std::string _path;
+    EntryMap _entries;
+    LruList _lru;                   // names of most recently used files at front
+    volatile bool _enabled;
+    size_t _maxSize;
+    volatile size_t _size;
+    volatile uint64_t _hits;
+};
+
+PTEX_NAMESPACE_END
+
+#endif
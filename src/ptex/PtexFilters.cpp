@@ -112,6 +112,12 @@ class PtexPointFilterTri : public PtexFilter
     extend significantly beyond both sides of the face), a special
     Hermite smoothstep is used to interpolate the two nearest 2 samples
     along the affected axis (or axes).
+
+    With the kerneltable option, the kernel is sampled into a table
+    when the filter is built and weights are linearly interpolated
+    from it.  The interpolation error is at most h^2/8 * max|k''| for
+    table spacing h, which for 1/256 texel and the gaussian (|k''| <= 4)
+    or bi-cubic (|k''| <= 5 for sharpness 0..1) kernel is below 1e-5.
 */
 class PtexWidth4Filter : public PtexSeparableFilter
 {
@@ -119,18 +125,45 @@ class PtexWidth4Filter : public PtexSeparableFilter
     typedef float KernelFn(float x, const float* c);
 
     PtexWidth4Filter(PtexTexture* tx, const PtexFilter::Options& opts, KernelFn k, const float* c = 0)
-        : PtexSeparableFilter(tx, opts), _k(k), _c(c) {}
+        : PtexSeparableFilter(tx, opts), _k(k), _c(c), _table(0) {}
+
+    virtual ~PtexWidth4Filter() { delete [] _table; }
 
     virtual void buildKernel(PtexSeparableKernel& k, float u, float v, float uw, float vw,
-                             Res faceRes)
+                             Res faceRes) const
     {
         buildKernelAxis(k.res.ulog2, k.u, k.uw, k.ku, u, uw, faceRes.ulog2);
         buildKernelAxis(k.res.vlog2, k.v, k.vw, k.kv, v, vw, faceRes.vlog2);
     }
 
+ protected:
+    // sample kernel into table if requested (call once kernel coefficients are set)
+    void buildTable()
+    {
+        if (!_options.kerneltable) return;
+        _table = new float[TableSize+1];
+        for (int i = 0; i <= TableSize; i++)
+            _table[i] = _k(float(i) * (1.0f/TableRes), _c);
+    }
+
  private:
+    enum { TableRes = 256,              // table samples per unit of x
+           TableSize = 4*TableRes };    // table covers abs(x) up to 4
+
+    float kernel(float x) const
+    {
+        if (_table) {
+            float t = PtexUtils::abs(x) * TableRes;
+            if (t < TableSize) {
+                int i = int(t);
+                float f = t - (float)i;
+                return _table[i] + f * (_table[i+1] - _table[i]);
+            }
+        }
+        return _k(x, _c);
+    }
 
-    float blur(float x)
+    float blur(float x) const
     {
         // 2-unit (x in -1..1) cubic hermite kernel
         // this produces a blur roughly 1.5 times that of the 4-unit b-spline kernel
@@ -139,7 +172,7 @@ class PtexWidth4Filter : public PtexSeparableFilter
     }
 
     void buildKernelAxis(int8_t& k_ureslog2, int& k_u, int& k_uw, float* ku,
-                         float u, float uw, int f_ureslog2)
+                         float u, float uw, int f_ureslog2) const
     {
         // build 1 axis (note: "u" labels may repesent either u or v axis)
 
@@ -171,7 +204,7 @@ class PtexWidth4Filter : public PtexSeparableFilter
                     // spread the filter gradually to approach the next-lower-res width
                     // at uw = .5, s = 1.0; at uw = 1, s = 0.8
                     float s = 1.0f/(uw + .75f);
-                    float ka = _k(xa, _c), kb = _k(xb, _c), kc = blur(xc*s);
+                    float ka = kernel(xa), kb = kernel(xb), kc = blur(xc*s);
                     ku[i] = ka * lerp1 + kc * lerp2;
                     ku[i+1] = kb * lerp1 + kc * lerp2;
                 }
@@ -229,7 +262,7 @@ class PtexWidth4Filter : public PtexSeparableFilter
             float step = 1.0f/uwpix, x1 = ((float)u1-upix)*(float)step;
             for (int i = 0; i < k_uw; i+=2) {
                 float xa = x1 + (float)i*step, xb = xa + step, xc = (xa+xb)*0.5f;
-                float ka = _k(xa, _c), kb = _k(xb, _c), kc = _k(xc, _c);
+                float ka = kernel(xa), kb = kernel(xb), kc = kernel(xc);
                 ku[i] = ka * lerp1 + kc * lerp2;
                 ku[i+1] = kb * lerp1 + kc * lerp2;
             }
@@ -239,12 +272,13 @@ class PtexWidth4Filter : public PtexSeparableFilter
             k_uw = u2-u1;
             // compute kernel weights
             float x1 = ((float)u1-upix)/uwpix, step = 1.0f/uwpix;
-            for (int i = 0; i < k_uw; i++) ku[i] = _k(x1 + (float)i*step, _c);
+            for (int i = 0; i < k_uw; i++) ku[i] = kernel(x1 + (float)i*step);
         }
     }
 
     KernelFn* _k;               // kernel function
     const float* _c;            // kernel coefficients (if any)
+    float* _table;              // sampled kernel (if kerneltable option is set)
 };
 
 
@@ -272,6 +306,7 @@ class PtexBicubicFilter : public PtexWidth4Filter
         _coeffs[4] = 2.5f - 1.5f * B;
         _coeffs[5] = 2.0f * B - 4.0f;
         _coeffs[6] = 2.0f - float(2.0/3.0) * B;
+        buildTable();
     }
 
  private:
@@ -293,7 +328,7 @@ class PtexGaussianFilter : public PtexWidth4Filter
 {
  public:
     PtexGaussianFilter(PtexTexture* tx, const PtexFilter::Options& opts)
-        : PtexWidth4Filter(tx, opts, kernelFn) {}
+        : PtexWidth4Filter(tx, opts, kernelFn) { buildTable(); }
 
  private:
     static float kernelFn(float x, const float*)
@@ -316,7 +351,7 @@ class PtexBoxFilter : public PtexSeparableFilter
 
  protected:
     virtual void buildKernel(PtexSeparableKernel& k, float u, float v, float uw, float vw,
-                             Res faceRes)
+                             Res faceRes) const
     {
         // clamp filter width to no larger than 1.0
         uw = PtexUtils::min(uw, 1.0f);
@@ -355,7 +390,7 @@ class PtexBoxFilter : public PtexSeparableFilter
     }
 
  private:
-    void computeWeights(float* kernel, int size, float f1, float f2)
+    void computeWeights(float* kernel, int size, float f1, float f2) const
     {
         assert(size >= 1 && size <= 3);
 
@@ -380,7 +415,7 @@ class PtexBilinearFilter : public PtexSeparableFilter
 
  protected:
     virtual void buildKernel(PtexSeparableKernel& k, float u, float v, float uw, float vw,
-                             Res faceRes)
+                             Res faceRes) const
     {
         // clamp filter width to no larger than 1.0
         uw = PtexUtils::min(uw, 1.0f);
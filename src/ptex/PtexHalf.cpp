@@ -35,6 +35,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 
 #include <cmath>
 #include "PtexHalf.h"
+#include "PtexSIMD.h"
 
 PTEX_NAMESPACE_BEGIN
 
@@ -61,4 +62,28 @@ uint16_t PtexHalf::fromFloat_except(uint32_t i)
         return (uint16_t)(s|0x7c00);
 }
 
+
+/** Bulk conversions, same results as the scalar conversions (short
+    arrays aren't worth a vector kernel) */
+void PtexHalf::toFloat(float* dst, const PtexHalf* src, int n)
+{
+    PtexSIMD::HalfToFloatFn* fn = n >= 8 ? PtexSIMD::halfToFloatFn() : 0;
+    if (fn) {
+        fn(dst, &src->bits, n);
+        return;
+    }
+    for (int i = 0; i < n; i++) dst[i] = toFloat(src[i].bits);
+}
+
+
+void PtexHalf::fromFloat(PtexHalf* dst, const float* src, int n)
+{
+    PtexSIMD::FloatToHalfFn* fn = n >= 8 ? PtexSIMD::floatToHalfFn() : 0;
+    if (fn) {
+        fn(&dst->bits, src, n);
+        return;
+    }
+    for (int i = 0; i < n; i++) dst[i].bits = fromFloat(src[i]);
+}
+
 PTEX_NAMESPACE_END
@@ -96,6 +96,12 @@ struct PtexHalf {
         return fromFloat_except(u.i);
     }
 
+    /// Convert n halves to floats, using F16C instructions when available
+    PTEXAPI static void toFloat(float* dst, const PtexHalf* src, int n);
+
+    /// Convert n floats to halves, vectorized when available
+    PTEXAPI static void fromFloat(PtexHalf* dst, const float* src, int n);
+
  private:
     PTEXAPI static uint16_t fromFloat_except(uint32_t val);
 #ifndef DOXYGEN
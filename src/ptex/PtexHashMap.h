@@ -166,6 +166,7 @@ class PtexHashMap
     {
         _numEntries = 16;
         _size = 0;
+        _grownMemUsed = 0;
         _entries = new Entry[_numEntries];
     }
 
@@ -200,6 +201,9 @@ public:
 
     uint32_t size() const { return _size; }
 
+    /// Memory allocated by growing the table (the sum of newMemUsed reported by tryInsert).
+    size_t grownMemUsed() const { return _grownMemUsed; }
+
     Value get(Key& key)
     {
         uint32_t mask = _numEntries-1;
@@ -297,6 +301,7 @@ private:
         uint32_t numNewEntries = _numEntries*2;
         Entry* entries = new Entry[numNewEntries];
         newMemUsed = numNewEntries * sizeof(Entry);
+        _grownMemUsed += newMemUsed;
         uint32_t mask = numNewEntries-1;
         for (uint32_t oldIndex = 0; oldIndex < _numEntries; ++oldIndex) {
             Entry& oldEntry = oldEntries[oldIndex];
@@ -319,6 +324,7 @@ private:
     uint32_t volatile _numEntries;
     uint32_t volatile _size;
     std::vector<Entry*> _oldEntries;
+    size_t _grownMemUsed;
 };
 
 PTEX_NAMESPACE_END
@@ -71,6 +71,7 @@ struct ExtHeader {
     uint64_t lmddatasize;
     uint64_t editdatasize;
     uint64_t editdatapos;
+    uint32_t facecodec;     // codec of face data (minor version 5 and later)
 };
 struct LevelInfo {
     uint64_t leveldatasize;
@@ -99,6 +100,15 @@ struct EditMetaDataHeader {
     uint32_t metadatazipsize;
     uint32_t metadatamemsize;
 };
+struct IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t filesize;
+    int64_t  filetime; // in nanoseconds
+    Header   header;
+    ExtHeader extheader;
+    uint32_t pathlen;
+};
 #pragma pack(pop)
 
 const uint32_t Magic = 'P' | ('t'<<8) | ('e'<<16) | ('x'<<24);
@@ -108,6 +118,10 @@ const int LevelInfoSize = sizeof(LevelInfo);
 const int FaceDataHeaderSize = sizeof(FaceDataHeader);
 const int EditFaceDataHeaderSize = sizeof(EditFaceDataHeader);
 const int EditMetaDataHeaderSize = sizeof(EditMetaDataHeader);
+const uint32_t IndexMagic = 'P' | ('t'<<8) | ('x'<<16) | ('i'<<24);
+const uint32_t IndexVersion = 2; // 2: file time in nanoseconds
+const int IndexHeaderSize = sizeof(IndexHeader);
+const uint32_t Lz4MinorVersion = 5; // file minor version needed to read lz4 face data
 
 // these constants can be tuned for performance
 const int IBuffSize = 8192;         // default input buffer size
@@ -115,6 +129,10 @@ const int BlockSize = 16384;        // target block size for file I/O
 const int TileSize  = 65536;        // target tile size (uncompressed)
 const int AllocaMax = 16384;        // max size for using alloca
 const int MetaDataThreshold = 1024; // cutoff for large meta data
+const int CoalesceSize = 1048576;   // max size of a coalesced read of adjacent face blocks
+const int OpenReadSize = 65536;     // default size of speculative read of file info at open
+const int MaxPrefixSize = 16777216; // max size of file info read in one piece at open
+const int IndexMinFaces = 256;      // min faces for file info to be kept in the index cache
 
 inline bool LittleEndian() {
     short word = 0x0201;
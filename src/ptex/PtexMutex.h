@@ -50,6 +50,7 @@ private:
 
 typedef AutoLock<Mutex> AutoMutex;
 typedef AutoLock<SpinLock> AutoSpin;
+typedef AutoLock<Monitor> AutoMonitor;
 
 PTEX_NAMESPACE_END
 
@@ -75,6 +75,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #endif
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
 
 #ifdef __APPLE__
 #include <os/lock.h>
@@ -172,6 +173,44 @@ private:
 #endif // __APPLE__
 #endif
 
+/*
+ * Monitor (mutex with condition variable)
+ */
+
+#ifdef PTEX_PLATFORM_WINDOWS
+
+class Monitor {
+public:
+    Monitor()      { InitializeCriticalSection(&_lock); InitializeConditionVariable(&_cond); }
+    ~Monitor()     { DeleteCriticalSection(&_lock); }
+    void lock()    { EnterCriticalSection(&_lock); }
+    void unlock()  { LeaveCriticalSection(&_lock); }
+    void wait()    { SleepConditionVariableCS(&_cond, &_lock, INFINITE); }
+    void notify()  { WakeConditionVariable(&_cond); }
+    void notifyAll() { WakeAllConditionVariable(&_cond); }
+private:
+    CRITICAL_SECTION _lock;
+    CONDITION_VARIABLE _cond;
+};
+
+#else
+
+class Monitor {
+public:
+    Monitor()      { pthread_mutex_init(&_mutex, 0); pthread_cond_init(&_cond, 0); }
+    ~Monitor()     { pthread_cond_destroy(&_cond); pthread_mutex_destroy(&_mutex); }
+    void lock()    { pthread_mutex_lock(&_mutex); }
+    void unlock()  { pthread_mutex_unlock(&_mutex); }
+    void wait()    { pthread_cond_wait(&_cond, &_mutex); }
+    void notify()  { pthread_cond_signal(&_cond); }
+    void notifyAll() { pthread_cond_broadcast(&_cond); }
+private:
+    pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+};
+
+#endif
+
 /*
  * Atomics
  */
@@ -294,6 +333,37 @@ PTEX_INLINE void PtexMemoryFence()
     MEM_FENCE();
 }
 
+template <typename T>
+PTEX_INLINE T AtomicLoad(T volatile* target)
+{
+    T value = *target;
+    MEM_FENCE();
+    return value;
+}
+
+// back off while spinning on an atomic: pause the cpu for the first few
+// tries, then give up the cpu to other threads
+PTEX_INLINE void PtexSpinWait(int& spins)
+{
+    if (spins < 16) {
+        spins++;
+#if defined(PTEX_PLATFORM_WINDOWS)
+        YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+    else {
+#ifdef PTEX_PLATFORM_WINDOWS
+        SwitchToThread();
+#else
+        sched_yield();
+#endif
+    }
+}
+
 
 #ifndef CACHE_LINE_SIZE
 #define CACHE_LINE_SIZE 64
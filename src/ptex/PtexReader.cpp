@@ -37,10 +37,32 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <iostream>
 #include <sstream>
 #include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(PTEX_PLATFORM_WINDOWS)
+#include <process.h>
+#else
+#include <unistd.h>
+#if !defined(PTEX_NO_MMAP)
+#include <sys/mman.h>
+#if defined(__APPLE__)
+#include <sys/mount.h>
+#elif defined(__linux__)
+#include <sys/vfs.h>
+#endif
+#endif
+#endif
 
 #include "Ptexture.h"
 #include "PtexUtils.h"
+#include "PtexCodec.h"
 #include "PtexReader.h"
+#include "PtexBlockCache.h"
+#include "PtexSharedCache.h"
+#include "PtexDiskCache.h"
+#include "PtexSeparableFilter.h"
 
 namespace {
     class TempErrorHandler : public PtexErrorHandler
@@ -56,6 +78,8 @@ namespace {
 
 PTEX_NAMESPACE_BEGIN
 
+
+
 PtexTexture* PtexTexture::open(const char* path, Ptex::String& error, bool premultiply)
 {
     PtexReader* reader = new PtexReader(premultiply, (PtexInputHandler*) 0, (PtexErrorHandler*) 0);
@@ -75,18 +99,30 @@ PtexReader::PtexReader(bool premultiply, PtexInputHandler* io, PtexErrorHandler*
       _ok(true),
       _needToOpen(true),
       _pendingPurge(false),
+      _positional(_io->supportsReadAt()),
+      _ioRefs(0),
       _fp(0),
       _pos(0),
+      _mapdata(0),
+      _mapsize(0),
+      _openReadSize(OpenReadSize),
+      _indexFp(0),
+      _fileKey(0),
+      _fileSize(0),
+      _fileTime(0),
       _pixelsize(0),
       _constdata(0),
       _metadata(0),
+      _numFilters(0),
       _hasEdits(false),
+      _reductionUses(0),
+      _evictLevel(0),
+      _evictFace(0),
       _baseMemUsed(sizeof(*this)),
       _memUsed(_baseMemUsed),
       _opens(0),
       _blockReads(0)
 {
-    memset(&_zstream, 0, sizeof(_zstream));
 }
 
 
@@ -95,6 +131,8 @@ PtexReader::~PtexReader()
     closeFP();
     if (_constdata) delete [] _constdata;
     if (_metadata) delete _metadata;
+    for (int i = 0; i < _numFilters; i++) delete _filters[i].filter;
+    for (size_t i = 0; i < _retiredFilters.size(); i++) delete _retiredFilters[i];
 
     for (std::vector<Level*>::iterator i = _levels.begin(); i != _levels.end(); ++i) {
         if (*i) delete *i;
@@ -108,10 +146,92 @@ void PtexReader::prune()
         if (*i) { delete *i; *i = 0; }
     }
     _reductions.clear();
+    _reductionUses = 0;
+    _evictLevel = _evictFace = 0;
     _memUsed = _baseMemUsed;
 }
 
 
+namespace {
+    struct ReductionEvictor {
+        size_t memFreed;
+        ReductionEvictor() : memFreed(0) {}
+        void operator() (PtexReader::FaceData* face) {
+            if (face->isTiled()) memFreed += static_cast<PtexReader::TiledFaceBase*>(face)->evictTiles(cp_recency, true);
+            memFreed += face->memUsed();
+        }
+    };
+}
+
+
+size_t PtexReader::evictUnused(size_t target, CachePolicy policy)
+{
+    // Free face data (faces, tiles, and dynamic reductions) not kept by
+    // the policy, until at least target bytes have been freed.  This is
+    // a clock replacement: the hand advances over the faces of each level
+    // in turn, counting down the uses of faces that are kept (see age)
+    // and freeing the others.  Face data isn't ref counted, so this must
+    // only be called while the reader isn't in use.
+    //
+    // Tiled faces are kept (reductions may refer to them) but their tiles
+    // are freed.  Dynamic reductions can only be freed all together, and
+    // are visited as a unit once per turn of the hand.
+    size_t memFreed = 0;
+    int nlevels = int(_levels.size());
+    for (int visited = 0, total = nlevels + 1; visited <= total && memFreed < target; ) {
+        if (_evictLevel >= nlevels) {
+            // end of turn, visit reductions
+            if (_reductions.size() && !age(_reductionUses, policy)) {
+                ReductionEvictor evictor;
+                _reductions.foreach(evictor);
+                memFreed += evictor.memFreed + _reductions.grownMemUsed();
+                _reductions.clear();
+                _reductionUses = 0;
+            }
+            _evictLevel = _evictFace = 0;
+            visited++;
+            continue;
+        }
+        Level* level = _levels[_evictLevel];
+        int nfaces = level ? int(level->faces.size()) : 0;
+        while (_evictFace < nfaces && memFreed < target) {
+            FaceData*& face = level->faces[_evictFace++];
+            if (!face) continue;
+            if (face->isTiled()) {
+                memFreed += static_cast<TiledFaceBase*>(face)->evictTiles(policy);
+            }
+            else if (!face->age(policy) && face->memUsed()) {
+                memFreed += face->memUsed();
+                delete face;
+                face = 0;
+            }
+        }
+        if (_evictFace >= nfaces) {
+            _evictLevel++;
+            _evictFace = 0;
+            visited++;
+        }
+    }
+    AtomicAdd(&_memUsed, -memFreed);
+    return memFreed;
+}
+
+
+size_t PtexReader::TiledFaceBase::evictTiles(CachePolicy policy, bool all)
+{
+    size_t memFreed = 0;
+    for (std::vector<FaceData*>::iterator i = _tiles.begin(); i != _tiles.end(); ++i) {
+        FaceData* tile = *i;
+        if (tile && (all || !tile->age(policy)) && tile->memUsed()) {
+            memFreed += tile->memUsed();
+            delete tile;
+            *i = 0;
+        }
+    }
+    return memFreed;
+}
+
+
 void PtexReader::purge()
 {
     // free all dynamic data
@@ -124,13 +244,25 @@ void PtexReader::purge()
     std::vector<Level*>().swap(_levels);
     std::vector<MetaEdit>().swap(_metaedits);
     std::vector<FaceEdit>().swap(_faceedits);
+    std::vector<FilePos>().swap(_indexLevelPos);
+    if (PtexBlockCache* cache = blockCache()) cache->remove(this);
     closeFP();
 
+    // cached filters were made for the old file (its data type, channels and
+    // border modes); don't hand them out again but keep them until the next
+    // purge in case a caller still has one.  Those retired by the previous
+    // purge can't still be held (the reader has had no users since then and
+    // callers must get the filter again after a purge), so free them now.
+    for (size_t i = 0; i < _retiredFilters.size(); i++) delete _retiredFilters[i];
+    _retiredFilters.clear();
+    for (int i = 0; i < _numFilters; i++) _retiredFilters.push_back(_filters[i].filter);
+    _numFilters = 0;
+
     // reset initial state
     _ok = true;
     _needToOpen = true;
     _pendingPurge = false;
-    _memUsed = _baseMemUsed = sizeof(*this);
+    _memUsed = _baseMemUsed = sizeof(*this) + _retiredFilters.size() * cachedFilterMemUsed();
 }
 
 
@@ -152,6 +284,13 @@ bool PtexReader::open(const char* pathArg, Ptex::String& error)
         _ok = 0;
         return 0;
     }
+    updateMapping();
+    _pos = 0;
+
+    // speculatively read the start of the file which normally holds all of
+    // the file info needed below so that opening takes a single read
+    if (!_mapdata) readPrefix(PtexUtils::max(_openReadSize, FilePos(HeaderSize)), true);
+
     memset(&_header, 0, sizeof(_header));
     readBlock(&_header, HeaderSize);
     if (_header.magic != Magic) {
@@ -201,14 +340,28 @@ bool PtexReader::open(const char* pathArg, Ptex::String& error)
     _lmddatapos = pos;    pos += _extheader.lmddatasize;
 
     // edit data may not start immediately if additional sections have been added
-    // use value from extheader if present (and > pos)
-    _editdatapos = PtexUtils::max(FilePos(_extheader.editdatapos), pos);
+    // use value from extheader if present (the compatibility barrier above is
+    // only written along with meta data so the computed pos may be past it)
+    _editdatapos = _extheader.editdatapos ? FilePos(_extheader.editdatapos) : pos;
+
+    // use cached file info from a previous open if present
+    bool indexed = false;
+    if (!_indexCachePath.empty()) {
+        readLevelInfo();
+        indexed = readIndex();
+    }
+
+    // if the file info didn't fit in the speculative read, get the rest in one more read
+    if (!indexed && FilePos(_prefix.size()) < _levelinfopos + _header.levelinfosize)
+        readPrefix(_levelinfopos + _header.levelinfosize, false);
 
     // read basic file info
     readFaceInfo();
     readConstData();
     readLevelInfo();
+    if (!indexed) writeIndex();
     readEditData();
+    _fileKey = sharedCache() || diskCache() ? fileKey() : 0;
     _baseMemUsed = _memUsed;
 
     // restore error handler
@@ -220,6 +373,10 @@ bool PtexReader::open(const char* pathArg, Ptex::String& error)
         closeFP();
         return 0;
     }
+
+    // done with the file prefix, resync stream with current position
+    std::vector<char>().swap(_prefix);
+    if (!_positional) _io->seek(_fp, _pos);
     AtomicStore(&_needToOpen, false);
     return true;
 }
@@ -228,7 +385,13 @@ bool PtexReader::tryClose()
 {
     if (_fp) {
         if (!readlock.trylock()) return false;
+        // can't close while positional reads are in flight
+        if (!AtomicCompareAndSwap(&_ioRefs, 0, -1)) {
+            readlock.unlock();
+            return false;
+        }
         closeFP();
+        AtomicStore(&_ioRefs, 0);
         readlock.unlock();
     }
     return true;
@@ -241,7 +404,54 @@ void PtexReader::closeFP()
         _io->close(_fp);
         _fp = 0;
     }
-    inflateEnd(&_zstream);
+    if (_indexFp) {
+        _indexIo.close(_indexFp);
+        _indexFp = 0;
+    }
+    _mapdata = 0;
+    _mapsize = 0;
+    std::vector<char>().swap(_prefix);
+}
+
+
+void PtexReader::readPrefix(FilePos end, bool speculative)
+{
+    // extend the in-memory copy of the start of the file up to end; end comes
+    // from the header which may be corrupt, so beyond the end of the file or
+    // the size limit the rest of the file info is left to the normal reads.
+    // Handlers may fail a read that runs past the end of the file, so unless
+    // the file size is known a speculative read only gets the header and the
+    // rest is sized from it.
+    int64_t fileSize, mtime;
+    if (_io == &_defaultIo && DefaultInputHandler::fileInfo(_fp, fileSize, mtime))
+        end = PtexUtils::min(end, FilePos(fileSize));
+    else if (speculative)
+        end = PtexUtils::min(end, FilePos(HeaderSize));
+    FilePos start = FilePos(_prefix.size());
+    if (end <= start || end > MaxPrefixSize) return;
+    int size = int(end - start);
+    _prefix.resize(size_t(end));
+    size_t result;
+    if (_positional) {
+        // a short read is fine, the file may be smaller than requested
+        result = _io->readAt(&_prefix[start], size, start, _fp);
+    }
+    else {
+        _io->seek(_fp, start);
+        result = _io->read(&_prefix[start], size, _fp);
+        if (result != size_t(size)) _io->seek(_fp, start);
+    }
+    logBlockRead();
+    _prefix.resize(size_t(start + result));
+}
+
+
+void PtexReader::updateMapping()
+{
+    // only the built-in handler provides direct access to the file data
+    int64_t size = 0;
+    _mapdata = (_io == &_defaultIo) ? _defaultIo.mapping(size) : 0;
+    _mapsize = _mapdata ? FilePos(size) : 0;
 }
 
 
@@ -255,6 +465,7 @@ bool PtexReader::reopenFP()
         setError("Can't reopen");
         return false;
     }
+    updateMapping();
     _pos = 0;
     Header headerval;
     ExtHeader extheaderval;
@@ -272,6 +483,26 @@ bool PtexReader::reopenFP()
 }
 
 
+bool PtexReader::acquireFP()
+{
+    // register read (wait if file is currently being closed)
+    for (int spins = 0; ; PtexSpinWait(spins)) {
+        int32_t refs = _ioRefs;
+        if (refs >= 0 && AtomicCompareAndSwap(&_ioRefs, refs, refs+1))
+            break;
+    }
+    // _fp is only changed under readlock, and reopenFP checks it again there
+    if (!AtomicLoad(&_fp)) {
+        AutoMutex locker(readlock);
+        if (!reopenFP()) {
+            releaseFP();
+            return false;
+        }
+    }
+    return true;
+}
+
+
 const Ptex::FaceInfo& PtexReader::getFaceInfo(int faceid)
 {
     if (faceid >= 0 && uint32_t(faceid) < _faceinfo.size())
@@ -347,6 +578,67 @@ PtexMetaData* PtexReader::getMetaData()
 }
 
 
+namespace {
+    bool sameOptions(const PtexFilter::Options& a, const PtexFilter::Options& b)
+    {
+        return a.filter == b.filter && a.lerp == b.lerp && a.sharpness == b.sharpness &&
+            a.noedgeblend == b.noedgeblend && a.kerneltable == b.kerneltable;
+    }
+}
+
+
+PtexFilter* PtexFilter::getCachedFilter(PtexTexture* tex, const PtexFilter::Options& opts)
+{
+    // textures not opened by the library have no filter cache
+    PtexReader* reader = dynamic_cast<PtexReader*>(tex);
+    return reader ? reader->getCachedFilter(opts) : getFilter(tex, opts);
+}
+
+
+size_t PtexReader::cachedFilterMemUsed()
+{
+    // approximate: the wrapped filter is usually a separable filter and the
+    // triangle filter is no larger
+    return sizeof(SharedFilter) + sizeof(PtexSeparableFilter);
+}
+
+
+PtexFilter* PtexReader::getCachedFilter(const PtexFilter::Options& options)
+{
+    // if caller was compiled with older version of struct, use default for new opts
+    PtexFilter::Options opts(options.filter, options.lerp, options.sharpness);
+    if (options.__structSize >= (char*)(&options.noedgeblend + 1) - (char*)&options)
+        opts.noedgeblend = options.noedgeblend;
+    if (options.__structSize >= (char*)(&options.kerneltable + 1) - (char*)&options)
+        opts.kerneltable = options.kerneltable;
+
+    // filters are only added (and never changed) so no lock is needed to find one,
+    // but the entries must not be read before the count that covers them
+    int numFilters = _numFilters;
+    PtexMemoryFence();
+    for (int i = 0; i < numFilters; i++) {
+        if (sameOptions(_filters[i].opts, opts)) return _filters[i].filter;
+    }
+
+    // get lock and make sure we still need to add the filter
+    AutoMutex locker(_filterlock);
+    for (int i = numFilters; i < _numFilters; i++) {
+        if (sameOptions(_filters[i].opts, opts)) return _filters[i].filter;
+    }
+
+    // if the cache is full, give the caller a filter of its own
+    PtexFilter* filter = PtexFilter::getFilter(this, opts);
+    if (!filter || _numFilters == MaxCachedFilters) return filter;
+    CachedFilter& entry = _filters[_numFilters];
+    entry.opts = opts;
+    entry.filter = new SharedFilter(filter);
+    _baseMemUsed += cachedFilterMemUsed();
+    increaseMemUsed(cachedFilterMemUsed());
+    AtomicStore(&_numFilters, _numFilters + 1);
+    return entry.filter;
+}
+
+
 PtexReader::MetaData::Entry*
 PtexReader::MetaData::getEntry(int index)
 {
@@ -368,19 +660,18 @@ PtexReader::MetaData::getEntry(int index)
     else {
         // not present, must read from file
 
-        // get read lock and make sure we still need to read
-        AutoMutex locker(_reader->readlock);
-        if (e->lmdData) {
+        // make sure we still need to read (another thread may be reading it)
+        AutoLoad load(_reader->_pendingLoads, e);
+        if (!load.loading() || e->lmdData) {
             return e;
         }
         // go ahead and read, keep local until finished
         LargeMetaData* lmdData = new LargeMetaData(e->datasize);
+        _reader->readZipBlockAt(e->lmdPos, lmdData->data(), e->lmdZipSize, e->datasize);
         e->data = (char*) lmdData->data();
         _reader->increaseMemUsed(sizeof(LargeMetaData) + e->datasize);
-        _reader->seek(e->lmdPos);
-        _reader->readZipBlock(e->data, e->lmdZipSize, e->datasize);
         // update entry
-        e->lmdData = lmdData;
+        AtomicStore(&e->lmdData, lmdData);
         return e;
     }
 }
@@ -553,58 +844,386 @@ void PtexReader::readEditMetaData()
 }
 
 
-bool PtexReader::readBlock(void* data, int size, bool reporterror)
+bool PtexReader::indexKey(IndexHeader& ih)
 {
-    assert(_fp && size >= 0);
-    if (!_fp || size < 0) return false;
-    int result = (int)_io->read(data, size, _fp);
-    if (result == size) {
-        _pos += size;
+    // cached file info is only used for files read by the default handler, and
+    // only pays for the extra file access when there are many faces to decode
+    if (_indexCachePath.empty() || _io != &_defaultIo || int(_header.nfaces) < IndexMinFaces)
+        return false;
+    int64_t filesize, filetime;
+    if (!DefaultInputHandler::fileInfo(_fp, filesize, filetime)) return false;
+    memset(&ih, 0, sizeof(ih));
+    ih.magic = IndexMagic;
+    ih.version = IndexVersion;
+    ih.filesize = uint64_t(filesize);
+    ih.filetime = filetime;
+    ih.header = _header;
+    ih.extheader = _extheader;
+    ih.pathlen = uint32_t(_path.size());
+    return true;
+}
+
+
+uint64_t PtexReader::fileKey()
+{
+    // identify the file to other processes (and later runs) by a hash
+    // (FNV-1a) of its path, size, modification time (to the nanosecond where
+    // the filesystem has it) and file id (only known for files read by the
+    // default handler), its headers, and whether its data is premultiplied
+    int64_t info[4] = { 0, 0, 0, _premultiply };
+    if (_io != &_defaultIo || !DefaultInputHandler::fileInfo(_fp, info[0], info[1], &info[2])) return 0;
+    _fileSize = info[0];
+    _fileTime = info[1];
+    uint64_t hash = (uint64_t(0xcbf29ce4) << 32) | 0x84222325;
+    const uint64_t prime = (uint64_t(1) << 40) | 0x1b3;
+    for (const char* cp = _path.c_str(); *cp; cp++) {
+        hash ^= uint8_t(*cp);
+        hash *= prime;
+    }
+    const uint8_t* bytes = (const uint8_t*) info;
+    for (size_t i = 0; i < sizeof(info); i++) {
+        hash ^= bytes[i];
+        hash *= prime;
+    }
+    bytes = (const uint8_t*) &_header;
+    for (size_t i = 0; i < sizeof(_header); i++) {
+        hash ^= bytes[i];
+        hash *= prime;
+    }
+    bytes = (const uint8_t*) &_extheader;
+    for (size_t i = 0; i < sizeof(_extheader); i++) {
+        hash ^= bytes[i];
+        hash *= prime;
+    }
+    return hash ? hash : 1;
+}
+
+
+std::string PtexReader::indexPath()
+{
+    // name cached file info after a hash of the file path (FNV-1a)
+    uint64_t hash = (uint64_t(0xcbf29ce4) << 32) | 0x84222325;
+    const uint64_t prime = (uint64_t(1) << 40) | 0x1b3;
+    for (const char* cp = _path.c_str(); *cp; cp++) {
+        hash ^= uint8_t(*cp);
+        hash *= prime;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%08x%08x.ptxi", uint32_t(hash >> 32), uint32_t(hash));
+    std::string path = _indexCachePath;
+    path += '/';
+    path += name;
+    return path;
+}
+
+
+bool PtexReader::readIndex()
+{
+    IndexHeader ih;
+    if (!indexKey(ih)) return false;
+    PtexInputHandler::Handle fp = _indexIo.open(indexPath().c_str());
+    if (!fp) return false;
+
+    // compute layout of cached data
+    int nfaces = _header.nfaces;
+    int faceinfosize = int(sizeof(FaceInfo)) * nfaces;
+    int rfaceidsize = int(sizeof(uint32_t)) * nfaces;
+    int constdatasize = _pixelsize * nfaces;
+    FilePos pos = IndexHeaderSize + ih.pathlen + faceinfosize + rfaceidsize + constdatasize;
+    std::vector<FilePos> levelpos(_levelinfo.size());
+    for (size_t i = 0; i < _levelinfo.size(); i++) {
+        levelpos[i] = pos;
+        pos += FaceDataHeaderSize * _levelinfo[i].nfaces;
+    }
+
+    // validate key and size
+    IndexHeader stored;
+    std::string path(ih.pathlen, '\0');
+    int64_t size, mtime;
+    bool ok = _indexIo.readAt(&stored, IndexHeaderSize, 0, fp) == size_t(IndexHeaderSize) &&
+        0 == memcmp(&stored, &ih, IndexHeaderSize) &&
+        _indexIo.readAt(&path[0], ih.pathlen, IndexHeaderSize, fp) == ih.pathlen &&
+        path == _path &&
+        DefaultInputHandler::fileInfo(fp, size, mtime) && size == int64_t(pos);
+
+    // read face info and constant data
+    if (ok) {
+        std::vector<FaceInfo> faceinfo(nfaces);
+        std::vector<uint32_t> rfaceids(nfaces);
+        uint8_t* constdata = new uint8_t[constdatasize];
+        pos = IndexHeaderSize + ih.pathlen;
+        ok = _indexIo.readAt(&faceinfo[0], faceinfosize, pos, fp) == size_t(faceinfosize) &&
+            _indexIo.readAt(&rfaceids[0], rfaceidsize, pos + faceinfosize, fp) == size_t(rfaceidsize) &&
+            _indexIo.readAt(constdata, constdatasize, pos + faceinfosize + rfaceidsize, fp) == size_t(constdatasize);
+        if (ok) {
+            _faceinfo.swap(faceinfo);
+            _rfaceids.swap(rfaceids);
+            increaseMemUsed(nfaces * (sizeof(_faceinfo[0]) + sizeof(_rfaceids[0])));
+            _constdata = constdata;
+            if (_premultiply && _header.hasAlpha())
+                PtexUtils::multalpha(_constdata, nfaces, datatype(),
+                                     _header.nchannels, _header.alphachan);
+            increaseMemUsed(constdatasize);
+        }
+        else delete [] constdata;
+    }
+    if (!ok) {
+        _indexIo.close(fp);
+        return false;
+    }
+
+    // keep file open to read level headers on demand
+    _indexFp = fp;
+    _indexLevelPos.swap(levelpos);
+    return true;
+}
+
+
+bool PtexReader::readIndexLevel(int levelid, Level* level)
+{
+    // read level header from cached file info (if still open)
+    if (size_t(levelid) >= _indexLevelPos.size() || !acquireFP()) return false;
+    size_t size = FaceDataHeaderSize * level->fdh.size();
+    bool ok = _indexFp && (!size ||
+        _indexIo.readAt(&level->fdh[0], size, _indexLevelPos[levelid], _indexFp) == size);
+    releaseFP();
+    return ok;
+}
+
+
+void PtexReader::writeIndex()
+{
+    // save decoded file info so that later opens can skip decoding
+    IndexHeader ih;
+    if (!_ok || !indexKey(ih)) return;
+    std::string path = indexPath();
+    char suffix[32];
+#ifdef PTEX_PLATFORM_WINDOWS
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", int(_getpid()));
+#else
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", int(getpid()));
+#endif
+    std::string tmppath = path + suffix;
+    FILE* fp = fopen(tmppath.c_str(), "wb");
+    if (!fp) return;
+
+    int nfaces = _header.nfaces;
+    int constdatasize = _pixelsize * nfaces;
+    bool ok = fwrite(&ih, IndexHeaderSize, 1, fp) == 1 &&
+        fwrite(_path.c_str(), _path.size(), 1, fp) == 1 &&
+        fwrite(&_faceinfo[0], sizeof(FaceInfo) * nfaces, 1, fp) == 1 &&
+        fwrite(&_rfaceids[0], sizeof(uint32_t) * nfaces, 1, fp) == 1;
+
+    // constant data is stored as in the file (not premultiplied)
+    if (ok) {
+        if (_premultiply && _header.hasAlpha()) {
+            std::vector<uint8_t> constdata(constdatasize);
+            seek(_constdatapos);
+            ok = readZipBlock(&constdata[0], _header.constdatasize, constdatasize) &&
+                fwrite(&constdata[0], constdatasize, 1, fp) == 1;
+        }
+        else ok = fwrite(_constdata, constdatasize, 1, fp) == 1;
+    }
+
+    // level headers
+    for (int i = 0; ok && i < _header.nlevels; i++) {
+        const LevelInfo& l = _levelinfo[i];
+        if (!l.nfaces) continue;
+        std::vector<FaceDataHeader> fdh(l.nfaces);
+        int size = FaceDataHeaderSize * l.nfaces;
+        seek(_levelpos[i]);
+        ok = readZipBlock(&fdh[0], l.levelheadersize, size) &&
+            fwrite(&fdh[0], size, 1, fp) == 1;
+    }
+
+    ok = (fclose(fp) == 0) && ok;
+#ifdef PTEX_PLATFORM_WINDOWS
+    // rename won't replace an existing file
+    if (ok) remove(path.c_str());
+#endif
+    if (!ok || rename(tmppath.c_str(), path.c_str()) != 0)
+        remove(tmppath.c_str());
+}
+
+
+bool PtexReader::readRaw(void* data, int size, FilePos pos, bool reporterror)
+{
+    // note: if the handler doesn't support positional reads,
+    // the stream must already be positioned at pos
+    if (pos + size <= FilePos(_prefix.size())) {
+        // copy from file prefix read at open
+        memcpy(data, &_prefix[pos], size);
         return true;
     }
+    if (_mapdata) {
+        // copy directly from mapped file
+        if (pos + size <= _mapsize) {
+            memcpy(data, _mapdata + pos, size);
+            return true;
+        }
+    }
+    else {
+        // stream position isn't maintained while reading from the prefix
+        if (!_positional && !_prefix.empty()) _io->seek(_fp, pos);
+        size_t result = _positional ? _io->readAt(data, size, pos, _fp) : _io->read(data, size, _fp);
+        if (result == size_t(size)) return true;
+    }
     if (reporterror)
         setError("PtexReader error: read failed (EOF)");
     return false;
 }
 
 
-bool PtexReader::readZipBlock(void* data, int zipsize, int unzipsize)
+bool PtexReader::inflateBuffer(void* data, const char* zipdata, int zipsize, int unzipsize)
+{
+    // inflate a whole block that is already in memory
+    if (!PtexCodec::inflateBlock(data, unzipsize, zipdata, zipsize)) {
+        setError("PtexReader error: unzip failed, file corrupt");
+        return false;
+    }
+    return true;
+}
+
+
+bool PtexReader::inflateRaw(void* data, int zipsize, int unzipsize, FilePos pos)
 {
     if (zipsize < 0 || unzipsize < 0) return false;
-    if (!_zstream.state) {
-        inflateInit(&_zstream);
+    if (_mapdata) {
+        // inflate in place from the mapped file (no copy needed)
+        if (pos + zipsize > _mapsize) {
+            setError("PtexReader error: read failed (EOF)");
+            return false;
+        }
+        return inflateBuffer(data, _mapdata + pos, zipsize, unzipsize);
     }
+    if (pos + zipsize <= FilePos(_prefix.size()))
+        return inflateBuffer(data, &_prefix[pos], zipsize, unzipsize);
 
     void* buff = alloca(BlockSize);
-    _zstream.next_out = (Bytef*) data;
-    _zstream.avail_out = unzipsize;
+    int size = 0;
+    if (PtexCodec::streaming()) {
+        // read the first chunk to check the codec (lz4 blocks can't be streamed)
+        size = (zipsize < BlockSize) ? zipsize : BlockSize;
+        if (!readRaw(buff, size, pos, true)) return false;
+        if (!PtexCodec::isLz4Block(buff, size))
+            return inflateStream(data, zipsize, unzipsize, pos, buff, size);
+    }
+
+    // read and inflate the whole block at once
+    bool useNew = zipsize > AllocaMax;
+    char* zipdata = useNew ? new char [zipsize] : (char*) alloca(zipsize);
+    memcpy(zipdata, buff, size);
+    bool ok = (size == zipsize || readRaw(zipdata + size, zipsize - size, pos + size, true)) &&
+        inflateBuffer(data, zipdata, zipsize, unzipsize);
+    if (useNew) delete [] zipdata;
+    return ok;
+}
+
+
+bool PtexReader::inflateStream(void* data, int zipsize, int unzipsize, FilePos pos,
+                               void* buff, int size)
+{
+    // inflate in BlockSize chunks, the first of which has already been read into buff
+    z_stream* zstream = PtexCodec::acquireInflateStream();
+    zstream->next_out = (Bytef*) data;
+    zstream->avail_out = unzipsize;
 
+    bool ok = true;
     while (1) {
-        int size = (zipsize < BlockSize) ? zipsize : BlockSize;
         zipsize -= size;
-        if (!readBlock(buff, size)) break;
-        _zstream.next_in = (Bytef*) buff;
-        _zstream.avail_in = size;
-        int zresult = inflate(&_zstream, zipsize ? Z_NO_FLUSH : Z_FINISH);
+        pos += size;
+        zstream->next_in = (Bytef*) buff;
+        zstream->avail_in = size;
+        int zresult = inflate(zstream, zipsize ? Z_NO_FLUSH : Z_FINISH);
         if (zresult == Z_STREAM_END) break;
         if (zresult != Z_OK) {
             setError("PtexReader error: unzip failed, file corrupt");
-            inflateReset(&_zstream);
-            return 0;
+            ok = false;
+            break;
         }
+        size = (zipsize < BlockSize) ? zipsize : BlockSize;
+        if (!readRaw(buff, size, pos, true)) break;
     }
 
-    int total = (int)_zstream.total_out;
-    inflateReset(&_zstream);
-    return total == unzipsize;
+    int total = (int)zstream->total_out;
+    PtexCodec::releaseInflateStream(zstream);
+    return ok && total == unzipsize;
+}
+
+
+bool PtexReader::readBlock(void* data, int size, bool reporterror)
+{
+    assert(_fp && size >= 0);
+    if (!_fp || size < 0) return false;
+    if (!readRaw(data, size, _pos, reporterror)) return false;
+    _pos += size;
+    return true;
+}
+
+
+bool PtexReader::readZipBlock(void* data, int zipsize, int unzipsize)
+{
+    if (!_fp || zipsize < 0) return false;
+    bool ok = inflateRaw(data, zipsize, unzipsize, _pos);
+    _pos += zipsize;
+    return ok;
+}
+
+
+bool PtexReader::readBlockAt(FilePos pos, void* data, int size)
+{
+    if (!_positional) {
+        // must serialize access to the stream position
+        AutoMutex locker(readlock);
+        seek(pos);
+        return readBlock(data, size);
+    }
+    if (!acquireFP()) return false;
+    logBlockRead();
+    bool ok = readRaw(data, size, pos, true);
+    releaseFP();
+    return ok;
+}
+
+
+bool PtexReader::readZipBlockAt(FilePos pos, void* data, int zipsize, int unzipsize)
+{
+    if (!_positional) {
+        // must serialize access to the stream position
+        AutoMutex locker(readlock);
+        seek(pos);
+        return readZipBlock(data, zipsize, unzipsize);
+    }
+    if (!acquireFP()) return false;
+    logBlockRead();
+    bool ok = inflateRaw(data, zipsize, unzipsize, pos);
+    releaseFP();
+    return ok;
+}
+
+
+bool PtexReader::readFaceBlockAt(FilePos pos, void* data, int zipsize, int unzipsize)
+{
+    // read a face (or tile) block through the block cache, if any, so
+    // that reloading the face after it is freed only costs decompression
+    // (mapped files are already in memory and don't need it)
+    PtexBlockCache* cache = _mapdata ? 0 : blockCache();
+    if (!cache || zipsize <= 0) return readZipBlockAt(pos, data, zipsize, unzipsize);
+    std::vector<char> block;
+    if (!cache->get(this, pos, block)) {
+        block.resize(zipsize);
+        if (!readBlockAt(pos, &block[0], zipsize)) return false;
+        cache->add(this, pos, &block[0], zipsize);
+    }
+    return inflateBuffer(data, &block[0], zipsize, unzipsize);
 }
 
 
 void PtexReader::readLevel(int levelid, Level*& level)
 {
-    // get read lock and make sure we still need to read
-    AutoMutex locker(readlock);
-    if (level) {
+    // make sure we still need to read (another thread may be reading it)
+    AutoLoad load(_pendingLoads, &level);
+    if (!load.loading() || level) {
         return;
     }
 
@@ -613,9 +1232,10 @@ void PtexReader::readLevel(int levelid, Level*& level)
 
     // keep new level local until finished
     Level* newlevel = new Level(l.nfaces);
-    seek(_levelpos[levelid]);
-    readZipBlock(&newlevel->fdh[0], l.levelheadersize, FaceDataHeaderSize * l.nfaces);
-    computeOffsets(tell(), l.nfaces, &newlevel->fdh[0], &newlevel->offsets[0]);
+    FilePos pos = _levelpos[levelid];
+    if (!readIndexLevel(levelid, newlevel))
+        readZipBlockAt(pos, &newlevel->fdh[0], l.levelheadersize, FaceDataHeaderSize * l.nfaces);
+    computeOffsets(pos + l.levelheadersize, l.nfaces, &newlevel->fdh[0], &newlevel->offsets[0]);
 
     // apply edits (if any) to level 0
     if (levelid == 0) {
@@ -649,8 +1269,13 @@ void PtexReader::TiledFace::readTile(int tile, FaceData*& data)
 void PtexReader::readFaceData(FilePos pos, FaceDataHeader fdh, Res res, int levelid,
                               FaceData*& face)
 {
-    AutoMutex locker(readlock);
+    // make sure we still need to read (another thread may be reading it);
+    // a batched read (see readFaceBatch) leaves faces it failed to read
+    // unpublished, so if there's still no face after waiting, read it here
+    bool loading = false;
+    while (!face && !(loading = _pendingLoads.beginLoad(&face))) {}
     if (face) {
+        if (loading) _pendingLoads.endLoad(&face);
         return;
     }
 
@@ -658,14 +1283,13 @@ void PtexReader::readFaceData(FilePos pos, FaceDataHeader fdh, Res res, int leve
     FaceData* newface = 0;
     size_t newMemUsed = 0;
 
-    seek(pos);
     switch (fdh.encoding()) {
     case enc_constant:
         {
             ConstantFace* cf = new ConstantFace(_pixelsize);
             newface = cf;
             newMemUsed = sizeof(ConstantFace) + _pixelsize;
-            readBlock(cf->data(), _pixelsize);
+            readBlockAt(pos, cf->data(), _pixelsize);
             if (levelid==0 && _premultiply && _header.hasAlpha())
                 PtexUtils::multalpha(cf->data(), 1, datatype(),
                                      _header.nchannels, _header.alphachan);
@@ -673,15 +1297,20 @@ void PtexReader::readFaceData(FilePos pos, FaceDataHeader fdh, Res res, int leve
         break;
     case enc_tiled:
         {
+            // tile res and tile header size precede the tile header
+            char preheader[sizeof(Res) + sizeof(uint32_t)];
             Res tileres;
-            readBlock(&tileres, sizeof(tileres));
-            uint32_t tileheadersize;
-            readBlock(&tileheadersize, sizeof(tileheadersize));
+            uint32_t tileheadersize = 0;
+            if (readBlockAt(pos, preheader, sizeof(preheader))) {
+                memcpy(&tileres, preheader, sizeof(tileres));
+                memcpy(&tileheadersize, preheader + sizeof(tileres), sizeof(tileheadersize));
+            }
+            pos += sizeof(preheader);
             TiledFace* tf = new TiledFace(this, res, tileres, levelid);
             newface = tf;
             newMemUsed = tf->memUsed();
-            readZipBlock(&tf->_fdh[0], tileheadersize, FaceDataHeaderSize * tf->_ntiles);
-            computeOffsets(tell(), tf->_ntiles, &tf->_fdh[0], &tf->_offsets[0]);
+            readZipBlockAt(pos, &tf->_fdh[0], tileheadersize, FaceDataHeaderSize * tf->_ntiles);
+            computeOffsets(pos + tileheadersize, tf->_ntiles, &tf->_fdh[0], &tf->_offsets[0]);
         }
         break;
     case enc_zipped:
@@ -690,21 +1319,29 @@ void PtexReader::readFaceData(FilePos pos, FaceDataHeader fdh, Res res, int leve
             int uw = res.u(), vw = res.v();
             int npixels = uw * vw;
             int unpackedSize = _pixelsize * npixels;
+            // use data in the shared cache in place if it's there
+            newface = sharedFace(pos, res, unpackedSize, true);
+            if (newface) {
+                newMemUsed = newface->memUsed();
+                break;
+            }
             PackedFace* pf = new PackedFace(res, _pixelsize, unpackedSize);
             newface = pf;
             newMemUsed = sizeof(PackedFace) + unpackedSize;
-            bool useNew = unpackedSize > AllocaMax;
-            char* tmp = useNew ? new char [unpackedSize] : (char*) alloca(unpackedSize);
-            readZipBlock(tmp, fdh.blocksize(), unpackedSize);
-            if (fdh.encoding() == enc_diffzipped)
-                PtexUtils::decodeDifference(tmp, unpackedSize, datatype());
-            PtexUtils::interleave(tmp, uw * DataSize(datatype()), uw, vw,
-                                  pf->data(), uw * _pixelsize,
-                                  datatype(), _header.nchannels);
-            if (levelid==0 && _premultiply && _header.hasAlpha())
-                PtexUtils::multalpha(pf->data(), npixels, datatype(),
-                                     _header.nchannels, _header.alphachan);
-            if (useNew) delete [] tmp;
+            if (!readCachedFace(pos, pf->data(), unpackedSize)) {
+                bool useNew = unpackedSize > AllocaMax;
+                char* tmp = useNew ? new char [unpackedSize] : (char*) alloca(unpackedSize);
+                bool ok = readFaceBlockAt(pos, tmp, fdh.blocksize(), unpackedSize);
+                unpackFaceData(tmp, fdh, res, levelid, pf);
+                if (useNew) delete [] tmp;
+                if (ok) cacheFace(pos, pf->data(), unpackedSize);
+            }
+            // once added to the shared cache, use that copy instead
+            if (FaceData* sf = sharedFace(pos, res, unpackedSize, false)) {
+                delete static_cast<FaceData*>(pf);
+                newface = sf;
+                newMemUsed = sf->memUsed();
+            }
         }
         break;
     }
@@ -713,6 +1350,224 @@ void PtexReader::readFaceData(FilePos pos, FaceDataHeader fdh, Res res, int leve
 
     AtomicStore(&face, newface);
     increaseMemUsed(newMemUsed);
+    _pendingLoads.endLoad(&face);
+}
+
+
+PtexReader::FaceData* PtexReader::sharedFace(FilePos pos, Res res, int size, bool countHit)
+{
+    // pin face data in the shared cache to use it in place
+    PtexSharedCache* shared = _fileKey ? sharedCache() : 0;
+    const void* data = shared ? shared->pin(_fileKey, pos, size, countHit) : 0;
+    return data ? new SharedFace(res, _pixelsize, shared, data) : 0;
+}
+
+
+PtexReader::SharedFace::~SharedFace()
+{
+    _cache->unpin(_data);
+    _data = 0;
+}
+
+
+bool PtexReader::readCachedFace(FilePos pos, void* data, int size)
+{
+    // look for decoded face data in the shared and disk caches, copying
+    // data found on disk to the shared cache for other processes
+    if (!_fileKey) return false;
+    PtexSharedCache* shared = sharedCache();
+    if (shared && shared->get(_fileKey, pos, data, size)) return true;
+    PtexDiskCache* disk = diskCache();
+    if (!disk || !disk->get(_fileKey, _fileSize, _fileTime, pos, data, size)) return false;
+    if (shared) shared->add(_fileKey, pos, data, size);
+    return true;
+}
+
+
+bool PtexReader::hasCachedFace(FilePos pos, int size)
+{
+    if (!_fileKey) return false;
+    PtexSharedCache* shared = sharedCache();
+    if (shared && shared->contains(_fileKey, pos, size)) return true;
+    PtexDiskCache* disk = diskCache();
+    return disk && disk->contains(_fileKey, pos);
+}
+
+
+void PtexReader::cacheFace(FilePos pos, const void* data, int size)
+{
+    // keep decoded face data read from the file in the shared and disk caches
+    if (!_fileKey) return;
+    if (PtexSharedCache* shared = sharedCache()) shared->add(_fileKey, pos, data, size);
+    if (PtexDiskCache* disk = diskCache()) disk->add(_fileKey, _fileSize, _fileTime, pos, data, size);
+}
+
+
+void PtexReader::unpackFaceData(char* data, FaceDataHeader fdh, Res res, int levelid,
+                                PackedFace* face)
+{
+    // convert inflated (zipped or diffzipped) block data to interleaved pixels
+    int uw = res.u(), vw = res.v();
+    int npixels = uw * vw;
+    int unpackedSize = _pixelsize * npixels;
+    if (fdh.encoding() == enc_diffzipped)
+        PtexUtils::decodeDifference(data, unpackedSize, datatype());
+    PtexUtils::interleave(data, uw * DataSize(datatype()), uw, vw,
+                          face->data(), uw * _pixelsize,
+                          datatype(), _header.nchannels);
+    if (levelid==0 && _premultiply && _header.hasAlpha())
+        PtexUtils::multalpha(face->data(), npixels, datatype(),
+                             _header.nchannels, _header.alphachan);
+}
+
+
+void PtexReader::getData(int nfaces, const int* faceids, void* const* buffers,
+                         const int* strides, const Res* res)
+{
+    // load the faces with coalesced reads, then copy them out as usual
+    if (_ok && nfaces > 1) readFaceBatch(nfaces, faceids, res);
+    for (int i = 0; i < nfaces; i++) {
+        int faceid = faceids[i];
+        int stride = strides ? strides[i] : 0;
+        if (res) getData(faceid, buffers[i], stride, res[i]);
+        else getData(faceid, buffers[i], stride);
+    }
+}
+
+
+namespace {
+    struct BatchFace {
+        FilePos pos;                      // file position of face block
+        int size;                         // size of face block
+        FaceDataHeader fdh;
+        Res res;
+        int levelid;
+        int index;                        // index within level
+        bool operator<(const BatchFace& other) const { return pos < other.pos; }
+    };
+}
+
+
+void PtexReader::readFaceBatch(int nfaces, const int* faceids, const Res* res)
+{
+    // find the faces that need to be read from a stored level and are
+    // stored as a single zip block (tiled faces, constant faces, dynamic
+    // reductions, and faces in the block or decoded data caches are left
+    // to the regular per-face path)
+    PtexBlockCache* cache = _mapdata ? 0 : blockCache();
+    std::vector<BatchFace> batch;
+    batch.reserve(nfaces);
+    for (int i = 0; i < nfaces; i++) {
+        int faceid = faceids[i];
+        if (faceid < 0 || size_t(faceid) >= _header.nfaces) continue;
+        const FaceInfo& fi = _faceinfo[faceid];
+        Res r = res ? res[i] : fi.res;
+        if (fi.isConstant() || r == 0) continue;
+        int redu = fi.res.ulog2 - r.ulog2, redv = fi.res.vlog2 - r.vlog2;
+        if (redu != redv || redu < 0 || size_t(redu) >= _levels.size()) continue;
+        if (redu > 0 && fi.hasEdits()) continue;
+        Level* level = getLevel(redu);
+        int index = redu ? int(_rfaceids[faceid]) : faceid;
+        if (size_t(index) >= level->faces.size() || level->faces[index]) continue;
+        FaceDataHeader fdh = level->fdh[index];
+        if (fdh.encoding() != enc_zipped && fdh.encoding() != enc_diffzipped) continue;
+        if (cache && cache->contains(this, level->offsets[index])) continue; // no read needed
+        if (hasCachedFace(level->offsets[index], _pixelsize * r.size())) continue;
+        BatchFace f;
+        f.pos = level->offsets[index];
+        f.size = fdh.blocksize();
+        f.fdh = fdh;
+        f.res = r;
+        f.levelid = redu;
+        f.index = index;
+        batch.push_back(f);
+    }
+    if (batch.size() < 2) return;
+
+    // read faces in file order
+    std::sort(batch.begin(), batch.end());
+
+    std::vector<char> readbuff;
+    std::vector<char> unpackbuff;
+    for (size_t begin = 0, nbatch = batch.size(); begin < nbatch; ) {
+        // coalesce adjacent blocks (allowing small gaps) into a single read
+        size_t end = begin + 1;
+        FilePos runpos = batch[begin].pos;
+        FilePos runend = runpos + batch[begin].size;
+        while (end < nbatch && batch[end].pos >= runend &&
+               batch[end].pos - runend <= IBuffSize &&
+               batch[end].pos + batch[end].size - runpos <= CoalesceSize)
+        {
+            runend = batch[end].pos + batch[end].size;
+            end++;
+        }
+        int runsize = int(runend - runpos);
+
+        // claim the faces in the run; skip any being loaded by another thread
+        for (size_t i = begin; i < end; i++) {
+            BatchFace& f = batch[i];
+            FaceData** slot = &_levels[f.levelid]->faces[f.index];
+            if (!_pendingLoads.beginLoad(slot, /*wait*/ false)) f.size = 0;
+            else if (*slot) { _pendingLoads.endLoad(slot); f.size = 0; }
+        }
+
+        // get the block data, directly from the mapped file if possible
+        const char* rundata = 0;
+        bool haveFP = false;
+        if (_positional) {
+            haveFP = acquireFP();
+            if (haveFP) {
+                logBlockRead();
+                if (_mapdata) {
+                    if (runend <= _mapsize) rundata = _mapdata + runpos;
+                }
+                else {
+                    readbuff.resize(runsize);
+                    if (readRaw(&readbuff[0], runsize, runpos, true)) rundata = &readbuff[0];
+                }
+            }
+        }
+        else {
+            readbuff.resize(runsize);
+            if (readBlockAt(runpos, &readbuff[0], runsize)) rundata = &readbuff[0];
+        }
+
+        // decompress and publish each face
+        for (size_t i = begin; i < end; i++) {
+            BatchFace& f = batch[i];
+            if (!f.size) continue;
+            Level* level = _levels[f.levelid];
+            FaceData** slot = &level->faces[f.index];
+            FaceData* newface = 0;
+            size_t newMemUsed = 0;
+            if (rundata) {
+                if (cache) cache->add(this, f.pos, rundata + (f.pos - runpos), f.size);
+                int unpackedSize = _pixelsize * f.res.size();
+                unpackbuff.resize(unpackedSize);
+                if (inflateBuffer(&unpackbuff[0], rundata + (f.pos - runpos), f.size, unpackedSize)) {
+                    PackedFace* pf = new PackedFace(f.res, _pixelsize, unpackedSize);
+                    unpackFaceData(&unpackbuff[0], f.fdh, f.res, f.levelid, pf);
+                    cacheFace(f.pos, pf->data(), unpackedSize);
+                    newface = pf;
+                    newMemUsed = sizeof(PackedFace) + unpackedSize;
+                    if (FaceData* sf = sharedFace(f.pos, f.res, unpackedSize, false)) {
+                        delete static_cast<FaceData*>(pf);
+                        newface = sf;
+                        newMemUsed = sf->memUsed();
+                    }
+                }
+            }
+            if (newface) {
+                AtomicStore(slot, newface);
+                increaseMemUsed(newMemUsed);
+            }
+            // on failure, leave the face for the regular path to read (and report);
+            // threads waiting on it in readFaceData read it themselves
+            _pendingLoads.endLoad(slot);
+        }
+        if (haveFP) releaseFP();
+        begin = end;
+    }
 }
 
 
@@ -742,29 +1597,13 @@ void PtexReader::getData(int faceid, void* buffer, int stride, Res res)
                         resu, resv, _pixelsize);
     }
     else if (d->isTiled()) {
-        // loop over tiles
-        Res tileres = d->tileRes();
-        int ntilesu = res.ntilesu(tileres);
-        int ntilesv = res.ntilesv(tileres);
-        int tileures = tileres.u();
-        int tilevres = tileres.v();
-        int tilerowlen = _pixelsize * tileures;
-        int tile = 0;
-        char* dsttilerow = (char*) buffer;
-        for (int i = 0; i < ntilesv; i++) {
-            char* dsttile = dsttilerow;
-            for (int j = 0; j < ntilesu; j++) {
-                PtexPtr<PtexFaceData> t ( d->getTile(tile++) );
-                if (t->isConstant())
-                    PtexUtils::fill(t->getData(), dsttile, stride,
-                                    tileures, tilevres, _pixelsize);
-                else
-                    PtexUtils::copy(t->getData(), tilerowlen, dsttile, stride,
-                                    tilevres, tilerowlen);
-                dsttile += tilerowlen;
-            }
-            dsttilerow += stride * tilevres;
-        }
+        // load tiles directly into dest buffer, in parallel if enabled
+        TileLoader* loader = new TileLoader(d.get(), buffer, stride, _pixelsize);
+        if (loader->ntiles() > 1)
+            submitTileTasks(loader, loader->ntiles() - 1);
+        while (loader->loadNext()) {}
+        loader->wait();
+        loader->unref();
     }
     else {
         PtexUtils::copy(d->getData(), rowlen, buffer, stride, resv, rowlen);
@@ -772,6 +1611,51 @@ void PtexReader::getData(int faceid, void* buffer, int stride, Res res)
 }
 
 
+PtexReader::TileLoader::TileLoader(PtexFaceData* face, void* buffer, int stride, int pixelsize)
+    : _face(face), _buffer((char*) buffer), _stride(stride), _pixelsize(pixelsize),
+      _tileres(face->tileRes()), _refCount(1), _next(0), _done(0)
+{
+    Res res = face->res();
+    _ntilesu = res.ntilesu(_tileres);
+    _ntiles = _ntilesu * res.ntilesv(_tileres);
+}
+
+
+bool PtexReader::TileLoader::loadNext()
+{
+    // claim a tile (once all are claimed, don't touch the face or buffer,
+    // they may already be gone)
+    int tile = AtomicIncrement(&_next) - 1;
+    if (tile >= _ntiles) return false;
+
+    int tileures = _tileres.u(), tilevres = _tileres.v();
+    int tilerowlen = _pixelsize * tileures;
+    char* dsttile = _buffer + (tile / _ntilesu) * _stride * tilevres + (tile % _ntilesu) * tilerowlen;
+    {
+        // the tile must be released before the copy is counted as done,
+        // after which the face may be purged
+        PtexPtr<PtexFaceData> t ( _face->getTile(tile) );
+        if (t->isConstant())
+            PtexUtils::fill(t->getData(), dsttile, _stride,
+                            tileures, tilevres, _pixelsize);
+        else
+            PtexUtils::copy(t->getData(), tilerowlen, dsttile, _stride,
+                            tilevres, tilerowlen);
+    }
+
+    AutoMonitor locker(_monitor);
+    if (++_done == _ntiles) _monitor.notifyAll();
+    return true;
+}
+
+
+void PtexReader::TileLoader::wait()
+{
+    AutoMonitor locker(_monitor);
+    while (_done < _ntiles) _monitor.wait();
+}
+
+
 PtexFaceData* PtexReader::getData(int faceid)
 {
     if (!_ok || faceid < 0 || size_t(faceid) >= _header.nfaces) {
@@ -836,6 +1720,7 @@ PtexFaceData* PtexReader::getData(int faceid, Res res)
     ReductionKey key(faceid, res);
     FaceData* face = _reductions.get(key);
     if (face) {
+        markUsed(_reductionUses);
         return face;
     }
 
@@ -894,6 +1779,7 @@ PtexFaceData* PtexReader::getData(int faceid, Res res)
     else {
         increaseMemUsed(newMemUsed + tableNewMemUsed);
     }
+    markUsed(_reductionUses);
     return face;
 }
 
@@ -1124,6 +2010,7 @@ PtexFaceData* PtexReader::TiledReducedFace::getTile(int tile)
 {
     FaceData*& face = _tiles[tile];
     if (face) {
+        face->markUsed();
         return face;
     }
 
@@ -1194,4 +2081,242 @@ PtexFaceData* PtexReader::TiledReducedFace::getTile(int tile)
     return face;
 }
 
+
+PtexInputHandler::Handle PtexReader::DefaultInputHandler::open(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp) {
+        // use mapped file if possible, otherwise fall back to buffered stdio
+        if (!map(fp)) {
+            buffer = new char [IBuffSize];
+            setvbuf(fp, buffer, _IOFBF, IBuffSize);
+        }
+    }
+    else buffer = 0;
+    return (Handle) fp;
+}
+
+
+bool PtexReader::DefaultInputHandler::close(Handle handle)
+{
+    unmap();
+    bool ok = handle && (fclose((FILE*)handle) == 0);
+    if (buffer) { delete [] buffer; buffer = 0; }
+    return ok;
+}
+
+
+PtexReader::PendingLoads::~PendingLoads()
+{
+    for (size_t i = 0, n = _loads.size(); i < n; i++) delete _loads[i];
+    for (size_t i = 0, n = _free.size(); i < n; i++) delete _free[i];
+}
+
+
+bool PtexReader::PendingLoads::beginLoad(const void* item, bool wait)
+{
+    _lock.lock();
+    for (size_t i = 0, n = _loads.size(); i < n; i++) {
+        Load* load = _loads[i];
+        if (load->item != item) continue;
+        if (!wait) {
+            _lock.unlock();
+            return false;
+        }
+
+        // item is already being loaded, wait for loading thread to finish
+        load->waiters++;
+        _lock.unlock();
+        load->mutex.lock();
+        load->mutex.unlock();
+
+        // last thread out recycles the record
+        _lock.lock();
+        if (--load->waiters == 0 && load->done) freeLoad(load);
+        _lock.unlock();
+        return false;
+    }
+
+    // register new load; mutex is held until the load is finished
+    Load* load;
+    if (_free.empty()) load = new Load;
+    else { load = _free.back(); _free.pop_back(); }
+    load->item = item;
+    load->waiters = 0;
+    load->done = false;
+    load->mutex.lock();
+    _loads.push_back(load);
+    _lock.unlock();
+    return true;
+}
+
+
+void PtexReader::PendingLoads::endLoad(const void* item)
+{
+    _lock.lock();
+    Load* load = 0;
+    for (size_t i = 0, n = _loads.size(); i < n; i++) {
+        if (_loads[i]->item == item) {
+            load = _loads[i];
+            _loads[i] = _loads.back();
+            _loads.pop_back();
+            break;
+        }
+    }
+    if (!load) { _lock.unlock(); return; }
+    load->done = true;
+    bool unused = load->waiters == 0;
+    _lock.unlock();
+
+    // wake up waiting threads
+    load->mutex.unlock();
+    if (unused) {
+        _lock.lock();
+        freeLoad(load);
+        _lock.unlock();
+    }
+}
+
+
+size_t PtexReader::DefaultInputHandler::readAt(void* bufferArg, size_t size, int64_t pos, Handle handle)
+{
+    if (_mapdata) {
+        if (pos < 0 || pos + int64_t(size) > _mapsize) return 0;
+        memcpy(bufferArg, _mapdata + pos, size);
+        return size;
+    }
+#ifdef PTEX_PLATFORM_WINDOWS
+    AutoMutex locker(_readAtLock);
+    if (fseeko((FILE*)handle, pos, SEEK_SET) != 0) return 0;
+    return fread(bufferArg, 1, size, (FILE*)handle);
+#else
+    int fd = fileno((FILE*)handle);
+    size_t total = 0;
+    while (total < size) {
+        ssize_t result = pread(fd, (char*)bufferArg + total, size - total, off_t(pos + total));
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) return total;
+        total += size_t(result);
+    }
+    return total;
+#endif
+}
+
+
+bool PtexReader::DefaultInputHandler::fileInfo(Handle handle, int64_t& size, int64_t& mtime,
+                                                int64_t* fileid)
+{
+#ifdef PTEX_PLATFORM_WINDOWS
+    struct _stat64 st;
+    if (_fstat64(_fileno((FILE*)handle), &st) != 0) return false;
+#else
+    struct stat st;
+    if (fstat(fileno((FILE*)handle), &st) != 0) return false;
+#endif
+    size = int64_t(st.st_size);
+    // with sub-second precision where available, so that a file rewritten
+    // within the same second is still seen as changed
+#if defined(PTEX_PLATFORM_WINDOWS)
+    mtime = int64_t(st.st_mtime) * 1000000000;
+#elif defined(__APPLE__)
+    mtime = int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    if (fileid) *fileid = int64_t(st.st_ino);
+    return true;
+}
+
+
+namespace {
+#if !defined(PTEX_NO_MMAP) && !defined(PTEX_PLATFORM_WINDOWS)
+    // true if the open file is on a local filesystem; accessing a mapping
+    // raises SIGBUS when the file is truncated, which network filesystems
+    // can do at any time when the file is replaced on another host
+    bool isLocalFile(int fd)
+    {
+#if defined(__APPLE__)
+        struct statfs fs;
+        return fstatfs(fd, &fs) == 0 && (fs.f_flags & MNT_LOCAL);
+#elif defined(__linux__)
+        struct statfs fs;
+        if (fstatfs(fd, &fs) != 0) return false;
+        switch (uint32_t(fs.f_type)) {
+        case 0x6969:        // nfs
+        case 0x517b:        // smb
+        case 0xfe534d42:    // smb2
+        case 0xff534d42:    // cifs
+        case 0x65735546:    // fuse
+        case 0x00c36400:    // ceph
+        case 0x5346414f:    // afs
+        case 0x01021997:    // 9p
+        case 0x0bd00bd0:    // lustre
+        case 0x47504653:    // gpfs
+            return false;
+        default:
+            return true;
+        }
+#else
+        (void) fd;
+        return false;
+#endif
+    }
+#endif
+}
+
+
+bool PtexReader::DefaultInputHandler::map(FILE* fp)
+{
+#if defined(PTEX_NO_MMAP)
+    (void) fp;
+    return false;
+#elif defined(PTEX_PLATFORM_WINDOWS)
+    HANDLE file = (HANDLE) _get_osfhandle(_fileno(fp));
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+        return false;
+    // don't map remote files, whose pages can fail to read in at any time
+    FILE_REMOTE_PROTOCOL_INFO remote;
+    if (GetFileInformationByHandleEx(file, FileRemoteProtocolInfo, &remote, sizeof(remote)))
+        return false;
+    if (sizeof(void*) < 8 && size.QuadPart > 0x7fffffff) return false;
+    _maphandle = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!_maphandle) return false;
+    _mapdata = (const char*) MapViewOfFile(_maphandle, FILE_MAP_READ, 0, 0, 0);
+    if (!_mapdata) {
+        CloseHandle(_maphandle);
+        _maphandle = 0;
+        return false;
+    }
+    _mapsize = size.QuadPart;
+    return true;
+#else
+    struct stat st;
+    int fd = fileno(fp);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return false;
+    if (!isLocalFile(fd)) return false;
+    if (sizeof(void*) < 8 && st.st_size > 0x7fffffff) return false;
+    void* data = mmap(0, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) return false;
+    _mapdata = (const char*) data;
+    _mapsize = st.st_size;
+    return true;
+#endif
+}
+
+
+void PtexReader::DefaultInputHandler::unmap()
+{
+    if (!_mapdata) return;
+#if defined(PTEX_PLATFORM_WINDOWS)
+    UnmapViewOfFile(_mapdata);
+    CloseHandle(_maphandle);
+    _maphandle = 0;
+#elif !defined(PTEX_NO_MMAP)
+    munmap((void*) _mapdata, size_t(_mapsize));
+#endif
+    _mapdata = 0;
+    _mapsize = 0;
+}
+
 PTEX_NAMESPACE_END
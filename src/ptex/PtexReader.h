@@ -46,9 +46,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include "PtexUtils.h"
 
 #include "PtexHashMap.h"
+#include "PtexThreadPool.h"
 
 PTEX_NAMESPACE_BEGIN
 
+class PtexBlockCache;
+class PtexSharedCache;
+class PtexDiskCache;
+
 class PtexReader : public PtexTexture {
 public:
     PtexReader(bool premultiply, PtexInputHandler* inputHandler, PtexErrorHandler* errorHandler);
@@ -57,10 +62,13 @@ public:
     bool needToOpen() const { return _needToOpen; }
     bool open(const char* path, Ptex::String& error);
     void prune();
+    size_t evictUnused(size_t target, CachePolicy policy=cp_recency);
     void purge();
     void setPendingPurge() { _pendingPurge = true; }
     bool pendingPurge() const { return _pendingPurge; }
     bool tryClose();
+    void setIndexCachePath(const char* path) { _indexCachePath = path ? path : ""; }
+    void setOpenReadSize(size_t size) { _openReadSize = FilePos(PtexUtils::min(size, size_t(MaxPrefixSize))); }
     bool ok() const { return _ok; }
     bool isOpen() { return _fp; }
     void invalidate() {
@@ -69,6 +77,26 @@ public:
     }
 
     void increaseMemUsed(size_t amount) { if (amount) AtomicAdd(&_memUsed, amount); }
+
+    // use counts for clock replacement (see evictUnused)
+    enum { MaxUses = 4 };
+    static void markUsed(volatile uint8_t& uses) { if (uses < MaxUses) uses = uint8_t(uses + 1); }
+    static bool age(volatile uint8_t& uses, CachePolicy policy)
+    {
+        // returns true if data should be kept, counting down its uses;
+        // cp_recency keeps data used since the last visit (uses are
+        // reset), cp_frequency keeps data used more than once (loading
+        // counts as a use) for a visit per use
+        if (policy == cp_recency) {
+            if (!uses) return false;
+            uses = 0;
+            return true;
+        }
+        if (uses <= 1) return false;
+        uses = uint8_t(uses - 1);
+        return true;
+    }
+
     void logOpen() { AtomicIncrement(&_opens); }
     void logBlockRead() { AtomicIncrement(&_blockReads); }
 
@@ -99,6 +127,9 @@ public:
     virtual bool hasMipMaps() { return _header.nlevels > 1; }
 
     virtual PtexMetaData* getMetaData();
+
+    /// Filter shared by all users of this texture (see PtexFilter::getCachedFilter).
+    PtexFilter* getCachedFilter(const PtexFilter::Options& opts);
     virtual const Ptex::FaceInfo& getFaceInfo(int faceid);
     virtual void getData(int faceid, void* buffer, int stride);
     virtual void getData(int faceid, void* buffer, int stride, Res res);
@@ -109,6 +140,8 @@ public:
     virtual void getPixel(int faceid, int u, int v,
 			  float* result, int firstchan, int nchannels,
 			  Ptex::Res res);
+    virtual void getData(int nfaces, const int* faceids, void* const* buffers,
+                         const int* strides, const Res* res);
 
     DataType datatype() const { return DataType(_header.datatype); }
     int nchannels() const { return _header.nchannels; }
@@ -117,6 +150,31 @@ public:
     const ExtHeader& extheader() const { return _extheader; }
     const LevelInfo& levelinfo(int level) const { return _levelinfo[level]; }
 
+    /// Filter held by the reader for all users, release() does nothing.
+    class SharedFilter : public PtexFilter {
+    public:
+        SharedFilter(PtexFilter* filter) : _filter(filter) {}
+        virtual ~SharedFilter() { _filter->release(); }
+        virtual void release() {}
+        virtual void eval(float* result, int firstchan, int nchannels,
+                          int faceid, float u, float v, float uw1, float vw1, float uw2, float vw2,
+                          float width, float blur)
+        {
+            _filter->eval(result, firstchan, nchannels, faceid, u, v, uw1, vw1, uw2, vw2,
+                          width, blur);
+        }
+        virtual void evalMany(float* result, int firstchan, int nchannels, int n,
+                              const int* faceid, const float* u, const float* v,
+                              const float* uw1, const float* vw1, const float* uw2, const float* vw2,
+                              float width, float blur)
+        {
+            _filter->evalMany(result, firstchan, nchannels, n, faceid, u, v, uw1, vw1, uw2, vw2,
+                              width, blur);
+        }
+    private:
+        PtexFilter* _filter;
+    };
+
     class MetaData : public PtexMetaData {
     public:
 	MetaData(PtexReader* reader)
@@ -365,13 +423,21 @@ public:
     class FaceData : public PtexFaceData {
     public:
         FaceData(Res resArg)
-            : _res(resArg) {}
+            : _res(resArg), _uses(1) {}
         virtual ~FaceData() {}
         virtual void release() { }
         virtual Ptex::Res res() { return _res; }
         virtual FaceData* reduce(PtexReader*, Res newres, PtexUtils::ReduceFn, size_t& newMemUsed) = 0;
+        /// Memory accounted for this face (excluding any tiles)
+        virtual size_t memUsed() = 0;
+
+        // use count for clock replacement (see evictUnused)
+        // (saturates, and is only written below that to keep shared cache lines clean)
+        void markUsed() { PtexReader::markUsed(_uses); }
+        bool age(CachePolicy policy) { return PtexReader::age(_uses, policy); }
     protected:
         Res _res;
+        volatile uint8_t _uses;
     };
 
     class PackedFace : public FaceData {
@@ -390,14 +456,31 @@ public:
         virtual Ptex::Res tileRes() { return _res; }
         virtual PtexFaceData* getTile(int) { return 0; }
         virtual FaceData* reduce(PtexReader*, Res newres, PtexUtils::ReduceFn, size_t& newMemUsed);
+        virtual size_t memUsed() { return sizeof(*this) + _pixelsize * _res.size(); }
 
     protected:
+        PackedFace(Res resArg, int pixelsize, char* data)
+            : FaceData(resArg), _pixelsize(pixelsize), _data(data) {}
         virtual ~PackedFace() { delete [] _data; }
 
         int _pixelsize;
         char* _data;
     };
 
+    /// Face data used in place in the shared cache (pinned there until the face is freed)
+    class SharedFace : public PackedFace {
+    public:
+        SharedFace(Res resArg, int pixelsize, PtexSharedCache* cache, const void* data)
+            : PackedFace(resArg, pixelsize, (char*) data), _cache(cache) {}
+        // counted in full, so maxMem limits how much data this process keeps pinned
+        virtual size_t memUsed() { return sizeof(*this) + _pixelsize * _res.size(); }
+
+    protected:
+        virtual ~SharedFace();
+
+        PtexSharedCache* _cache;
+    };
+
     class ConstantFace : public PackedFace {
     public:
         ConstantFace(int pixelsize)
@@ -405,6 +488,7 @@ public:
         virtual bool isConstant() { return true; }
         virtual void getPixel(int, int, void* result) { memcpy(result, _data, _pixelsize); }
         virtual FaceData* reduce(PtexReader*, Res newres, PtexUtils::ReduceFn, size_t& newMemUsed);
+        virtual size_t memUsed() { return sizeof(*this) + _pixelsize; }
     };
 
     class ErrorFace : public ConstantFace {
@@ -416,6 +500,7 @@ public:
             memcpy(_data, errorPixel, pixelsize);
         }
         virtual void release() { if (_deleteOnRelease) delete this; }
+        virtual size_t memUsed() { return 0; } // not accounted for (and never evicted)
     };
 
     class TiledFaceBase : public FaceData {
@@ -446,6 +531,9 @@ public:
         int ntilesv() const { return _ntilesv; }
         int ntiles() const { return _ntiles; }
 
+        /// Free tiles not kept by the policy (or all tiles), returning the memory freed.
+        size_t evictTiles(CachePolicy policy, bool all=false);
+
     protected:
         size_t baseExtraMemUsed() { return _tiles.size() * sizeof(_tiles[0]); }
 
@@ -480,10 +568,11 @@ public:
         {
             FaceData*& f = _tiles[tile];
             if (!f) readTile(tile, f);
+            else f->markUsed();
             return f;
         }
         void readTile(int tile, FaceData*& data);
-        size_t memUsed() {
+        virtual size_t memUsed() {
             return sizeof(*this) + baseExtraMemUsed() + _fdh.size() * (sizeof(_fdh[0]) + sizeof(_offsets[0]));
         }
 
@@ -509,7 +598,7 @@ public:
         }
         virtual PtexFaceData* getTile(int tile);
 
-        size_t memUsed() { return sizeof(*this) + baseExtraMemUsed(); }
+        virtual size_t memUsed() { return sizeof(*this) + baseExtraMemUsed(); }
 
     protected:
         TiledFaceBase* _parentface;
@@ -543,6 +632,119 @@ public:
 
 
 protected:
+    /** Coordinates lazy loads of face, tile, level, and meta data
+        items.  Only one thread loads a given item; other threads
+        needing the same item wait for that load to finish while loads
+        of unrelated items proceed.  Items are identified by the
+        address of the slot the loaded data is published to.
+     */
+    class PendingLoads {
+    public:
+        PendingLoads() {}
+        ~PendingLoads();
+
+        /** Begin loading an item.  Returns true if the caller should
+            load the item and then call endLoad().  Returns false if
+            another thread was already loading the item, after waiting
+            for it to finish (unless wait is false). */
+        bool beginLoad(const void* item, bool wait=true);
+
+        /** Finish loading an item (after the result has been published). */
+        void endLoad(const void* item);
+
+    private:
+        struct Load {
+            const void* item;   // item being loaded
+            int waiters;        // number of threads waiting for load
+            bool done;          // true once load has finished
+            Mutex mutex;        // held by loading thread until load finishes
+        };
+        PendingLoads(const PendingLoads&);
+        void operator=(const PendingLoads&);
+        void freeLoad(Load* load) { load->item = 0; _free.push_back(load); }
+
+        SpinLock _lock;
+        std::vector<Load*> _loads;  // loads in flight
+        std::vector<Load*> _free;   // recycled load records
+    };
+
+    /** Scoped call to PendingLoads::beginLoad/endLoad. */
+    class AutoLoad {
+    public:
+        AutoLoad(PendingLoads& loads, const void* item)
+            : _loads(loads), _item(item), _loading(loads.beginLoad(item)) {}
+        ~AutoLoad() { if (_loading) _loads.endLoad(_item); }
+        bool loading() const { return _loading; }
+    private:
+        PendingLoads& _loads;
+        const void* _item;
+        bool _loading;
+    };
+
+    /** Loads the tiles of a face into a destination buffer, possibly
+        from several threads at once.  Each thread (the caller and any
+        worker tasks) claims tiles until none are left; the caller then
+        waits for tiles claimed by other threads to finish.  Reference
+        counted so that worker tasks that start late can still run
+        safely after the caller has returned.
+     */
+    class TileLoader {
+    public:
+        TileLoader(PtexFaceData* face, void* buffer, int stride, int pixelsize);
+
+        int ntiles() const { return _ntiles; }
+        void ref() { AtomicIncrement(&_refCount); }
+        void unref() { if (0 == AtomicDecrement(&_refCount)) delete this; }
+
+        /// Load and copy the next unclaimed tile.  Returns false if none are left.
+        bool loadNext();
+        /// Wait until all tiles have been copied.
+        void wait();
+        /// Create a worker task that loads tiles (holds a reference to the loader).
+        PtexThreadPool::Task* newTask() { ref(); return new Task(this); }
+
+    private:
+        class Task : public PtexThreadPool::Task {
+            TileLoader* _loader;
+        public:
+            Task(TileLoader* loader) : _loader(loader) {}
+            virtual void run() { while (_loader->loadNext()) {} _loader->unref(); }
+        };
+
+        ~TileLoader() {}
+        TileLoader(const TileLoader&);
+        void operator=(const TileLoader&);
+
+        PtexFaceData* _face;
+        char* _buffer;
+        int _stride;
+        int _pixelsize;
+        Res _tileres;
+        int _ntilesu;
+        int _ntiles;
+        volatile int32_t _refCount;
+        volatile int32_t _next;     // next tile to claim
+        int _done;                  // number of tiles copied (guarded by _monitor)
+        Monitor _monitor;
+    };
+
+    /** Submit up to maxTasks tile loading tasks to worker threads.
+        Returns the number submitted; zero if parallel tile loading
+        isn't enabled (the caller loads all the tiles itself). */
+    virtual int submitTileTasks(TileLoader* /*loader*/, int /*maxTasks*/) { return 0; }
+
+    /** Cache of compressed face data blocks to consult before reading
+        the file, or null if there is none (see PtexCache::setBlockCacheSize). */
+    virtual PtexBlockCache* blockCache() { return 0; }
+
+    /** Cache of decoded face data shared with other processes, or null
+        if there is none (see PtexCache::setSharedCache). */
+    virtual PtexSharedCache* sharedCache() { return 0; }
+
+    /** Persistent cache of decoded face data on local disk, or null if
+        there is none (see PtexCache::setDiskCache). */
+    virtual PtexDiskCache* diskCache() { return 0; }
+
     void setError(const char* error)
     {
         std::string msg = error;
@@ -560,15 +762,27 @@ protected:
         if (!_fp && !reopenFP()) return;
         logBlockRead();
         if (pos != _pos) {
-            _io->seek(_fp, pos);
+            // positional reads are addressed directly by _pos
+            if (!_positional) _io->seek(_fp, pos);
             _pos = pos;
         }
     }
 
     void closeFP();
     bool reopenFP();
+    void updateMapping();
+    void readPrefix(FilePos end, bool speculative);
+    bool acquireFP();
+    void releaseFP() { AtomicDecrement(&_ioRefs); }
+    bool readRaw(void* data, int size, FilePos pos, bool reportError);
+    bool inflateRaw(void* data, int zipsize, int unzipsize, FilePos pos);
     bool readBlock(void* data, int size, bool reportError=true);
     bool readZipBlock(void* data, int zipsize, int unzipsize);
+    bool readBlockAt(FilePos pos, void* data, int size);
+    bool readZipBlockAt(FilePos pos, void* data, int zipsize, int unzipsize);
+    bool readFaceBlockAt(FilePos pos, void* data, int zipsize, int unzipsize);
+    bool inflateBuffer(void* data, const char* zipdata, int zipsize, int unzipsize);
+    bool inflateStream(void* data, int zipsize, int unzipsize, FilePos pos, void* buff, int size);
     Level* getLevel(int levelid)
     {
         Level*& level = _levels[levelid];
@@ -581,6 +795,7 @@ protected:
     {
         FaceData*& face = level->faces[faceid];
         if (!face) readFace(levelid, level, faceid, res);
+        else face->markUsed();
         return face;
     }
 
@@ -590,12 +805,24 @@ protected:
     void readLevel(int levelid, Level*& level);
     void readFace(int levelid, Level* level, int faceid, Res res);
     void readFaceData(FilePos pos, FaceDataHeader fdh, Res res, int levelid, FaceData*& face);
+    void unpackFaceData(char* data, FaceDataHeader fdh, Res res, int levelid, PackedFace* face);
+    FaceData* sharedFace(FilePos pos, Res res, int size, bool countHit);
+    bool readCachedFace(FilePos pos, void* data, int size);
+    bool hasCachedFace(FilePos pos, int size);
+    void cacheFace(FilePos pos, const void* data, int size);
+    void readFaceBatch(int nfaces, const int* faceids, const Res* res);
     void readMetaData();
     void readMetaDataBlock(MetaData* metadata, FilePos pos, int zipsize, int memsize, size_t& metaDataMemUsed);
     void readLargeMetaDataHeaders(MetaData* metadata, FilePos pos, int zipsize, int memsize, size_t& metaDataMemUsed);
     void readEditData();
     void readEditFaceData();
     void readEditMetaData();
+    bool indexKey(IndexHeader& ih);
+    uint64_t fileKey();
+    std::string indexPath();
+    bool readIndex();
+    bool readIndexLevel(int levelid, Level* level);
+    void writeIndex();
 
     FaceData* errorData(bool deleteOnRelease=false)
     {
@@ -611,30 +838,43 @@ protected:
     class DefaultInputHandler : public PtexInputHandler
     {
         char* buffer;
+        const char* _mapdata;
+        int64_t _mapsize;
+#ifdef PTEX_PLATFORM_WINDOWS
+        HANDLE _maphandle;
+        Mutex _readAtLock;
+#endif
      public:
-        DefaultInputHandler() : buffer(0) {}
-        virtual Handle open(const char* path) {
-            FILE* fp = fopen(path, "rb");
-            if (fp) {
-                buffer = new char [IBuffSize];
-                setvbuf(fp, buffer, _IOFBF, IBuffSize);
-            }
-            else buffer = 0;
-            return (Handle) fp;
-        }
+        DefaultInputHandler() : buffer(0), _mapdata(0), _mapsize(0)
+#ifdef PTEX_PLATFORM_WINDOWS
+            , _maphandle(0)
+#endif
+        {}
+        virtual Handle open(const char* path);
         virtual void seek(Handle handle, int64_t pos) { fseeko((FILE*)handle, pos, SEEK_SET); }
         virtual size_t read(void* bufferArg, size_t size, Handle handle) {
             return fread(bufferArg, size, 1, (FILE*)handle) == 1 ? size : 0;
         }
-        virtual bool close(Handle handle) {
-            bool ok = handle && (fclose((FILE*)handle) == 0);
-            if (buffer) { delete [] buffer; buffer = 0; }
-            return ok;
-        }
+        virtual bool close(Handle handle);
         virtual const char* lastError() { return strerror(errno); }
+        virtual size_t readAt(void* bufferArg, size_t size, int64_t pos, Handle handle);
+        virtual bool supportsReadAt() { return true; }
+
+        /** Memory mapping of the open file (or null if the file couldn't be mapped).
+            The mapping remains valid until the handle is closed. */
+        const char* mapping(int64_t& size) const { size = _mapsize; return _mapdata; }
+
+        /** Size, modification time (in nanoseconds), and optionally file id
+            (inode) of an open file. */
+        static bool fileInfo(Handle handle, int64_t& size, int64_t& mtime, int64_t* fileid = 0);
+
+     private:
+        bool map(FILE* fp);
+        void unmap();
     };
 
     Mutex readlock;
+    PendingLoads _pendingLoads;       // face/level loads in flight
     DefaultInputHandler _defaultIo;   // Default IO handler
     PtexInputHandler* _io;            // IO handler
     PtexErrorHandler* _err;           // Error handler
@@ -642,8 +882,21 @@ protected:
     bool _ok;                         // flag set to false if open or read error occurred
     bool _needToOpen;                 // true if file needs to be opened (or reopened after a purge)
     bool _pendingPurge;               // true if a purge attempt was made but file was busy
+    bool _positional;                 // true if io handler supports concurrent positional reads
+    volatile int32_t _ioRefs;         // number of positional reads in flight (-1 while closing)
     PtexInputHandler::Handle _fp;     // file pointer
     FilePos _pos;                     // current seek position
+    const char* _mapdata;             // memory mapped file data (default io only)
+    FilePos _mapsize;                 // size of mapped file data
+    std::vector<char> _prefix;        // start of file (only held during open)
+    std::string _indexCachePath;      // dir for cached file info (empty if not used)
+    FilePos _openReadSize;            // size of speculative read at open (see PtexCache::setOpenReadSize)
+    DefaultInputHandler _indexIo;     // IO handler for cached file info
+    PtexInputHandler::Handle _indexFp; // cached file info (if valid)
+    std::vector<FilePos> _indexLevelPos; // position of level headers in cached file info
+    uint64_t _fileKey;                // identity of file in shared and disk caches (zero if not used)
+    int64_t _fileSize;                // size and modification time of file (checked by disk cache)
+    int64_t _fileTime;
     std::string _path;                // current file path
     Header _header;                   // the header
     ExtHeader _extheader;             // extended header
@@ -658,6 +911,17 @@ protected:
     int _pixelsize;                   // size of a pixel in bytes
     uint8_t* _constdata;              // constant pixel value per face
     MetaData* _metadata;              // meta data (read on demand)
+
+    struct CachedFilter {
+        PtexFilter::Options opts;
+        SharedFilter* filter;
+    };
+    enum { MaxCachedFilters = 8 };
+    CachedFilter _filters[MaxCachedFilters]; // filters shared by all users (see getCachedFilter)
+    volatile int32_t _numFilters;     // number of cached filters (only grows until a purge)
+    Mutex _filterlock;                // held while adding a cached filter
+    std::vector<SharedFilter*> _retiredFilters; // cached filters from before the last purge
+    static size_t cachedFilterMemUsed(); // memory counted for each cached or retired filter
     bool _hasEdits;                   // has edit blocks
 
     std::vector<FaceInfo> _faceinfo;   // per-face header info
@@ -711,9 +975,13 @@ protected:
     };
     typedef PtexHashMap<ReductionKey, FaceData*> ReductionMap;
     ReductionMap _reductions;
+    volatile uint8_t _reductionUses;  // use count of reductions (see evictUnused)
     std::vector<char> _errorPixel; // referenced by errorData()
 
-    z_stream_s _zstream;
+    // clock hand of evictUnused (level and face next to be visited)
+    int _evictLevel;
+    int _evictFace;
+
     size_t _baseMemUsed;
     volatile size_t _memUsed;
     volatile size_t _opens;
@@ -0,0 +1,237 @@
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#include "PtexPlatform.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef PTEX_USE_SIMD
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#include "Ptexture.h"
+#include "PtexSIMD.h"
+
+PTEX_NAMESPACE_BEGIN
+
+namespace {
+#ifdef PTEX_USE_SIMD
+    // regs = eax, ebx, ecx, edx
+    void cpuid(unsigned int leaf, unsigned int regs[4])
+    {
+#ifdef _MSC_VER
+        int r[4];
+        __cpuidex(r, int(leaf), 0);
+        for (int i = 0; i < 4; i++) regs[i] = (unsigned int)r[i];
+#else
+        __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    // state components the os saves on context switches
+    unsigned int xgetbv0()
+    {
+#ifdef _MSC_VER
+        return (unsigned int)_xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ __volatile__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return eax;
+#endif
+    }
+#endif
+
+    SimdLevel detectLevel()
+    {
+#ifdef PTEX_USE_SIMD
+        unsigned int regs[4];
+        cpuid(0, regs);
+        unsigned int maxLeaf = regs[0];
+        if (maxLeaf < 1) return simd_none;
+
+        cpuid(1, regs);
+        bool sse41 = (regs[2] >> 19) & 1;
+        bool osxsave = (regs[2] >> 27) & 1;
+        bool avx = (regs[2] >> 28) & 1;
+        bool f16c = (regs[2] >> 29) & 1;
+        if (!sse41) return simd_none;
+
+        // avx2 also requires the os to save the ymm registers
+        if (maxLeaf < 7 || !osxsave || !avx || !f16c || (xgetbv0() & 6) != 6)
+            return simd_sse41;
+        cpuid(7, regs);
+        bool avx2 = (regs[1] >> 5) & 1;
+        return avx2 ? simd_avx2 : simd_sse41;
+#else
+        return simd_none;
+#endif
+    }
+
+    SimdLevel initialLevel(SimdLevel maxLevel)
+    {
+        // can be overridden with $PTEX_SIMD (set to a level name)
+        const char* name = getenv("PTEX_SIMD");
+        if (name) {
+            for (int i = 0; i <= maxLevel; i++) {
+                if (strcmp(name, SimdLevelName(SimdLevel(i))) == 0)
+                    return SimdLevel(i);
+            }
+        }
+        return maxLevel;
+    }
+
+    // note: the level is simd_none until initialized
+    const SimdLevel maxLevel = detectLevel();
+    volatile SimdLevel currentLevel = initialLevel(maxLevel);
+}
+
+
+bool SetSimdLevel(SimdLevel level)
+{
+    if (level < simd_none || level > maxLevel) return false;
+    currentLevel = level;
+    return true;
+}
+
+
+SimdLevel GetSimdLevel()
+{
+    return currentLevel;
+}
+
+
+namespace PtexSIMD {
+
+const Kernels* kernels()
+{
+#ifdef PTEX_USE_SIMD
+    switch (currentLevel) {
+    case simd_avx2:  return &avx2Kernels;
+    case simd_sse41: return &sse41Kernels;
+    case simd_none:  break;
+    }
+#endif
+    return 0;
+}
+
+
+namespace {
+    int sizeIndex(int elemsize) { return elemsize == 1 ? 0 : elemsize == 2 ? 1 : 2; }
+}
+
+
+InterleaveFn* interleaveFn(int elemsize, int nchan)
+{
+    const Kernels* k = kernels();
+    if (!k || nchan < 3 || nchan > 4) return 0;
+    return k->interleave[sizeIndex(elemsize)][nchan-3];
+}
+
+
+DeinterleaveFn* deinterleaveFn(int elemsize, int nchan)
+{
+    const Kernels* k = kernels();
+    if (!k || nchan < 3 || nchan > 4) return 0;
+    return k->deinterleave[sizeIndex(elemsize)][nchan-3];
+}
+
+
+DifferenceFn* encodeDifferenceFn(int elemsize)
+{
+    const Kernels* k = kernels();
+    if (!k || elemsize > 2) return 0;
+    return k->encodeDifference[sizeIndex(elemsize)];
+}
+
+
+DifferenceFn* decodeDifferenceFn(int elemsize)
+{
+    const Kernels* k = kernels();
+    if (!k || elemsize > 2) return 0;
+    return k->decodeDifference[sizeIndex(elemsize)];
+}
+
+
+ReduceFn* reduceFn(ReduceMode mode, int dt, int nchan)
+{
+    const Kernels* k = kernels();
+    if (!k || dt < 0 || dt > 3 || (nchan > 4 && mode != reduce_v)) return 0;
+    return k->reduce[mode][dt];
+}
+
+
+HalfToFloatFn* halfToFloatFn()
+{
+    const Kernels* k = kernels();
+    return k ? k->halfToFloat : 0;
+}
+
+
+FloatToHalfFn* floatToHalfFn()
+{
+    const Kernels* k = kernels();
+    return k ? k->floatToHalf : 0;
+}
+
+
+ToFloatFn* toFloatFn(int dt)
+{
+    const Kernels* k = kernels();
+    if (!k || dt < 0 || dt > 1) return 0;
+    return k->toFloat[dt];
+}
+
+
+FromFloatFn* fromFloatFn(int dt)
+{
+    const Kernels* k = kernels();
+    if (!k || dt < 0 || dt > 1) return 0;
+    return k->fromFloat[dt];
+}
+
+
+SeparableApplyFn* separableApplyFn(int dt, int nChan, int nTxChan)
+{
+    const Kernels* k = kernels();
+    if (!k || dt < 0 || dt > 3 || nChan < 1 || nChan > 4 || nTxChan > 4) return 0;
+    return k->separableApply[nChan-1][dt];
+}
+
+} // namespace PtexSIMD
+
+PTEX_NAMESPACE_END
@@ -0,0 +1,249 @@
+#ifndef PtexSIMD_h
+#define PtexSIMD_h
+
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+/**
+  @file PtexSIMD.h
+  @brief SIMD kernels selected at runtime based on cpu support.
+
+  The kernels for each instruction set live in their own source file
+  (PtexSSE41.cpp, PtexAVX2.cpp) which is compiled with the flags needed
+  for that instruction set.  Nothing in those files may run unless the
+  cpu supports it, so they only define kernels (in an anonymous
+  namespace, so that no inline function compiled for the instruction set
+  can be shared with other files) and a table of pointers to them.
+*/
+
+#include <string.h>
+#include "PtexExports.h"
+#include "PtexInt.h"
+#include "PtexVersion.h"
+
+PTEX_NAMESPACE_BEGIN
+
+namespace PtexSIMD {
+
+/** Interleave n elements from each of nchan planes (planestride bytes
+    apart) into n pixels at dst. */
+typedef void InterleaveFn(const void* src, int planestride, void* dst, int n);
+
+/** Deinterleave n pixels from src into n elements in each of nchan
+    planes (planestride bytes apart) at dst. */
+typedef void DeinterleaveFn(const void* src, void* dst, int planestride, int n);
+
+/** Replace each element of data (size bytes) with its difference from
+    the previous element, or undo the difference (a running sum). */
+typedef void DifferenceFn(void* data, int size);
+
+/** Convert n uint8 or uint16 values to float, same as ConvertToFloat. */
+typedef void ToFloatFn(float* dst, const void* src, int n);
+
+/** Convert n floats to uint8 or uint16 values, same as ConvertFromFloat. */
+typedef void FromFloatFn(void* dst, const float* src, int n);
+
+/** Apply a separable filter kernel, same as PtexSeparableKernel::apply.
+    data is the first texel of the kernel, rows are rowlen elements apart,
+    and nothing at or after end may be read. */
+typedef void SeparableApplyFn(float* result, const void* data, const void* end, int rowlen,
+                              int nTxChan, int nChan, int uw, int vw,
+                              const float* ku, const float* kv);
+
+/** Mipmap reduction of a face, same as PtexUtils::reduce etc. */
+typedef void ReduceFn(const void* src, int sstride, int uw, int vw,
+                      void* dst, int dstride, int nchan);
+
+/** Convert n halves (as bits) to floats, same as PtexHalf::toFloat. */
+typedef void HalfToFloatFn(float* dst, const uint16_t* src, int n);
+
+/** Convert n floats to halves (as bits), same as PtexHalf::fromFloat. */
+typedef void FloatToHalfFn(uint16_t* dst, const float* src, int n);
+
+/** Mipmap reductions, in the order of Kernels::reduce. */
+enum ReduceMode { reduce_uv, reduce_u, reduce_v, reduce_tri };
+
+/** Kernels for one instruction set.  Null entries aren't supported. */
+struct Kernels {
+    InterleaveFn* interleave[3][2];     ///< [log2 element size][nchan-3]
+    DeinterleaveFn* deinterleave[3][2]; ///< [log2 element size][nchan-3]
+    DifferenceFn* encodeDifference[2];  ///< [log2 element size]
+    DifferenceFn* decodeDifference[2];  ///< [log2 element size]
+    ReduceFn* reduce[4][4];             ///< [ReduceMode][DataType]
+    HalfToFloatFn* halfToFloat;
+    FloatToHalfFn* floatToHalf;
+    ToFloatFn* toFloat[2];              ///< [DataType] (uint8, uint16)
+    FromFloatFn* fromFloat[2];          ///< [DataType] (uint8, uint16)
+    SeparableApplyFn* separableApply[4][4]; ///< [nChan-1][DataType]
+};
+
+#ifdef PTEX_USE_SIMD
+extern const Kernels sse41Kernels;
+extern const Kernels avx2Kernels;
+#endif
+
+/** Kernels for the current simd level (null for simd_none). */
+const Kernels* kernels();
+
+/** Interleave kernel for the current simd level, or null if none. */
+InterleaveFn* interleaveFn(int elemsize, int nchan);
+
+/** Deinterleave kernel for the current simd level, or null if none. */
+DeinterleaveFn* deinterleaveFn(int elemsize, int nchan);
+
+/** Difference encoding kernel for the current simd level, or null if none. */
+DifferenceFn* encodeDifferenceFn(int elemsize);
+
+/** Difference decoding kernel for the current simd level, or null if none. */
+DifferenceFn* decodeDifferenceFn(int elemsize);
+
+/** Reduction kernel for the current simd level, or null if none.
+    Only reduce_v supports more than 4 channels. */
+ReduceFn* reduceFn(ReduceMode mode, int dt, int nchan);
+
+/** Half to float kernel for the current simd level, or null if none. */
+HalfToFloatFn* halfToFloatFn();
+
+/** Float to half kernel for the current simd level, or null if none. */
+FloatToHalfFn* floatToHalfFn();
+
+/** Integer to float kernel for the current simd level, or null if none. */
+ToFloatFn* toFloatFn(int dt);
+
+/** Float to integer kernel for the current simd level, or null if none. */
+FromFloatFn* fromFloatFn(int dt);
+
+/** Separable filter kernel for the current simd level, or null if none.
+    Up to 4 channels of pixels with up to 4 channels are supported. */
+SeparableApplyFn* separableApplyFn(int dt, int nChan, int nTxChan);
+
+/* Byte shuffle masks (for pshufb) shared by all instruction sets.  Each
+   gives the source byte for byte j of a 16 byte output vector, or -128
+   to zero it.  Elements are s bytes. */
+
+/// Channel c of 3-channel pixels, from input vector k of 3.
+static inline char deinterleave3Byte(int s, int c, int k, int j)
+{
+    int q = ((j / s) * 3 + c) * s + j % s;
+    return char(q / 16 == k ? q % 16 : -128);
+}
+
+/// Output vector k of 3 of 3-channel pixels, from channel c.
+static inline char interleave3Byte(int s, int c, int k, int j)
+{
+    int q = k * 16 + j, p = q / (3 * s), ch = (q / s) % 3;
+    return char(ch == c ? p * s + q % s : -128);
+}
+
+/// 4-channel pixels to channel-major 4 byte groups.
+static inline char group4Byte(int s, int j)
+{
+    int c = j / 4, i = j % 4;
+    return char(((i / s) * 4 + c) * s + i % s);
+}
+
+/// Channel-major 4 byte groups to 4-channel pixels (inverse of group4Byte).
+static inline char ungroup4Byte(int s, int j)
+{
+    int e = j / (4 * s), c = (j / s) % 4;
+    return char(c * 4 + e * s + j % s);
+}
+
+/// Even pixels of p (1, 2 or 4) bytes to the low 8 bytes, odd pixels to the high 8 bytes.
+static inline char splitPixelsByte(int p, int j)
+{
+    int h = j / 8, r = j % 8;
+    return char((2 * (r / p) + h) * p + r % p);
+}
+
+/// Last element of a vector, repeated.
+static inline char lastElemByte(int s, int j)
+{
+    return char(16 - s + j % s);
+}
+
+/* Scalar loops for the elements left over after the last full vector. */
+
+template<int s, int nchan>
+static inline void interleaveTail(const char* src, int planestride, char* dst, int i, int n)
+{
+    for (; i < n; i++)
+        for (int c = 0; c < nchan; c++)
+            memcpy(dst + (i * nchan + c) * s, src + c * planestride + i * s, s);
+}
+
+template<int s, int nchan>
+static inline void deinterleaveTail(const char* src, char* dst, int planestride, int i, int n)
+{
+    for (; i < n; i++)
+        for (int c = 0; c < nchan; c++)
+            memcpy(dst + c * planestride + i * s, src + (i * nchan + c) * s, s);
+}
+
+template<typename T>
+static inline void encodeDifferenceTail(T* p, T* end, T prev)
+{
+    for (T tmp; p != end; p++) { tmp = prev; prev = *p; *p = T(*p - tmp); }
+}
+
+template<typename T>
+static inline void decodeDifferenceTail(T* p, T* end, T prev)
+{
+    for (; p != end; p++) { *p = T(*p + prev); prev = *p; }
+}
+
+template<typename T>
+static inline void toFloatTail(float* dst, const T* src, int i, int n)
+{
+    const float scale = sizeof(T) == 1 ? 1.f/255.f : 1.f/65535.f;
+    for (; i < n; i++) dst[i] = float(src[i]) * scale;
+}
+
+template<typename T>
+static inline void fromFloatTail(T* dst, const float* src, int i, int n)
+{
+    // clamped to [0,1] in the same way as PtexUtils::clamp (nans become 0)
+    const float scale = sizeof(T) == 1 ? 255.0f : 65535.0f;
+    for (; i < n; i++) {
+        float f = src[i] > 0.0f ? src[i] : 0.0f;
+        f = f < 1.0f ? f : 1.0f;
+        dst[i] = T(f * scale + 0.5f);
+    }
+}
+
+} // namespace PtexSIMD
+
+PTEX_NAMESPACE_END
+
+#endif
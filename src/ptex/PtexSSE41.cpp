@@ -0,0 +1,622 @@
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+/**
+  @file PtexSSE41.cpp
+  @brief SSE4.1 kernels (see PtexSIMD.h).  Compiled with SSE4.1 enabled.
+*/
+
+#include <smmintrin.h>
+#include "PtexSIMD.h"
+
+PTEX_NAMESPACE_BEGIN
+
+namespace {
+    using namespace PtexSIMD;
+
+    template<int s>
+    inline __m128i interleave3Mask(int c, int k)
+    {
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = interleave3Byte(s, c, k, j);
+        return _mm_loadu_si128((const __m128i*) m);
+    }
+
+    template<int s>
+    inline __m128i deinterleave3Mask(int c, int k)
+    {
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = deinterleave3Byte(s, c, k, j);
+        return _mm_loadu_si128((const __m128i*) m);
+    }
+
+    template<int s>
+    inline __m128i group4Mask(bool group)
+    {
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = group ? group4Byte(s, j) : ungroup4Byte(s, j);
+        return _mm_loadu_si128((const __m128i*) m);
+    }
+
+    // transpose a 4x4 matrix of 32-bit values
+    inline void transpose4(__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+    {
+        __m128i x0 = _mm_unpacklo_epi32(a, b), x1 = _mm_unpackhi_epi32(a, b);
+        __m128i x2 = _mm_unpacklo_epi32(c, d), x3 = _mm_unpackhi_epi32(c, d);
+        a = _mm_unpacklo_epi64(x0, x2);
+        b = _mm_unpackhi_epi64(x0, x2);
+        c = _mm_unpacklo_epi64(x1, x3);
+        d = _mm_unpackhi_epi64(x1, x3);
+    }
+
+    // shuffle masks for interleave3, [output vector][channel]
+    template<int s>
+    struct Interleave3Masks {
+        __m128i m[3][3];
+        Interleave3Masks()
+        {
+            for (int k = 0; k < 3; k++)
+                for (int c = 0; c < 3; c++) m[k][c] = interleave3Mask<s>(c, k);
+        }
+    };
+
+    template<int s>
+    void interleave3(const Interleave3Masks<s>& masks, const void* srcArg, int planestride, void* dstArg, int n)
+    {
+        const char* src = (const char*) srcArg;
+        char* dst = (char*) dstArg;
+        const __m128i (&m)[3][3] = masks.m;
+
+        // 16 bytes from each channel make 48 bytes of pixels
+        int i = 0;
+        for (const int block = 16 / s; i + block <= n; i += block) {
+            const char* sp = src + i * s;
+            __m128i c0 = _mm_loadu_si128((const __m128i*) sp);
+            __m128i c1 = _mm_loadu_si128((const __m128i*) (sp + planestride));
+            __m128i c2 = _mm_loadu_si128((const __m128i*) (sp + 2 * planestride));
+            char* dp = dst + i * 3 * s;
+            for (int k = 0; k < 3; k++) {
+                __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(c0, m[k][0]),
+                                                      _mm_shuffle_epi8(c1, m[k][1])),
+                                         _mm_shuffle_epi8(c2, m[k][2]));
+                _mm_storeu_si128((__m128i*) (dp + k * 16), v);
+            }
+        }
+        interleaveTail<s, 3>(src, planestride, dst, i, n);
+    }
+
+    template<int s>
+    void interleave3(const void* src, int planestride, void* dst, int n)
+    {
+        interleave3(Interleave3Masks<s>(), src, planestride, dst, n);
+    }
+
+    // shuffle masks for deinterleave3, [channel][input vector]
+    template<int s>
+    struct Deinterleave3Masks {
+        __m128i m[3][3];
+        Deinterleave3Masks()
+        {
+            for (int c = 0; c < 3; c++)
+                for (int k = 0; k < 3; k++) m[c][k] = deinterleave3Mask<s>(c, k);
+        }
+    };
+
+    template<int s>
+    void deinterleave3(const Deinterleave3Masks<s>& masks, const void* srcArg, void* dstArg, int planestride, int n)
+    {
+        const char* src = (const char*) srcArg;
+        char* dst = (char*) dstArg;
+        const __m128i (&m)[3][3] = masks.m;
+
+        // 48 bytes of pixels make 16 bytes for each channel
+        int i = 0;
+        for (const int block = 16 / s; i + block <= n; i += block) {
+            const char* sp = src + i * 3 * s;
+            __m128i v0 = _mm_loadu_si128((const __m128i*) sp);
+            __m128i v1 = _mm_loadu_si128((const __m128i*) (sp + 16));
+            __m128i v2 = _mm_loadu_si128((const __m128i*) (sp + 32));
+            char* dp = dst + i * s;
+            for (int c = 0; c < 3; c++) {
+                __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, m[c][0]),
+                                                      _mm_shuffle_epi8(v1, m[c][1])),
+                                         _mm_shuffle_epi8(v2, m[c][2]));
+                _mm_storeu_si128((__m128i*) (dp + c * planestride), v);
+            }
+        }
+        deinterleaveTail<s, 3>(src, dst, planestride, i, n);
+    }
+
+    template<int s>
+    void deinterleave3(const void* src, void* dst, int planestride, int n)
+    {
+        deinterleave3(Deinterleave3Masks<s>(), src, dst, planestride, n);
+    }
+
+    template<int s>
+    void interleave4(const void* srcArg, int planestride, void* dstArg, int n)
+    {
+        const char* src = (const char*) srcArg;
+        char* dst = (char*) dstArg;
+        const __m128i m = group4Mask<s>(false);
+
+        // transpose 4 byte groups of each channel, then
+        // interleave the channels within each group
+        int i = 0;
+        for (const int block = 16 / s; i + block <= n; i += block) {
+            const char* sp = src + i * s;
+            __m128i v0 = _mm_loadu_si128((const __m128i*) sp);
+            __m128i v1 = _mm_loadu_si128((const __m128i*) (sp + planestride));
+            __m128i v2 = _mm_loadu_si128((const __m128i*) (sp + 2 * planestride));
+            __m128i v3 = _mm_loadu_si128((const __m128i*) (sp + 3 * planestride));
+            transpose4(v0, v1, v2, v3);
+            if (s != 4) {
+                v0 = _mm_shuffle_epi8(v0, m);
+                v1 = _mm_shuffle_epi8(v1, m);
+                v2 = _mm_shuffle_epi8(v2, m);
+                v3 = _mm_shuffle_epi8(v3, m);
+            }
+            char* dp = dst + i * 4 * s;
+            _mm_storeu_si128((__m128i*) dp, v0);
+            _mm_storeu_si128((__m128i*) (dp + 16), v1);
+            _mm_storeu_si128((__m128i*) (dp + 32), v2);
+            _mm_storeu_si128((__m128i*) (dp + 48), v3);
+        }
+        interleaveTail<s, 4>(src, planestride, dst, i, n);
+    }
+
+    template<int s>
+    void deinterleave4(const void* srcArg, void* dstArg, int planestride, int n)
+    {
+        const char* src = (const char*) srcArg;
+        char* dst = (char*) dstArg;
+        const __m128i m = group4Mask<s>(true);
+
+        // group the channels within each 16 bytes, then transpose the groups
+        int i = 0;
+        for (const int block = 16 / s; i + block <= n; i += block) {
+            const char* sp = src + i * 4 * s;
+            __m128i v0 = _mm_loadu_si128((const __m128i*) sp);
+            __m128i v1 = _mm_loadu_si128((const __m128i*) (sp + 16));
+            __m128i v2 = _mm_loadu_si128((const __m128i*) (sp + 32));
+            __m128i v3 = _mm_loadu_si128((const __m128i*) (sp + 48));
+            if (s != 4) {
+                v0 = _mm_shuffle_epi8(v0, m);
+                v1 = _mm_shuffle_epi8(v1, m);
+                v2 = _mm_shuffle_epi8(v2, m);
+                v3 = _mm_shuffle_epi8(v3, m);
+            }
+            transpose4(v0, v1, v2, v3);
+            char* dp = dst + i * s;
+            _mm_storeu_si128((__m128i*) dp, v0);
+            _mm_storeu_si128((__m128i*) (dp + planestride), v1);
+            _mm_storeu_si128((__m128i*) (dp + 2 * planestride), v2);
+            _mm_storeu_si128((__m128i*) (dp + 3 * planestride), v3);
+        }
+        deinterleaveTail<s, 4>(src, dst, planestride, i, n);
+    }
+
+    template<int s> inline __m128i add(__m128i a, __m128i b)
+    { return s == 1 ? _mm_add_epi8(a, b) : _mm_add_epi16(a, b); }
+
+    template<int s> inline __m128i sub(__m128i a, __m128i b)
+    { return s == 1 ? _mm_sub_epi8(a, b) : _mm_sub_epi16(a, b); }
+
+    template<typename T>
+    void encodeDifference(void* data, int size)
+    {
+        const int s = sizeof(T), block = 16 / s;
+        T* p = (T*) data, * end = p + size / s;
+
+        // subtract each vector shifted up one element, with the last
+        // (original) element of the previous vector shifted in
+        __m128i prev = _mm_setzero_si128();
+        for (; end - p >= block; p += block) {
+            __m128i v = _mm_loadu_si128((const __m128i*) p);
+            _mm_storeu_si128((__m128i*) p, sub<s>(v, _mm_alignr_epi8(v, prev, 16 - s)));
+            prev = v;
+        }
+        T last[block];
+        _mm_storeu_si128((__m128i*) last, prev);
+        encodeDifferenceTail(p, end, last[block-1]);
+    }
+
+    template<typename T>
+    void decodeDifference(void* data, int size)
+    {
+        const int s = sizeof(T), block = 16 / s;
+        T* p = (T*) data, * end = p + size / s;
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = lastElemByte(s, j);
+        const __m128i lastMask = _mm_loadu_si128((const __m128i*) m);
+
+        // running sum within each vector by adding shifted copies (log2
+        // block steps), plus the last sum of the previous vector
+        __m128i carry = _mm_setzero_si128();
+        for (; end - p >= block; p += block) {
+            __m128i v = _mm_loadu_si128((const __m128i*) p);
+            v = add<s>(v, _mm_slli_si128(v, s));
+            v = add<s>(v, _mm_slli_si128(v, 2 * s));
+            v = add<s>(v, _mm_slli_si128(v, 4 * s));
+            if (s == 1) v = add<s>(v, _mm_slli_si128(v, 8));
+            v = add<s>(v, carry);
+            _mm_storeu_si128((__m128i*) p, v);
+            carry = _mm_shuffle_epi8(v, lastMask);
+        }
+        decodeDifferenceTail(p, end, p == (T*) data ? T(0) : p[-1]);
+    }
+
+    /* Mipmap reductions.  Each block of pixel pairs is split into its
+       even and odd pixels so that the averages are element-wise, using
+       the same arithmetic (and rounding) as the scalar code. */
+
+    // averages of 2 and 4 vectors, same as halve and quarter in PtexUtils
+    template<typename T> struct Avg {};
+
+    template<> struct Avg<uint8_t> {
+        static __m128i avg2(__m128i a, __m128i b)
+        {
+            // (a & b) + ((a ^ b) >> 1) doesn't overflow
+            __m128i h = _mm_and_si128(_mm_srli_epi16(_mm_xor_si128(a, b), 1), _mm_set1_epi8(0x7f));
+            return _mm_add_epi8(_mm_and_si128(a, b), h);
+        }
+        static __m128i avg4(__m128i a, __m128i b, __m128i c, __m128i d)
+        {
+            const __m128i z = _mm_setzero_si128();
+            __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, z), _mm_unpacklo_epi8(b, z)),
+                                       _mm_add_epi16(_mm_unpacklo_epi8(c, z), _mm_unpacklo_epi8(d, z)));
+            __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, z), _mm_unpackhi_epi8(b, z)),
+                                       _mm_add_epi16(_mm_unpackhi_epi8(c, z), _mm_unpackhi_epi8(d, z)));
+            return _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2));
+        }
+    };
+
+    template<> struct Avg<uint16_t> {
+        static __m128i avg2(__m128i a, __m128i b)
+        {
+            return _mm_add_epi16(_mm_and_si128(a, b), _mm_srli_epi16(_mm_xor_si128(a, b), 1));
+        }
+        static __m128i avg4(__m128i a, __m128i b, __m128i c, __m128i d)
+        {
+            const __m128i z = _mm_setzero_si128();
+            __m128i lo = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(a, z), _mm_unpacklo_epi16(b, z)),
+                                       _mm_add_epi32(_mm_unpacklo_epi16(c, z), _mm_unpacklo_epi16(d, z)));
+            __m128i hi = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(a, z), _mm_unpackhi_epi16(b, z)),
+                                       _mm_add_epi32(_mm_unpackhi_epi16(c, z), _mm_unpackhi_epi16(d, z)));
+            return _mm_packus_epi32(_mm_srli_epi32(lo, 2), _mm_srli_epi32(hi, 2));
+        }
+    };
+
+    template<> struct Avg<float> {
+        static __m128 avg2f(__m128 a, __m128 b)
+        {
+            return _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(a, b));
+        }
+        static __m128 avg4f(__m128 a, __m128 b, __m128 c, __m128 d)
+        {
+            // same order of additions as the scalar code
+            return _mm_mul_ps(_mm_set1_ps(0.25f), _mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d));
+        }
+        static __m128i avg2(__m128i a, __m128i b)
+        {
+            return _mm_castps_si128(avg2f(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+        }
+        static __m128i avg4(__m128i a, __m128i b, __m128i c, __m128i d)
+        {
+            return _mm_castps_si128(avg4f(_mm_castsi128_ps(a), _mm_castsi128_ps(b),
+                                          _mm_castsi128_ps(c), _mm_castsi128_ps(d)));
+        }
+    };
+
+    template<int P>
+    inline __m128i splitMask()
+    {
+        char m[16];
+        for (int j = 0; j < 16; j++) m[j] = P < 8 ? splitPixelsByte(P, j) : char(j);
+        return _mm_loadu_si128((const __m128i*) m);
+    }
+
+    // split 32 bytes of P byte pixels into the even and the odd pixels
+    template<int P>
+    inline void split(const char* src, __m128i m, __m128i& even, __m128i& odd)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*) src);
+        __m128i b = _mm_loadu_si128((const __m128i*) (src + 16));
+        if (P == 16) { even = a; odd = b; return; }
+        if (P < 8) { a = _mm_shuffle_epi8(a, m); b = _mm_shuffle_epi8(b, m); }
+        even = _mm_unpacklo_epi64(a, b);
+        odd = _mm_unpackhi_epi64(a, b);
+    }
+
+    // 16 output bytes from 32 bytes of pixel pairs in rows a (and b), and
+    // for reduce_tri, 16 bytes of pixels from the diagonal in g
+    template<typename T, int P, ReduceMode mode>
+    inline void reduceBlock(const char* a, const char* b, const char* g, char* dst, __m128i m)
+    {
+        __m128i e0, o0, e1, o1, r;
+        split<P>(a, m, e0, o0);
+        if (mode == reduce_u) r = Avg<T>::avg2(e0, o0);
+        else {
+            split<P>(b, m, e1, o1);
+            if (mode == reduce_tri) o1 = _mm_loadu_si128((const __m128i*) g);
+            r = Avg<T>::avg4(e0, o0, e1, o1);
+        }
+        _mm_storeu_si128((__m128i*) dst, r);
+    }
+
+    // n output bytes of a row
+    template<typename T, int P, ReduceMode mode>
+    void reduceRow(const char* a, const char* b, const char* g, char* dst, int n, __m128i m)
+    {
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            reduceBlock<T, P, mode>(a + 2 * i, b + 2 * i, g + i, dst + i, m);
+        if (i < n) {
+            // pad the last partial block
+            char ta[32] = { 0 }, tb[32] = { 0 }, tg[16] = { 0 }, td[16];
+            memcpy(ta, a + 2 * i, 2 * (n - i));
+            if (mode != reduce_u) memcpy(tb, b + 2 * i, 2 * (n - i));
+            if (mode == reduce_tri) memcpy(tg, g + i, n - i);
+            reduceBlock<T, P, mode>(ta, tb, tg, td, m);
+            memcpy(dst + i, td, n - i);
+        }
+    }
+
+    // gather the pixels that reduceTri takes from the other triangle for
+    // output row r, pixels x0 to x0+np (moving up two rows per pixel)
+    inline void gatherTri(const char* src, int sstride, int w, int P, int r, int x0, int np, char* g)
+    {
+        const char* p = src + (w - 1 - 2 * x0) * sstride + (w - 1 - 2 * r) * P;
+        for (int x = 0; x < np; x++, p -= 2 * sstride) memcpy(g + x * P, p, P);
+    }
+
+    // faces of P byte pixels (1, 2 or 4 channels)
+    template<typename T, int P, ReduceMode mode>
+    void reducePixels(const char* src, int sstride, int uw, int vw, char* dst, int dstride)
+    {
+        const __m128i m = splitMask<P>();
+        const int chunk = 64; // pixels gathered at a time for reduce_tri
+        char g[chunk * P];
+        int rows = mode == reduce_u ? vw : mode == reduce_tri ? uw / 2 : vw / 2;
+        int rowstep = mode == reduce_u ? sstride : 2 * sstride;
+        const char* s = src;
+        for (int r = 0; r < rows; r++, s += rowstep, dst += dstride) {
+            const char* s2 = mode == reduce_u ? s : s + sstride;
+            if (mode != reduce_tri) {
+                reduceRow<T, P, mode>(s, s2, g, dst, uw / 2 * P, m);
+                continue;
+            }
+            for (int x0 = 0; x0 < uw / 2; x0 += chunk) {
+                int np = uw / 2 - x0 < chunk ? uw / 2 - x0 : chunk;
+                gatherTri(src, sstride, uw, P, r, x0, np, g);
+                reduceRow<T, P, mode>(s + 2 * x0 * P, s2 + 2 * x0 * P, g, dst + x0 * P, np * P, m);
+            }
+        }
+    }
+
+    // faces of 3 channel pixels, reduced one channel at a time
+    template<typename T, ReduceMode mode>
+    void reducePlanes(const char* src, int sstride, int uw, int vw, char* dst, int dstride)
+    {
+        const int s = sizeof(T), P = 3 * s;
+        const __m128i m = splitMask<s>();
+        const Interleave3Masks<s> im;
+        const Deinterleave3Masks<s> dm;
+        const int chunk = 128; // output pixels at a time
+        const int astride = 2 * chunk * s, gstride = chunk * s;
+        char a[3 * astride], b[3 * astride], g[3 * gstride], pixels[chunk * P], d[3 * gstride];
+        int rows = mode == reduce_u ? vw : mode == reduce_tri ? uw / 2 : vw / 2;
+        int rowstep = mode == reduce_u ? sstride : 2 * sstride;
+        const char* sp = src;
+        for (int r = 0; r < rows; r++, sp += rowstep, dst += dstride) {
+            for (int x0 = 0; x0 < uw / 2; x0 += chunk) {
+                int np = uw / 2 - x0 < chunk ? uw / 2 - x0 : chunk;
+                deinterleave3(dm, sp + 2 * x0 * P, a, astride, 2 * np);
+                if (mode != reduce_u)
+                    deinterleave3(dm, sp + sstride + 2 * x0 * P, b, astride, 2 * np);
+                if (mode == reduce_tri) {
+                    gatherTri(src, sstride, uw, P, r, x0, np, pixels);
+                    deinterleave3(dm, pixels, g, gstride, np);
+                }
+                for (int c = 0; c < 3; c++)
+                    reduceRow<T, s, mode>(a + c * astride, b + c * astride, g + c * gstride,
+                                          d + c * gstride, np * s, m);
+                interleave3(im, d, gstride, dst + x0 * P, np);
+            }
+        }
+    }
+
+    // 3 channel float pixels, in the low 3 elements of a vector
+    inline __m128 load3(const char* p)
+    {
+        return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double*) p)),
+                             _mm_load_ss((const float*) p + 2));
+    }
+
+    inline void store3(char* p, __m128 v)
+    {
+        _mm_storel_pi((__m64*) p, v);
+        _mm_store_ss((float*) p + 2, _mm_movehl_ps(v, v));
+    }
+
+    // faces of 3 channel floats, a pixel at a time (the fourth element
+    // overlaps the next pixel, except at the end of a row)
+    template<ReduceMode mode>
+    void reduceFloat3(const char* src, int sstride, int uw, int vw, char* dst, int dstride)
+    {
+        const int P = 12, nx = uw / 2;
+        int rows = mode == reduce_u ? vw : mode == reduce_tri ? uw / 2 : vw / 2;
+        int rowstep = mode == reduce_u ? sstride : 2 * sstride;
+        const char* sp = src;
+        for (int r = 0; r < rows; r++, sp += rowstep, dst += dstride) {
+            const char* a = sp, * b = sp + sstride;
+            const char* g = src + (uw - 1) * sstride + (uw - 1 - 2 * r) * P;
+            char* d = dst;
+            for (int x = 0; x < nx; x++, a += 2 * P, b += 2 * P, g -= 2 * sstride, d += P) {
+                bool last = x == nx - 1;
+                __m128 a0 = _mm_loadu_ps((const float*) a);
+                __m128 a1 = last ? load3(a + P) : _mm_loadu_ps((const float*) (a + P));
+                __m128 v;
+                if (mode == reduce_u) v = Avg<float>::avg2f(a0, a1);
+                else {
+                    __m128 b0 = _mm_loadu_ps((const float*) b);
+                    __m128 b1 = mode == reduce_tri ? load3(g)
+                        : last ? load3(b + P) : _mm_loadu_ps((const float*) (b + P));
+                    v = Avg<float>::avg4f(a0, a1, b0, b1);
+                }
+                if (last) store3(d, v);
+                else _mm_storeu_ps((float*) d, v);
+            }
+        }
+    }
+
+    template<typename T, ReduceMode mode>
+    void reduce(const void* src, int sstride, int uw, int vw, void* dst, int dstride, int nchan)
+    {
+        const char* s = (const char*) src;
+        char* d = (char*) dst;
+        const int size = sizeof(T);
+        switch (nchan) {
+        case 1: reducePixels<T, size, mode>(s, sstride, uw, vw, d, dstride); break;
+        case 2: reducePixels<T, 2 * size, mode>(s, sstride, uw, vw, d, dstride); break;
+        case 3:
+            if (size == 4) reduceFloat3<mode>(s, sstride, uw, vw, d, dstride);
+            else reducePlanes<T, mode>(s, sstride, uw, vw, d, dstride);
+            break;
+        case 4: reducePixels<T, 4 * size, mode>(s, sstride, uw, vw, d, dstride); break;
+        }
+    }
+
+    template<typename T>
+    void reducev(const void* src, int sstride, int uw, int vw,
+                 void* dst, int dstride, int nchan)
+    {
+        // element-wise, whatever the number of channels
+        const char* s = (const char*) src;
+        char* d = (char*) dst;
+        int n = uw * nchan * int(sizeof(T));
+        for (int v = 0; v < vw / 2; v++, s += 2 * sstride, d += dstride) {
+            const char* a = s, * b = s + sstride;
+            int i = 0;
+            for (; i + 16 <= n; i += 16) {
+                __m128i r = Avg<T>::avg2(_mm_loadu_si128((const __m128i*) (a + i)),
+                                         _mm_loadu_si128((const __m128i*) (b + i)));
+                _mm_storeu_si128((__m128i*) (d + i), r);
+            }
+            if (i < n) {
+                char ta[16] = { 0 }, tb[16] = { 0 };
+                memcpy(ta, a + i, n - i);
+                memcpy(tb, b + i, n - i);
+                __m128i r = Avg<T>::avg2(_mm_loadu_si128((const __m128i*) ta),
+                                         _mm_loadu_si128((const __m128i*) tb));
+                _mm_storeu_si128((__m128i*) ta, r);
+                memcpy(d + i, ta, n - i);
+            }
+        }
+    }
+
+    /* Conversions of uint8 and uint16 data to and from float, with the
+       same arithmetic as ConvertToFloat and ConvertFromFloat. */
+
+    template<typename T>
+    void toFloat(float* dst, const void* srcArg, int n)
+    {
+        const T* src = (const T*) srcArg;
+        const int s = sizeof(T), block = 16 / s;
+        const __m128 scale = _mm_set1_ps(s == 1 ? 1.f/255.f : 1.f/65535.f);
+        int i = 0;
+        for (; i + block <= n; i += block) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+            for (int j = 0; j < block; j += 4, v = _mm_srli_si128(v, 4 * s)) {
+                __m128i w = s == 1 ? _mm_cvtepu8_epi32(v) : _mm_cvtepu16_epi32(v);
+                _mm_storeu_ps(dst + i + j, _mm_mul_ps(_mm_cvtepi32_ps(w), scale));
+            }
+        }
+        toFloatTail(dst, src, i, n);
+    }
+
+    // 4 floats clamped to [0,1] (max and min return the second operand
+    // for nans, like PtexUtils::clamp), scaled and rounded
+    inline __m128i fromFloat(const float* p, __m128 scale)
+    {
+        __m128 f = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(f, scale), _mm_set1_ps(0.5f)));
+    }
+
+    template<typename T>
+    void fromFloat(void* dstArg, const float* src, int n)
+    {
+        T* dst = (T*) dstArg;
+        const int s = sizeof(T), block = 16 / s;
+        const __m128 scale = _mm_set1_ps(s == 1 ? 255.0f : 65535.0f);
+        int i = 0;
+        for (; i + block <= n; i += block) {
+            const float* p = src + i;
+            __m128i r = _mm_packus_epi32(fromFloat(p, scale), fromFloat(p + 4, scale));
+            if (s == 1)
+                r = _mm_packus_epi16(r, _mm_packus_epi32(fromFloat(p + 8, scale), fromFloat(p + 12, scale)));
+            _mm_storeu_si128((__m128i*) (dst + i), r);
+        }
+        fromFloatTail(dst, src, i, n);
+    }
+}
+
+
+namespace PtexSIMD {
+
+const Kernels sse41Kernels = {
+    { { interleave3<1>, interleave4<1> },
+      { interleave3<2>, interleave4<2> },
+      { interleave3<4>, interleave4<4> } },
+    { { deinterleave3<1>, deinterleave4<1> },
+      { deinterleave3<2>, deinterleave4<2> },
+      { deinterleave3<4>, deinterleave4<4> } },
+    { encodeDifference<uint8_t>, encodeDifference<uint16_t> },
+    { decodeDifference<uint8_t>, decodeDifference<uint16_t> },
+    // no F16C for half data, where the scalar conversion tables are faster,
+    // and the compiler already vectorizes the scalar reducev for floats
+    { { reduce<uint8_t, reduce_uv>, reduce<uint16_t, reduce_uv>, 0, reduce<float, reduce_uv> },
+      { reduce<uint8_t, reduce_u>, reduce<uint16_t, reduce_u>, 0, reduce<float, reduce_u> },
+      { reducev<uint8_t>, reducev<uint16_t>, 0, 0 },
+      { reduce<uint8_t, reduce_tri>, reduce<uint16_t, reduce_tri>, 0, reduce<float, reduce_tri> } },
+    0, 0, // half conversions use the tables
+    { toFloat<uint8_t>, toFloat<uint16_t> },
+    { fromFloat<uint8_t>, fromFloat<uint16_t> },
+    { { 0 } } // no separable filter kernels
+};
+
+} // namespace PtexSIMD
+
+PTEX_NAMESPACE_END
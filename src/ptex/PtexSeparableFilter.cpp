@@ -44,6 +44,20 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 
 PTEX_NAMESPACE_BEGIN
 
+namespace {
+    // face data handle, released on scope exit unless held for a batch
+    struct FaceDataRef {
+        PtexFaceData* data;
+        bool owned;
+        FaceDataRef() : data(0), owned(true) {}
+        ~FaceDataRef() { if (data && owned) data->release(); }
+    };
+
+    // number of lookups grouped by face at a time in evalMany
+    const int BlockSize = 64;
+}
+
+
 void PtexSeparableFilter::eval(float* result, int firstChan, int nChannels,
                                int faceid, float u, float v,
                                float uw1, float vw1, float uw2, float vw2,
@@ -52,18 +66,92 @@ void PtexSeparableFilter::eval(float* result, int firstChan, int nChannels,
     // init
     if (!_tx || nChannels <= 0) return;
     if (faceid < 0 || faceid >= _tx->numFaces()) return;
-    _firstChanOffset = firstChan*DataSize(_dt);
-    _nchan = PtexUtils::min(nChannels, _ntxchan-firstChan);
+    Context ctx(firstChan*DataSize(_dt), PtexUtils::min(nChannels, _ntxchan-firstChan));
+
+    evalFace(ctx, result, faceid, u, v, uw1, vw1, uw2, vw2, width, blur);
+}
+
+
+void PtexSeparableFilter::evalMany(float* result, int firstChan, int nChannels, int n,
+                                   const int* faceid, const float* u, const float* v,
+                                   const float* uw1, const float* vw1,
+                                   const float* uw2, const float* vw2,
+                                   float width, float blur)
+{
+    // init (same for all lookups)
+    if (!_tx || nChannels <= 0 || n <= 0) return;
+    Context ctx(firstChan*DataSize(_dt), PtexUtils::min(nChannels, _ntxchan-firstChan));
+    if (ctx.nchan <= 0) return;
+
+    // evaluate the lookups for one face at a time (in blocks, to bound the
+    // cost of grouping), holding on to the face data used for that face
+    int numFaces = _tx->numFaces();
+    float* pixel = (float*) alloca(sizeof(float)*ctx.nchan);
+    bool done[BlockSize];
+    ctx.batching = true;
+    for (int b = 0; b < n; b += BlockSize) {
+        int bn = PtexUtils::min(BlockSize, n - b);
+        for (int j = 0; j < bn; j++) done[j] = faceid[b+j] < 0 || faceid[b+j] >= numFaces;
+        for (int j1 = 0; j1 < bn; j1++) {
+            if (done[j1]) continue;
+            int fid = faceid[b+j1];
+
+            // if neighborhood is constant, every lookup gets the constant value of the face
+            if (_tx->getFaceInfo(fid).isNeighborhoodConstant()) {
+                PtexPtr<PtexFaceData> data ( _tx->getData(fid, 0) );
+                if (data) {
+                    char* d = (char*) data->getData() + ctx.firstChanOffset;
+                    Ptex::ConvertToFloat(pixel, d, _dt, ctx.nchan);
+                }
+                for (int j = j1; j < bn; j++) {
+                    if (done[j] || faceid[b+j] != fid) continue;
+                    done[j] = true;
+                    if (!data) continue;
+                    float* dst = result + b + j;
+                    for (int c = 0; c < ctx.nchan; c++) dst[c*n] = pixel[c];
+                }
+                continue;
+            }
 
+            int prev = -1; // previous lookup evaluated on this face
+            for (int j = j1; j < bn; j++) {
+                if (done[j] || faceid[b+j] != fid) continue;
+                done[j] = true;
+                int i = b + j;
+                float* dst = result + i;
+                if (prev >= 0 && u[i] == u[prev] && v[i] == v[prev] && uw1[i] == uw1[prev] &&
+                    vw1[i] == vw1[prev] && uw2[i] == uw2[prev] && vw2[i] == vw2[prev])
+                {
+                    // repeated lookup, reuse the result
+                    for (int c = 0; c < ctx.nchan; c++) dst[c*n] = dst[c*n + prev - i];
+                    continue;
+                }
+                // evaluate into a pixel and scatter into the result planes
+                for (int c = 0; c < ctx.nchan; c++) pixel[c] = dst[c*n];
+                evalFace(ctx, pixel, fid, u[i], v[i], uw1[i], vw1[i], uw2[i], vw2[i], width, blur);
+                for (int c = 0; c < ctx.nchan; c++) dst[c*n] = pixel[c];
+                prev = i;
+            }
+            ctx.releaseData();
+        }
+    }
+}
+
+
+void PtexSeparableFilter::evalFace(Context& ctx, float* result, int faceid, float u, float v,
+                                   float uw1, float vw1, float uw2, float vw2,
+                                   float width, float blur) const
+{
     // get face info
     const FaceInfo& f = _tx->getFaceInfo(faceid);
 
     // if neighborhood is constant, just return constant value of face
     if (f.isNeighborhoodConstant()) {
-        PtexPtr<PtexFaceData> data ( _tx->getData(faceid, 0) );
-        if (data) {
-            char* d = (char*) data->getData() + _firstChanOffset;
-            Ptex::ConvertToFloat(result, d, _dt, _nchan);
+        FaceDataRef data;
+        data.data = getData(ctx, faceid, 0, data.owned);
+        if (data.data) {
+            char* d = (char*) data.data->getData() + ctx.firstChanOffset;
+            Ptex::ConvertToFloat(result, d, _dt, ctx.nchan);
         }
         return;
     }
@@ -87,7 +175,7 @@ void PtexSeparableFilter::eval(float* result, int firstChan, int nChannels,
     }
 
     if (return_black) {
-        memset(result, 0, sizeof(float)*_nchan);
+        memset(result, 0, sizeof(float)*ctx.nchan);
         return;
     }
 
@@ -113,26 +201,26 @@ void PtexSeparableFilter::eval(float* result, int firstChan, int nChannels,
     // check kernel (debug only)
     assert(k.uw > 0 && k.vw > 0);
     assert(k.uw <= PtexSeparableKernel::kmax && k.vw <= PtexSeparableKernel::kmax);
-    _weight = k.weight();
+    ctx.weight = k.weight();
 
     // allocate temporary result
-    _result = (float*) alloca(sizeof(float)*_nchan);
-    memset(_result, 0, sizeof(float)*_nchan);
+    ctx.result = (float*) alloca(sizeof(float)*ctx.nchan);
+    memset(ctx.result, 0, sizeof(float)*ctx.nchan);
 
     // apply to faces
-    splitAndApply(k, faceid, f);
+    splitAndApply(ctx, k, faceid, f);
 
     // normalize (both for data type and cumulative kernel weight applied)
     // and output result
-    float scale = 1.0f / (_weight * OneValue(_dt));
-    for (int i = 0; i < _nchan; i++) result[i] = float(_result[i] * scale);
+    float scale = 1.0f / (ctx.weight * OneValue(_dt));
+    for (int i = 0; i < ctx.nchan; i++) result[i] = float(ctx.result[i] * scale);
 
     // clear temp result
-    _result = 0;
+    ctx.result = 0;
 }
 
 
-void PtexSeparableFilter::splitAndApply(PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f)
+void PtexSeparableFilter::splitAndApply(Context& ctx, PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f) const
 {
     // do we need to split? (i.e. does kernel span an edge?)
     bool splitR = (k.u+k.uw > k.res.u()), splitL = (k.u < 0);
@@ -143,7 +231,7 @@ void PtexSeparableFilter::splitAndApply(PtexSeparableKernel& k, int faceid, cons
         if (splitL) k.mergeL(_uMode);
         if (splitT) k.mergeT(_vMode);
         if (splitB) k.mergeB(_vMode);
-        apply(k, faceid, f);
+        apply(ctx, k, faceid, f);
         return;
     }
 
@@ -155,18 +243,18 @@ void PtexSeparableFilter::splitAndApply(PtexSeparableKernel& k, int faceid, cons
                 if (splitT) {
                     if (f.adjface(e_top) >= 0) {
                         ka.splitT(kc);
-                        applyToCorner(kc, faceid, f, e_top);
+                        applyToCorner(ctx, kc, faceid, f, e_top);
                     }
                     else ka.mergeT(_vMode);
                 }
                 if (splitB) {
                     if (f.adjface(e_bottom) >= 0) {
                         ka.splitB(kc);
-                        applyToCorner(kc, faceid, f, e_right);
+                        applyToCorner(ctx, kc, faceid, f, e_right);
                     }
                     else ka.mergeB(_vMode);
                 }
-                applyAcrossEdge(ka, faceid, f, e_right);
+                applyAcrossEdge(ctx, ka, faceid, f, e_right);
             }
             else k.mergeR(_uMode);
         }
@@ -176,44 +264,44 @@ void PtexSeparableFilter::splitAndApply(PtexSeparableKernel& k, int faceid, cons
                 if (splitT) {
                     if (f.adjface(e_top) >= 0) {
                         ka.splitT(kc);
-                        applyToCorner(kc, faceid, f, e_left);
+                        applyToCorner(ctx, kc, faceid, f, e_left);
                     }
                     else ka.mergeT(_vMode);
                 }
                 if (splitB) {
                     if (f.adjface(e_bottom) >= 0) {
                         ka.splitB(kc);
-                        applyToCorner(kc, faceid, f, e_bottom);
+                        applyToCorner(ctx, kc, faceid, f, e_bottom);
                     }
                     else ka.mergeB(_vMode);
                 }
-                applyAcrossEdge(ka, faceid, f, e_left);
+                applyAcrossEdge(ctx, ka, faceid, f, e_left);
             }
             else k.mergeL(_uMode);
         }
         if (splitT) {
             if (f.adjface(e_top) >= 0) {
                 k.splitT(ka);
-                applyAcrossEdge(ka, faceid, f, e_top);
+                applyAcrossEdge(ctx, ka, faceid, f, e_top);
             }
             else k.mergeT(_vMode);
         }
         if (splitB) {
             if (f.adjface(e_bottom) >= 0) {
                 k.splitB(ka);
-                applyAcrossEdge(ka, faceid, f, e_bottom);
+                applyAcrossEdge(ctx, ka, faceid, f, e_bottom);
             }
             else k.mergeB(_vMode);
         }
     }
 
     // do local face
-    apply(k, faceid, f);
+    apply(ctx, k, faceid, f);
 }
 
 
-void PtexSeparableFilter::applyAcrossEdge(PtexSeparableKernel& k,
-                                          int faceid, const Ptex::FaceInfo& f, int eid)
+void PtexSeparableFilter::applyAcrossEdge(Context& ctx, PtexSeparableKernel& k,
+                                          int faceid, const Ptex::FaceInfo& f, int eid) const
 {
     int afid = f.adjface(eid), aeid = f.adjedge(eid);
     const Ptex::FaceInfo* af = &_tx->getFaceInfo(afid);
@@ -249,13 +337,13 @@ void PtexSeparableFilter::applyAcrossEdge(PtexSeparableKernel& k,
 
     // rotate and apply (resplit if going to a subface)
     k.rotate(rot);
-    if (afIsSubface) splitAndApply(k, afid, *af);
-    else apply(k, afid, *af);
+    if (afIsSubface) splitAndApply(ctx, k, afid, *af);
+    else apply(ctx, k, afid, *af);
 }
 
 
-void PtexSeparableFilter::applyToCorner(PtexSeparableKernel& k, int faceid,
-                                        const Ptex::FaceInfo& f, int eid)
+void PtexSeparableFilter::applyToCorner(Context& ctx, PtexSeparableKernel& k, int faceid,
+                                        const Ptex::FaceInfo& f, int eid) const
 {
     // traverse clockwise around corner vertex and gather corner faces
     int afid = faceid, aeid = eid;
@@ -298,7 +386,7 @@ void PtexSeparableFilter::applyToCorner(PtexSeparableKernel& k, int faceid,
             bool primary = (i==1);
             k.adjustSubfaceToMain(eid + primary * 2);
             k.rotate(eid - aeid + 3 - primary);
-            splitAndApply(k, afid, *af);
+            splitAndApply(ctx, k, afid, *af);
             return;
         }
         prevIsSubface = isSubface;
@@ -306,7 +394,7 @@ void PtexSeparableFilter::applyToCorner(PtexSeparableKernel& k, int faceid,
 
     if (numCorners == 1) {
         // regular case (valence 4)
-        applyToCornerFace(k, f, eid, cfaceId[1], *cface[1], cedgeId[1]);
+        applyToCornerFace(ctx, k, f, eid, cfaceId[1], *cface[1], cedgeId[1]);
     }
     else if (numCorners > 1) {
         // valence 5+, make kernel symmetric and apply equally to each face
@@ -316,20 +404,20 @@ void PtexSeparableFilter::applyToCorner(PtexSeparableKernel& k, int faceid,
         float newWeight = k.makeSymmetric(initialWeight);
         for (int i = 1; i <= numCorners; i++) {
             PtexSeparableKernel kc = k;
-            applyToCornerFace(kc, f, 2, cfaceId[i], *cface[i], cedgeId[i]);
+            applyToCornerFace(ctx, kc, f, 2, cfaceId[i], *cface[i], cedgeId[i]);
         }
         // adjust weight for symmetrification and for additional corners
-        _weight += newWeight * (float)numCorners - initialWeight;
+        ctx.weight += newWeight * (float)numCorners - initialWeight;
     }
     else {
         // valence 2 or 3, ignore corner face (just adjust weight)
-        _weight -= k.weight();
+        ctx.weight -= k.weight();
     }
 }
 
 
-void PtexSeparableFilter::applyToCornerFace(PtexSeparableKernel& k, const Ptex::FaceInfo& f, int eid,
-                                            int cfid, const Ptex::FaceInfo& cf, int ceid)
+void PtexSeparableFilter::applyToCornerFace(Context& ctx, PtexSeparableKernel& k, const Ptex::FaceInfo& f, int eid,
+                                            int cfid, const Ptex::FaceInfo& cf, int ceid) const
 {
     // adjust uv coord and res for face/subface boundary
     bool fIsSubface = f.isSubface(), cfIsSubface = cf.isSubface();
@@ -340,12 +428,12 @@ void PtexSeparableFilter::applyToCornerFace(PtexSeparableKernel& k, const Ptex::
 
     // rotate and apply (resplit if going to a subface)
     k.rotate(eid - ceid + 2);
-    if (cfIsSubface) splitAndApply(k, cfid, cf);
-    else apply(k, cfid, cf);
+    if (cfIsSubface) splitAndApply(ctx, k, cfid, cf);
+    else apply(ctx, k, cfid, cf);
 }
 
 
-void PtexSeparableFilter::apply(PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f)
+void PtexSeparableFilter::apply(Context& ctx, PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f) const
 {
     assert(k.u >= 0 && k.u + k.uw <= k.res.u());
     assert(k.v >= 0 && k.v + k.vw <= k.res.v());
@@ -357,18 +445,20 @@ void PtexSeparableFilter::apply(PtexSeparableKernel& k, int faceid, const Ptex::
     while (k.res.v() > f.res.v()) k.downresV();
 
     // get face data, and apply
-    PtexPtr<PtexFaceData> dh ( _tx->getData(faceid, k.res) );
+    FaceDataRef dhr;
+    dhr.data = getData(ctx, faceid, k.res, dhr.owned);
+    PtexFaceData* dh = dhr.data;
     if (!dh) return;
 
     if (dh->isConstant()) {
-        k.applyConst(_result, (char*)dh->getData()+_firstChanOffset, _dt, _nchan);
+        k.applyConst(ctx.result, (char*)dh->getData()+ctx.firstChanOffset, _dt, ctx.nchan);
         return;
     }
 
     // allocate temporary result for tanvec mode (if needed)
-    bool tanvecMode = (_efm == efm_tanvec) && (_nchan >= 2) && (k.rot > 0);
-    float* result = tanvecMode ? (float*) alloca(sizeof(float)*_nchan) : _result;
-    if (tanvecMode) memset(result, 0, sizeof(float)*_nchan);
+    bool tanvecMode = (_efm == efm_tanvec) && (ctx.nchan >= 2) && (k.rot > 0);
+    float* result = tanvecMode ? (float*) alloca(sizeof(float)*ctx.nchan) : ctx.result;
+    if (tanvecMode) memset(result, 0, sizeof(float)*ctx.nchan);
 
     if (dh->isTiled()) {
         Ptex::Res tileres = dh->tileRes();
@@ -387,42 +477,78 @@ void PtexSeparableFilter::apply(PtexSeparableKernel& k, int faceid, const Ptex::
                 kt.u = u % tileresu;
                 kt.uw = PtexUtils::min(uw, tileresu - kt.u);
                 kt.ku = k.ku + u - k.u;
-                PtexPtr<PtexFaceData> th ( dh->getTile(tilev * ntilesu + tileu) );
+                FaceDataRef thr;
+                thr.data = getData(ctx, faceid, k.res, thr.owned, dh, tilev * ntilesu + tileu);
+                PtexFaceData* th = thr.data;
                 if (th) {
                     if (th->isConstant())
-                        kt.applyConst(result, (char*)th->getData()+_firstChanOffset, _dt, _nchan);
+                        kt.applyConst(result, (char*)th->getData()+ctx.firstChanOffset, _dt, ctx.nchan);
                     else
-                        kt.apply(result, (char*)th->getData()+_firstChanOffset, _dt, _nchan, _ntxchan);
+                        kt.apply(result, (char*)th->getData()+ctx.firstChanOffset, _dt, ctx.nchan, _ntxchan);
                 }
             }
         }
     }
     else {
-        k.apply(result, (char*)dh->getData()+_firstChanOffset, _dt, _nchan, _ntxchan);
+        k.apply(result, (char*)dh->getData()+ctx.firstChanOffset, _dt, ctx.nchan, _ntxchan);
     }
 
     if (tanvecMode) {
         // rotate tangent-space vector data and update main result
         switch (k.rot) {
             case 0: // rot==0 included for completeness, but tanvecMode should be false in this case
-                _result[0] += result[0];
-                _result[1] += result[1];
+                ctx.result[0] += result[0];
+                ctx.result[1] += result[1];
                 break;
             case 1:
-                _result[0] -= result[1];
-                _result[1] += result[0];
+                ctx.result[0] -= result[1];
+                ctx.result[1] += result[0];
                 break;
             case 2:
-                _result[0] -= result[0];
-                _result[1] -= result[1];
+                ctx.result[0] -= result[0];
+                ctx.result[1] -= result[1];
                 break;
             case 3:
-                _result[0] += result[1];
-                _result[1] -= result[0];
+                ctx.result[0] += result[1];
+                ctx.result[1] -= result[0];
                 break;
         }
-        for (int i = 2; i < _nchan; i++) _result[i] += result[i];
+        for (int i = 2; i < ctx.nchan; i++) ctx.result[i] += result[i];
     }
 }
 
+
+PtexFaceData* PtexSeparableFilter::getData(Context& ctx, int faceid, Res res, bool& owned,
+                                           PtexFaceData* face, int tile) const
+{
+    if (ctx.batching) {
+        for (int i = 0; i < ctx.numBatchData; i++) {
+            const BatchData& b = ctx.batchData[i];
+            if (b.faceid == faceid && b.tile == tile && b.res == res) {
+                owned = false;
+                return b.data;
+            }
+        }
+    }
+    PtexFaceData* data = face ? face->getTile(tile) : _tx->getData(faceid, res);
+
+    // only the first few handles are held; more are rarely reused
+    owned = !ctx.batching || ctx.numBatchData == MaxBatchData || !data;
+    if (!owned) {
+        BatchData& b = ctx.batchData[ctx.numBatchData++];
+        b.faceid = faceid;
+        b.res = res;
+        b.tile = tile;
+        b.data = data;
+    }
+    return data;
+}
+
+
+void PtexSeparableFilter::Context::releaseData()
+{
+    // release tiles before the faces they belong to
+    while (numBatchData > 0) batchData[--numBatchData].data->release();
+}
+
 PTEX_NAMESPACE_END
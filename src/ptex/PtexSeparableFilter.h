@@ -50,37 +50,74 @@ class PtexSeparableFilter : public PtexFilter
                       int faceid, float u, float v,
                       float uw1, float vw1, float uw2, float vw2,
                       float width, float blur);
+    virtual void evalMany(float* result, int firstchan, int nchannels, int n,
+                          const int* faceid, const float* u, const float* v,
+                          const float* uw1, const float* vw1, const float* uw2, const float* vw2,
+                          float width, float blur);
 
  protected:
     PtexSeparableFilter(PtexTexture* tx, const PtexFilter::Options& opts ) :
-        _tx(tx), _options(opts), _result(0), _weight(0),
-        _firstChanOffset(0), _nchan(0), _ntxchan(_tx->numChannels()),
+        _tx(tx), _options(opts), _ntxchan(_tx->numChannels()),
         _dt(tx->dataType()), _uMode(tx->uBorderMode()), _vMode(tx->vBorderMode()),
         _efm(tx->edgeFilterMode())
     {
         // if caller was compiled with older version of struct, set default for new opts
-        if (_options.__structSize < (char*)&_options.noedgeblend - (char*)&_options) {
+        if (_options.__structSize < (char*)(&_options.noedgeblend + 1) - (char*)&_options) {
             _options.noedgeblend = 0;
         }
+        if (_options.__structSize < (char*)(&_options.kerneltable + 1) - (char*)&_options) {
+            _options.kerneltable = 0;
+        }
     }
     virtual ~PtexSeparableFilter() {}
 
-    virtual void buildKernel(PtexSeparableKernel& k, float u, float v, float uw, float vw,
-                             Res faceRes) = 0;
+    struct BatchData {
+        int faceid;             // face id
+        Res res;                // face resolution
+        int tile;               // tile index, or -1 for the face
+        PtexFaceData* data;     // data handle
+    };
+    enum { MaxBatchData = 4 };
+
+    // state of an evaluation, kept on the stack (rather than in the filter)
+    // so that one filter can be used by any number of threads at once
+    struct Context {
+        float* result;          // temp result
+        float weight;           // accumulated weight of data in result
+        int firstChanOffset;    // byte offset of first channel to eval
+        int nchan;              // number of channels to eval
+        bool batching;          // face data is held in batchData (in evalMany)
+        int numBatchData;       // number of held face data handles
+        BatchData batchData[MaxBatchData]; // face data held for the current face's lookups
+
+        Context(int firstChanOffset_, int nchan_)
+            : result(0), weight(0), firstChanOffset(firstChanOffset_), nchan(nchan_),
+              batching(false), numBatchData(0) {}
+        ~Context() { releaseData(); }
+        void releaseData();
+    };
 
-    void splitAndApply(PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f);
-    void applyAcrossEdge(PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f, int eid);
-    void applyToCorner(PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f, int eid);
-    void applyToCornerFace(PtexSeparableKernel& k, const Ptex::FaceInfo& f, int eid,
-                           int cfaceid, const Ptex::FaceInfo& cf, int ceid);
-    void apply(PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f);
+    virtual void buildKernel(PtexSeparableKernel& k, float u, float v, float uw, float vw,
+                             Res faceRes) const = 0;
+
+    void evalFace(Context& ctx, float* result, int faceid, float u, float v,
+                  float uw1, float vw1, float uw2, float vw2, float width, float blur) const;
+    void splitAndApply(Context& ctx, PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f) const;
+    void applyAcrossEdge(Context& ctx, PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f,
+                         int eid) const;
+    void applyToCorner(Context& ctx, PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f,
+                       int eid) const;
+    void applyToCornerFace(Context& ctx, PtexSeparableKernel& k, const Ptex::FaceInfo& f, int eid,
+                           int cfaceid, const Ptex::FaceInfo& cf, int ceid) const;
+    void apply(Context& ctx, PtexSeparableKernel& k, int faceid, const Ptex::FaceInfo& f) const;
+
+    // get face data (or a tile of the given face data); while batching, some
+    // data is held by the context, otherwise the caller owns it
+    PtexFaceData* getData(Context& ctx, int faceid, Res res, bool& owned,
+                          PtexFaceData* face=0, int tile=-1) const;
 
     PtexTexture* _tx;           // texture being evaluated
     Options _options;           // options
-    float* _result;             // temp result
-    float _weight;              // accumulated weight of data in _result
-    int _firstChanOffset;       // byte offset of first channel to eval
-    int _nchan;                 // number of channels to eval
     int _ntxchan;               // number of channels in texture
     DataType _dt;               // data type of texture
     BorderMode _uMode, _vMode;  // border modes (clamp,black,periodic)
@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include "PtexUtils.h"
 #include "PtexHalf.h"
 #include "PtexSeparableKernel.h"
+#include "PtexSIMD.h"
 
 PTEX_NAMESPACE_BEGIN
 
@@ -44,29 +45,31 @@ namespace {
     template<class T, int nChan>
     void Apply(PtexSeparableKernel& k, float* result, void* data, int /*nChan*/, int /*nTxChan*/)
     {
+        typedef typename PtexUtils::FilterRow<T>::Type R;
         float* rowResult = (float*) alloca(nChan*sizeof(float));
         int rowlen = k.res.u() * nChan;
         int datalen = k.uw * nChan;
-        int rowskip = rowlen - datalen;
+        float* rowBuf = (float*) alloca(PtexUtils::FilterRow<T>::converted * datalen * sizeof(float));
         float* kvp = k.kv;
         T* p = static_cast<T*>(data) + (k.v * k.res.u() + k.u) * nChan;
         T* pEnd = p + k.vw * rowlen;
         while (p != pEnd)
         {
             float* kup = k.ku;
-            T* pRowEnd = p + datalen;
+            const R* rp = PtexUtils::FilterRow<T>::get(p, datalen, rowBuf);
+            const R* rpEnd = rp + datalen;
             // just mult and copy first element
-            PtexUtils::VecMult<T,nChan>()(rowResult, p, *kup++);
-            p += nChan;
+            PtexUtils::VecMult<R,nChan>()(rowResult, rp, *kup++);
+            rp += nChan;
             // accumulate remaining elements
-            while (p != pRowEnd) {
+            while (rp != rpEnd) {
                 // rowResult[i] = p[i] * ku[u] for i in {0..n-1}
-                PtexUtils::VecAccum<T,nChan>()(rowResult, p, *kup++);
-                p += nChan;
+                PtexUtils::VecAccum<R,nChan>()(rowResult, rp, *kup++);
+                rp += nChan;
             }
             // result[i] += rowResult[i] * kv[v] for i in {0..n-1}
             PtexUtils::VecAccum<float,nChan>()(result, rowResult, *kvp++);
-            p += rowskip;
+            p += rowlen;
         }
     }
 
@@ -74,29 +77,31 @@ namespace {
     template<class T, int nChan>
     void ApplyS(PtexSeparableKernel& k, float* result, void* data, int /*nChan*/, int nTxChan)
     {
+        typedef typename PtexUtils::FilterRow<T>::Type R;
         float* rowResult = (float*) alloca(nChan*sizeof(float));
         int rowlen = k.res.u() * nTxChan;
         int datalen = k.uw * nTxChan;
-        int rowskip = rowlen - datalen;
+        float* rowBuf = (float*) alloca(PtexUtils::FilterRow<T>::converted * datalen * sizeof(float));
         float* kvp = k.kv;
         T* p = static_cast<T*>(data) + (k.v * k.res.u() + k.u) * nTxChan;
         T* pEnd = p + k.vw * rowlen;
         while (p != pEnd)
         {
             float* kup = k.ku;
-            T* pRowEnd = p + datalen;
+            const R* rp = PtexUtils::FilterRow<T>::get(p, datalen - nTxChan + nChan, rowBuf);
+            const R* rpEnd = rp + datalen;
             // just mult and copy first element
-            PtexUtils::VecMult<T,nChan>()(rowResult, p, *kup++);
-            p += nTxChan;
+            PtexUtils::VecMult<R,nChan>()(rowResult, rp, *kup++);
+            rp += nTxChan;
             // accumulate remaining elements
-            while (p != pRowEnd) {
+            while (rp != rpEnd) {
                 // rowResult[i] = p[i] * ku[u] for i in {0..n-1}
-                PtexUtils::VecAccum<T,nChan>()(rowResult, p, *kup++);
-                p += nTxChan;
+                PtexUtils::VecAccum<R,nChan>()(rowResult, rp, *kup++);
+                rp += nTxChan;
             }
             // result[i] += rowResult[i] * kv[v] for i in {0..n-1}
             PtexUtils::VecAccum<float,nChan>()(result, rowResult, *kvp++);
-            p += rowskip;
+            p += rowlen;
         }
     }
 
@@ -104,34 +109,51 @@ namespace {
     template<class T>
     void ApplyN(PtexSeparableKernel& k, float* result, void* data, int nChan, int nTxChan)
     {
+        typedef typename PtexUtils::FilterRow<T>::Type R;
         float* rowResult = (float*) alloca(nChan*sizeof(float));
         int rowlen = k.res.u() * nTxChan;
         int datalen = k.uw * nTxChan;
-        int rowskip = rowlen - datalen;
+        float* rowBuf = (float*) alloca(PtexUtils::FilterRow<T>::converted * datalen * sizeof(float));
         float* kvp = k.kv;
         T* p = static_cast<T*>(data) + (k.v * k.res.u() + k.u) * nTxChan;
         T* pEnd = p + k.vw * rowlen;
         while (p != pEnd)
         {
             float* kup = k.ku;
-            T* pRowEnd = p + datalen;
+            const R* rp = PtexUtils::FilterRow<T>::get(p, datalen - nTxChan + nChan, rowBuf);
+            const R* rpEnd = rp + datalen;
             // just mult and copy first element
-            PtexUtils::VecMultN<T>()(rowResult, p, nChan, *kup++);
-            p += nTxChan;
+            PtexUtils::VecMultN<R>()(rowResult, rp, nChan, *kup++);
+            rp += nTxChan;
             // accumulate remaining elements
-            while (p != pRowEnd) {
+            while (rp != rpEnd) {
                 // rowResult[i] = p[i] * ku[u] for i in {0..n-1}
-                PtexUtils::VecAccumN<T>()(rowResult, p, nChan, *kup++);
-                p += nTxChan;
+                PtexUtils::VecAccumN<R>()(rowResult, rp, nChan, *kup++);
+                rp += nTxChan;
             }
             // result[i] += rowResult[i] * kv[v] for i in {0..n-1}
             PtexUtils::VecAccumN<float>()(result, rowResult, nChan, *kvp++);
-            p += rowskip;
+            p += rowlen;
         }
     }
 }
 
 
+bool PtexSeparableKernel::applySIMD(float* dst, void* data, DataType dt, int nChan, int nTxChan)
+{
+    // narrow kernels are faster in scalar code unless half conversion is needed
+    if (uw < 4 && dt != dt_half) return false;
+    PtexSIMD::SeparableApplyFn* fn = PtexSIMD::separableApplyFn(dt, nChan, nTxChan);
+    if (!fn) return false;
+    // data may start at a channel offset within the pixel, so the end of
+    // the data is only known to be after the last channel used
+    int size = DataSize(dt);
+    char* p = static_cast<char*>(data) + (v * res.u() + u) * nTxChan * size;
+    char* end = static_cast<char*>(data) + ((res.size() - 1) * nTxChan + nChan) * size;
+    fn(dst, p, end, res.u() * nTxChan, nTxChan, nChan, uw, vw, ku, kv);
+    return true;
+}
+
 
 PtexSeparableKernel::ApplyFn
 PtexSeparableKernel::applyFunctions[] = {
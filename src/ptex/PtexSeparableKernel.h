@@ -456,6 +456,9 @@ class PtexSeparableKernel {
 
     void apply(float* dst, void* data, DataType dt, int nChan, int nTxChan)
     {
+        // use a vector kernel if there is one for the current simd level
+        if (applySIMD(dst, data, dt, nChan, nTxChan)) return;
+
         // dispatch specialized apply function
         ApplyFn fn = applyFunctions[(nChan!=nTxChan)*20 + ((unsigned)nChan<=4)*nChan*4 + dt];
         fn(*this, dst, data, nChan, nTxChan);
@@ -471,6 +474,7 @@ class PtexSeparableKernel {
     typedef void (*ApplyConstFn)(float weight, float* dst, void* data, int nChan);
     static ApplyFn applyFunctions[40];
     static ApplyConstFn applyConstFunctions[20];
+    bool applySIMD(float* dst, void* data, DataType dt, int nChan, int nTxChan);
     static inline float accumulate(const float* p, int n)
     {
         float result = 0;
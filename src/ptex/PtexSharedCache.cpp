@@ -0,0 +1,484 @@
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#include "PtexPlatform.h"
+#include "PtexSharedCache.h"
+
+// the segment lock must be a robust mutex, which reports when its owner
+// died holding it, so that a killed process can't block the others; these
+// are available on all POSIX platforms but macOS
+#if !defined(PTEX_PLATFORM_WINDOWS) && !defined(__APPLE__)
+#define PTEX_SHARED_CACHE
+#endif
+
+#ifdef PTEX_SHARED_CACHE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+PTEX_NAMESPACE_BEGIN
+
+#ifdef PTEX_SHARED_CACHE
+
+namespace {
+    const uint32_t Magic = 0x78747370; // "pstx"
+    const uint32_t Version = 2;
+    const uint64_t RecordAlign = 64;   // size of Record header, and alignment of records
+    const size_t BytesPerSlot = 8192;  // arena bytes per index slot
+    const int MaxClients = 64;         // (one bit each in a record's pin mask)
+
+    uint64_t align(uint64_t size) { return (size + RecordAlign - 1) & ~(RecordAlign - 1); }
+}
+
+struct PtexSharedCache::Header {
+    volatile uint32_t magic;        // set last, once the segment is initialized
+    uint32_t version;
+    uint64_t size;                  // size of segment
+    uint64_t nslots;                // size of index (a power of two)
+    uint64_t arenaOffset;           // offset of records within segment
+    uint64_t arenaSize;
+    uint64_t head;                  // arena offset of the next record to allocate
+    int32_t clients[MaxClients];    // process id of each attached cache (or zero if free)
+    pthread_mutex_t mutex;
+};
+
+// The arena is always tiled by records (free ones having a zero file key),
+// and each update leaves it that way, so that it can be walked even after
+// a process dies mid-update.
+struct PtexSharedCache::Record {
+    uint64_t fileKey;               // zero for a free record
+    uint64_t pos;                   // file position of block
+    uint64_t size;                  // size of data (following the record)
+    uint64_t recordSize;            // size of record including data and alignment
+    uint64_t pins;                  // mask of clients using the data in place
+    uint64_t pad[3];
+};
+
+
+PtexSharedCache* PtexSharedCache::open(const char* nameArg, size_t size, std::string& error)
+{
+    std::string name = nameArg ? nameArg : "";
+    if (name.empty() || name[0] != '/') name.insert(0, "/");
+    size_t minSize = align(sizeof(Header)) + 64 * (sizeof(uint64_t) + BytesPerSlot);
+    if (size < minSize) size = minSize;
+
+    // create and initialize, or attach to an existing segment; the data is
+    // trusted by every process using it, so only the owner may access it
+    bool created = true;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        error = "Can't open shared cache " + name + ": " + strerror(errno);
+        return 0;
+    }
+    if (created) {
+        // (the umask may have removed the owner's access)
+        if (fchmod(fd, 0600) != 0 || ftruncate(fd, off_t(size)) != 0) {
+            error = "Can't size shared cache " + name + ": " + strerror(errno);
+            close(fd);
+            shm_unlink(name.c_str());
+            return 0;
+        }
+    }
+    else {
+        // use the existing size (waiting briefly for the creator to set it)
+        struct stat st;
+        for (int i = 0; i < 1000 && fstat(fd, &st) == 0 && st.st_size == 0; i++) usleep(1000);
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < minSize) {
+            error = "Invalid shared cache " + name;
+            close(fd);
+            return 0;
+        }
+        if (st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO))) {
+            error = "Shared cache " + name + " isn't private to this user";
+            close(fd);
+            return 0;
+        }
+        size = size_t(st.st_size);
+    }
+    void* base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        error = "Can't map shared cache " + name + ": " + strerror(errno);
+        close(fd);
+        if (created) shm_unlink(name.c_str());
+        return 0;
+    }
+
+    Header* header = (Header*) base;
+    if (created) {
+        uint64_t nslots = 64;
+        while (nslots * 2 * (sizeof(uint64_t) + BytesPerSlot) <= size - align(sizeof(Header))) nslots *= 2;
+        header->version = Version;
+        header->size = size;
+        header->nslots = nslots;
+        header->arenaOffset = align(sizeof(Header) + nslots * sizeof(uint64_t));
+        header->arenaSize = (size - header->arenaOffset) & ~(RecordAlign - 1);
+        header->head = 0;
+        Record* first = (Record*) ((char*) base + header->arenaOffset);
+        first->recordSize = header->arenaSize;
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        // (index slots, clients, and the free record's key and pins are zero in a new segment)
+        AtomicStore(&header->magic, Magic);
+    }
+    else {
+        for (int i = 0; i < 1000 && header->magic != Magic; i++) usleep(1000);
+        PtexMemoryFence();
+        if (header->magic != Magic || header->version != Version || header->size != size) {
+            error = "Invalid shared cache " + name;
+            munmap(base, size);
+            close(fd);
+            return 0;
+        }
+    }
+    return new PtexSharedCache((char*) base, size, fd);
+}
+
+
+PtexSharedCache::PtexSharedCache(char* base, size_t size, int fd)
+    : _base(base), _size(size), _fd(fd), _header((Header*) base),
+      _slots((uint64_t*) (base + align(sizeof(Header)))),
+      _arena(base + _header->arenaOffset), _client(-1), _hits(0)
+{
+    attach();
+}
+
+
+PtexSharedCache::~PtexSharedCache()
+{
+    // (any faces using data in place must have been freed already)
+    if (_client >= 0 && lock()) {
+        releaseClient(_client);
+        unlock();
+    }
+    munmap(_base, _size);
+    close(_fd); // (releasing the liveness lock)
+}
+
+
+bool PtexSharedCache::lock()
+{
+    int result = pthread_mutex_lock(&_header->mutex);
+    if (result == EOWNERDEAD) {
+        // previous owner died mid-update
+        recover();
+        pthread_mutex_consistent(&_header->mutex);
+        result = 0;
+    }
+    return result == 0;
+}
+
+
+void PtexSharedCache::unlock()
+{
+    pthread_mutex_unlock(&_header->mutex);
+}
+
+
+void PtexSharedCache::lockForTesting()
+{
+    lock();
+}
+
+
+void PtexSharedCache::recover()
+{
+    // updates keep the arena walkable, so this only fails if the segment
+    // was damaged some other way; then start over (which may overwrite data
+    // pinned by other processes, but at least keeps the cache usable)
+    Header& h = *_header;
+    bool headFound = h.head == h.arenaSize;
+    uint64_t offset = 0;
+    while (offset < h.arenaSize) {
+        uint64_t recordSize = record(offset)->recordSize;
+        if (!recordSize || (recordSize & (RecordAlign - 1)) || recordSize > h.arenaSize - offset) break;
+        if (offset == h.head) headFound = true;
+        offset += recordSize;
+    }
+    if (offset != h.arenaSize) reset();
+    else if (!headFound) h.head = 0;
+}
+
+
+void PtexSharedCache::reset()
+{
+    Header& h = *_header;
+    memset(_slots, 0, h.nslots * sizeof(uint64_t));
+    memset(record(0), 0, sizeof(Record));
+    record(0)->recordSize = h.arenaSize;
+    h.head = 0;
+}
+
+
+void PtexSharedCache::attach()
+{
+    // take a free client slot (or the slot of a dead process) so that this
+    // cache can pin data; otherwise data is only copied
+    if (!lock()) return;
+    Header& h = *_header;
+    for (int client = 0; client < MaxClients && _client < 0; client++) {
+        if (h.clients[client]) {
+            if (clientAlive(client)) continue;
+            releaseClient(client);
+        }
+#ifdef F_OFD_SETLK
+        // hold a lock on a byte of the segment for the life of the cache
+        struct flock fl;
+        memset(&fl, 0, sizeof(fl));
+        fl.l_type = F_WRLCK;
+        fl.l_whence = SEEK_SET;
+        fl.l_start = client;
+        fl.l_len = 1;
+        if (fcntl(_fd, F_OFD_SETLK, &fl) != 0) continue;
+#endif
+        h.clients[client] = int32_t(getpid());
+        _client = client;
+    }
+    unlock();
+}
+
+
+bool PtexSharedCache::clientAlive(int client)
+{
+#ifdef F_OFD_GETLK
+    // the client's lock is released (by the kernel) when its process dies
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = client;
+    fl.l_len = 1;
+    return fcntl(_fd, F_OFD_GETLK, &fl) != 0 || fl.l_type != F_UNLCK;
+#else
+    pid_t pid = pid_t(_header->clients[client]);
+    return kill(pid, 0) == 0 || errno != ESRCH;
+#endif
+}
+
+
+void PtexSharedCache::releaseClient(int client)
+{
+    // drop the client's pins from every record and free its slot
+    Header& h = *_header;
+    uint64_t bit = uint64_t(1) << client;
+    for (uint64_t offset = 0; offset < h.arenaSize; offset += record(offset)->recordSize)
+        record(offset)->pins &= ~bit;
+    h.clients[client] = 0;
+}
+
+
+bool PtexSharedCache::pinnedByLiveClient(Record* rec)
+{
+    // pins of a process that died are released when found
+    for (int client = 0; client < MaxClients; client++) {
+        if (!(rec->pins & (uint64_t(1) << client))) continue;
+        if (client == _client || clientAlive(client)) return true;
+        releaseClient(client);
+    }
+    return false;
+}
+
+
+uint64_t* PtexSharedCache::slot(uint64_t fileKey, FilePos pos)
+{
+    uint64_t hash = (fileKey ^ uint64_t(pos)) * ((uint64_t(0x9e3779b9) << 32) | 0x7f4a7c15);
+    return &_slots[(hash >> 32) & (_header->nslots - 1)];
+}
+
+
+PtexSharedCache::Record* PtexSharedCache::find(uint64_t fileKey, FilePos pos, int size)
+{
+    uint64_t offset = *slot(fileKey, pos);
+    if (!offset) return 0;
+    Record* rec = record(offset - 1);
+    if (rec->fileKey != fileKey || rec->pos != uint64_t(pos) || rec->size != uint64_t(size)) return 0;
+    return rec;
+}
+
+
+bool PtexSharedCache::get(uint64_t fileKey, FilePos pos, void* data, int size)
+{
+    if (!lock()) return false;
+    Record* rec = find(fileKey, pos, size);
+    if (rec) memcpy(data, rec + 1, size);
+    unlock();
+    if (!rec) return false;
+    AtomicIncrement(&_hits);
+    return true;
+}
+
+
+const void* PtexSharedCache::pin(uint64_t fileKey, FilePos pos, int size, bool countHit)
+{
+    if (_client < 0 || !lock()) return 0;
+    Record* rec = find(fileKey, pos, size);
+    if (rec) {
+        rec->pins |= uint64_t(1) << _client;
+        _pins[uint64_t((char*) rec - _arena)]++;
+    }
+    unlock();
+    if (!rec) return 0;
+    if (countHit) AtomicIncrement(&_hits);
+    return rec + 1;
+}
+
+
+void PtexSharedCache::unpin(const void* data)
+{
+    if (!lock()) return;
+    Record* rec = (Record*) data - 1;
+    std::map<uint64_t, int>::iterator i = _pins.find(uint64_t((char*) rec - _arena));
+    if (i != _pins.end() && --i->second == 0) {
+        _pins.erase(i);
+        rec->pins &= ~(uint64_t(1) << _client);
+    }
+    unlock();
+}
+
+
+bool PtexSharedCache::contains(uint64_t fileKey, FilePos pos, int size)
+{
+    if (!lock()) return false;
+    bool found = find(fileKey, pos, size) != 0;
+    unlock();
+    return found;
+}
+
+
+void PtexSharedCache::evict(Record* rec)
+{
+    if (!rec->fileKey) return;
+    uint64_t* s = slot(rec->fileKey, FilePos(rec->pos));
+    if (*s == uint64_t((char*) rec - _arena) + 1) *s = 0;
+    rec->fileKey = 0;
+}
+
+
+bool PtexSharedCache::allocate(uint64_t recordSize, uint64_t& offset)
+{
+    // gather a run of unpinned records at the head (freeing them), starting
+    // over after any pinned record and at the start of the arena; give up
+    // once the whole arena has been scanned
+    Header& h = *_header;
+    uint64_t start = h.head == h.arenaSize ? 0 : h.head;
+    uint64_t end = start, scanned = 0;
+    while (end - start < recordSize) {
+        if (scanned > 2 * h.arenaSize) return false;
+        if (end == h.arenaSize) { start = end = 0; continue; }
+        Record* rec = record(end);
+        uint64_t size = rec->recordSize;
+        if (rec->fileKey && rec->pins && pinnedByLiveClient(rec)) start = end + size;
+        else evict(rec);
+        end += size;
+        scanned += size;
+    }
+
+    // split off the rest of the run as a free record before shrinking the
+    // first record to cover the new one, so the arena is always walkable
+    if (end - start > recordSize) {
+        Record* rest = record(start + recordSize);
+        rest->fileKey = 0;
+        rest->pins = 0;
+        rest->recordSize = end - start - recordSize;
+        PtexMemoryFence();
+    }
+    record(start)->recordSize = recordSize;
+    h.head = start + recordSize;
+    offset = start;
+    return true;
+}
+
+
+void PtexSharedCache::add(uint64_t fileKey, FilePos pos, const void* data, int size)
+{
+    // don't let one face displace more than a quarter of the cache
+    uint64_t recordSize = align(sizeof(Record) + uint64_t(size));
+    if (size <= 0 || recordSize > _header->arenaSize / 4) return;
+    if (!lock()) return;
+    uint64_t offset;
+    if (find(fileKey, pos, size) || !allocate(recordSize, offset)) {
+        // added by another thread or process, or no room between pinned records
+        unlock();
+        return;
+    }
+
+    // fill in the (free) record, then give it its key and index it
+    Record* rec = record(offset);
+    rec->pos = uint64_t(pos);
+    rec->size = uint64_t(size);
+    rec->pins = 0;
+    memcpy(rec + 1, data, size);
+    PtexMemoryFence();
+    rec->fileKey = fileKey;
+    *slot(fileKey, pos) = offset + 1;
+    unlock();
+}
+
+#else
+
+// not supported without robust process-shared mutexes
+
+PtexSharedCache* PtexSharedCache::open(const char* /*name*/, size_t /*size*/, std::string& error)
+{
+#ifdef PTEX_PLATFORM_WINDOWS
+    error = "Shared cache is not supported on Windows";
+#else
+    error = "Shared cache is not supported on this platform (it has no robust mutexes)";
+#endif
+    return 0;
+}
+
+PtexSharedCache::~PtexSharedCache() {}
+bool PtexSharedCache::get(uint64_t, FilePos, void*, int) { return false; }
+const void* PtexSharedCache::pin(uint64_t, FilePos, int, bool) { return 0; }
+void PtexSharedCache::unpin(const void*) {}
+bool PtexSharedCache::contains(uint64_t, FilePos, int) { return false; }
+void PtexSharedCache::add(uint64_t, FilePos, const void*, int) {}
+void PtexSharedCache::lockForTesting() {}
+
+#endif
+
+PTEX_NAMESPACE_END
@@ -0,0 +1,146 @@
+#ifndef PtexSharedCache_h
+#define PtexSharedCache_h
+
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+/**
+  @file PtexSharedCache.h
+  @brief Contains PtexSharedCache, a cache of decoded face data shared between processes.
+*/
+
+#include <map>
+#include <string>
+#include "PtexPlatform.h"
+
+PTEX_NAMESPACE_BEGIN
+
+/** Cache of decoded face data in a named shared memory segment, so that
+    processes on a node reading the same textures read, decode, and hold
+    each face once.
+
+    The segment holds a direct-mapped index and an arena of records (face
+    data tagged with the file and block it came from).  Processes use the
+    face data in place: a record is pinned while any process holds a
+    face that points to it, and the per-process PtexCache then holds only
+    a small view of the face.  Each attached cache has a client slot in
+    the segment and records keep a mask of the clients pinning them, so a
+    record is never overwritten while in use.  New records are allocated
+    at a moving head, replacing the records there and skipping over
+    pinned ones.  If no room can be found (or the cache has no client
+    slot, at most 64 being attached at once) faces are copied instead.
+
+    The segment's mutex is robust: if a process dies while holding it,
+    the next process to lock it checks the arena (which is kept
+    consistent by each update) and carries on, only resetting it if it
+    is damaged.  Client slots are released when the cache is deleted or,
+    if a process dies, when another process finds its pins in the way;
+    on Linux client liveness is tracked with locks on the segment, and
+    elsewhere by process id (which assumes the processes share a pid
+    namespace).  The cache is only available on POSIX platforms with
+    robust mutexes (not macOS or Windows).
+
+    The segment outlives the processes using it (data stays warm across
+    restarts) until it is unlinked, e.g. with shm_unlink.
+ */
+class PtexSharedCache
+{
+public:
+    /** Attach to the named segment, creating it with the given size if
+        it doesn't exist.  Returns null (with an error) on failure. */
+    static PtexSharedCache* open(const char* name, size_t size, std::string& error);
+    ~PtexSharedCache();
+
+    /** Copy the data of the block at pos of the given file into data.
+        Returns false if not cached. */
+    bool get(uint64_t fileKey, FilePos pos, void* data, int size);
+
+    /** Find the data of the block at pos of the given file and pin it so
+        that it stays in place until unpin() is called.  Returns null if
+        not cached (or if this cache can't pin data).  If countHit is
+        false the lookup isn't counted in hits(). */
+    const void* pin(uint64_t fileKey, FilePos pos, int size, bool countHit=true);
+
+    /** Release a pin taken by pin(). */
+    void unpin(const void* data);
+
+    /** True if the data of the block at pos of the given file is cached. */
+    bool contains(uint64_t fileKey, FilePos pos, int size);
+
+    /** Add a copy of the data of the block at pos of the given file. */
+    void add(uint64_t fileKey, FilePos pos, const void* data, int size);
+
+    size_t size() const { return _size; }
+    uint64_t hits() const { return _hits; }
+
+    /** Take the segment lock and keep it (for tests of recovery from a
+        process dying while holding it). */
+    void lockForTesting();
+
+private:
+    struct Header;
+    struct Record;
+
+    PtexSharedCache(char* base, size_t size, int fd);
+    PtexSharedCache(const PtexSharedCache&);
+    void operator=(const PtexSharedCache&);
+
+    bool lock();
+    void unlock();
+    void recover();
+    void reset();
+    void attach();
+    bool clientAlive(int client);
+    void releaseClient(int client);
+    bool pinnedByLiveClient(Record* record);
+    Record* record(uint64_t offset) { return (Record*) (_arena + offset); }
+    uint64_t* slot(uint64_t fileKey, FilePos pos);
+    Record* find(uint64_t fileKey, FilePos pos, int size);
+    void evict(Record* record);
+    bool allocate(uint64_t recordSize, uint64_t& offset);
+
+    char* _base;                    // mapped segment
+    size_t _size;                   // size of mapping
+    int _fd;                        // segment (holding this client's liveness lock)
+    Header* _header;
+    uint64_t* _slots;               // index: record offset + 1 (or 0 if empty)
+    char* _arena;                   // records, tiling the arena
+    int _client;                    // client slot of this cache (or -1 if it can't pin)
+    std::map<uint64_t, int> _pins;  // pin counts of records pinned by this cache (under segment lock)
+    volatile uint64_t _hits;        // hits by this process
+};
+
+PTEX_NAMESPACE_END
+
+#endif
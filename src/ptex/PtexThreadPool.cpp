@@ -0,0 +1,132 @@
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#include "PtexPlatform.h"
+#include "PtexThreadPool.h"
+
+PTEX_NAMESPACE_BEGIN
+
+PtexThreadPool::PtexThreadPool(int numThreads)
+    : _stopping(false)
+{
+    _threads.reserve(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+        Thread thread;
+#ifdef PTEX_PLATFORM_WINDOWS
+        thread = (HANDLE) _beginthreadex(0, 0, threadMain, this, 0, 0);
+        if (!thread) break;
+#else
+        if (pthread_create(&thread, 0, threadMain, this) != 0) break;
+#endif
+        _threads.push_back(thread);
+    }
+}
+
+
+PtexThreadPool::~PtexThreadPool()
+{
+    // workers exit once the queue is empty
+    _monitor.lock();
+    _stopping = true;
+    _monitor.notifyAll();
+    _monitor.unlock();
+
+    for (size_t i = 0, n = _threads.size(); i < n; i++) {
+#ifdef PTEX_PLATFORM_WINDOWS
+        WaitForSingleObject(_threads[i], INFINITE);
+        CloseHandle(_threads[i]);
+#else
+        pthread_join(_threads[i], 0);
+#endif
+    }
+
+    // run anything left over if no threads could be created
+    while (!_queue.empty()) {
+        Task* task = _queue.front();
+        _queue.pop_front();
+        task->run();
+        delete task;
+    }
+}
+
+
+void PtexThreadPool::submit(Task* task)
+{
+    if (_threads.empty()) {
+        // no workers, just run it now
+        task->run();
+        delete task;
+        return;
+    }
+    AutoMonitor locker(_monitor);
+    _queue.push_back(task);
+    _monitor.notify();
+}
+
+
+#ifdef PTEX_PLATFORM_WINDOWS
+unsigned __stdcall PtexThreadPool::threadMain(void* pool)
+{
+    static_cast<PtexThreadPool*>(pool)->workerLoop();
+    return 0;
+}
+#else
+void* PtexThreadPool::threadMain(void* pool)
+{
+    static_cast<PtexThreadPool*>(pool)->workerLoop();
+    return 0;
+}
+#endif
+
+
+void PtexThreadPool::workerLoop()
+{
+    while (1) {
+        _monitor.lock();
+        while (_queue.empty() && !_stopping) _monitor.wait();
+        if (_queue.empty()) {
+            _monitor.unlock();
+            return;
+        }
+        Task* task = _queue.front();
+        _queue.pop_front();
+        _monitor.unlock();
+
+        task->run();
+        delete task;
+    }
+}
+
+PTEX_NAMESPACE_END
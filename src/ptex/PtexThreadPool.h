@@ -0,0 +1,93 @@
+#ifndef PtexThreadPool_h
+#define PtexThreadPool_h
+
+/*
+PTEX SOFTWARE
+Copyright 2014 Disney Enterprises, Inc.  All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+  * The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+    Studios" or the names of its contributors may NOT be used to
+    endorse or promote products derived from this software without
+    specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+/**
+  @file PtexThreadPool.h
+  @brief Contains PtexThreadPool, a simple fixed-size worker thread pool.
+*/
+
+#include <deque>
+#include <vector>
+#include "PtexPlatform.h"
+#include "PtexMutex.h"
+
+PTEX_NAMESPACE_BEGIN
+
+/** Fixed-size pool of worker threads that run queued tasks in fifo order.
+    Destroying the pool waits for all queued tasks to finish.
+ */
+class PtexThreadPool
+{
+public:
+    class Task
+    {
+    public:
+        virtual ~Task() {}
+        virtual void run() = 0;
+    };
+
+    PtexThreadPool(int numThreads);
+    ~PtexThreadPool();
+
+    int numThreads() const { return int(_threads.size()); }
+
+    /** Queue a task to be run by a worker thread.  The pool takes
+        ownership of the task and deletes it after it is run. */
+    void submit(Task* task);
+
+private:
+    PtexThreadPool(const PtexThreadPool&);
+    void operator=(const PtexThreadPool&);
+
+#ifdef PTEX_PLATFORM_WINDOWS
+    typedef HANDLE Thread;
+    static unsigned __stdcall threadMain(void* pool);
+#else
+    typedef pthread_t Thread;
+    static void* threadMain(void* pool);
+#endif
+    void workerLoop();
+
+    Monitor _monitor;
+    std::deque<Task*> _queue;
+    std::vector<Thread> _threads;
+    bool _stopping;
+};
+
+PTEX_NAMESPACE_END
+
+#endif
@@ -55,10 +55,9 @@ void PtexTriangleFilter::eval(float* result, int firstChan, int nChannels,
     // init
     if (!_tx || nChannels <= 0) return;
     if (faceid < 0 || faceid >= _tx->numFaces()) return;
-    _ntxchan = _tx->numChannels();
-    _dt = _tx->dataType();
-    _firstChanOffset = firstChan*DataSize(_dt);
-    _nchan = PtexUtils::min(nChannels, _ntxchan-firstChan);
+    Context ctx;
+    ctx.firstChanOffset = firstChan*DataSize(_dt);
+    ctx.nchan = PtexUtils::min(nChannels, _ntxchan-firstChan);
 
     // get face info
     const FaceInfo& f = _tx->getFaceInfo(faceid);
@@ -67,8 +66,8 @@ void PtexTriangleFilter::eval(float* result, int firstChan, int nChannels,
     if (f.isNeighborhoodConstant()) {
         PtexPtr<PtexFaceData> data ( _tx->getData(faceid, 0) );
         if (data) {
-            char* d = (char*) data->getData() + _firstChanOffset;
-            Ptex::ConvertToFloat(result, d, _dt, _nchan);
+            char* d = (char*) data->getData() + ctx.firstChanOffset;
+            Ptex::ConvertToFloat(result, d, _dt, ctx.nchan);
         }
         return;
     }
@@ -82,29 +81,26 @@ void PtexTriangleFilter::eval(float* result, int firstChan, int nChannels,
     buildKernel(k, u, v, uw1, vw1, uw2, vw2, width, blur, f.res);
 
     // accumulate the weight as we apply
-    _weight = 0;
+    ctx.weight = 0;
 
     // allocate temporary result
-    _result = (float*) alloca(sizeof(float)*_nchan);
-    memset(_result, 0, sizeof(float)*_nchan);
+    ctx.result = (float*) alloca(sizeof(float)*ctx.nchan);
+    memset(ctx.result, 0, sizeof(float)*ctx.nchan);
 
     // apply to faces
-    splitAndApply(k, faceid, f);
+    splitAndApply(ctx, k, faceid, f);
 
     // normalize (both for data type and cumulative kernel weight applied)
     // and output result
-    float scale = 1.0f / (_weight * OneValue(_dt));
-    for (int i = 0; i < _nchan; i++) result[i] = float(_result[i] * scale);
-
-    // clear temp result
-    _result = 0;
+    float scale = 1.0f / (ctx.weight * OneValue(_dt));
+    for (int i = 0; i < ctx.nchan; i++) result[i] = float(ctx.result[i] * scale);
 }
 
 
 
 void PtexTriangleFilter::buildKernel(PtexTriangleKernel& k, float u, float v,
                                      float uw1, float vw1, float uw2, float vw2,
-                                     float width, float blur, Res faceRes)
+                                     float width, float blur, Res faceRes) const
 {
     const float sqrt3 = 1.7320508075688772f;
 
@@ -164,40 +160,40 @@ void PtexTriangleFilter::buildKernel(PtexTriangleKernel& k, float u, float v,
 }
 
 
-void PtexTriangleFilter::splitAndApply(PtexTriangleKernel& k, int faceid, const Ptex::FaceInfo& f)
+void PtexTriangleFilter::splitAndApply(Context& ctx, PtexTriangleKernel& k, int faceid, const Ptex::FaceInfo& f) const
 {
     // do we need to split? if so, split kernel and apply across edge(s)
     if (k.u1 < 0 && f.adjface(2) >= 0) {
         PtexTriangleKernel ka;
         k.splitU(ka);
-        applyAcrossEdge(ka, f, 2);
+        applyAcrossEdge(ctx, ka, f, 2);
     }
     if (k.v1 < 0 && f.adjface(0) >= 0) {
         PtexTriangleKernel ka;
         k.splitV(ka);
-        applyAcrossEdge(ka, f, 0);
+        applyAcrossEdge(ctx, ka, f, 0);
     }
     if (k.w1 < 0 && f.adjface(1) >= 0) {
         PtexTriangleKernel ka;
         k.splitW(ka);
-        applyAcrossEdge(ka, f, 1);
+        applyAcrossEdge(ctx, ka, f, 1);
     }
     // apply to local face
-    apply(k, faceid, f);
+    apply(ctx, k, faceid, f);
 }
 
 
-void PtexTriangleFilter::applyAcrossEdge(PtexTriangleKernel& k,
-                                         const Ptex::FaceInfo& f, int eid)
+void PtexTriangleFilter::applyAcrossEdge(Context& ctx, PtexTriangleKernel& k,
+                                         const Ptex::FaceInfo& f, int eid) const
 {
     int afid = f.adjface(eid), aeid = f.adjedge(eid);
     const Ptex::FaceInfo& af = _tx->getFaceInfo(afid);
     k.reorient(eid, aeid);
-    splitAndApply(k, afid, af);
+    splitAndApply(ctx, k, afid, af);
 }
 
 
-void PtexTriangleFilter::apply(PtexTriangleKernel& k, int faceid, const Ptex::FaceInfo& f)
+void PtexTriangleFilter::apply(Context& ctx, PtexTriangleKernel& k, int faceid, const Ptex::FaceInfo& f) const
 {
     // clamp kernel face (resolution and extent)
     k.clampRes(f.res);
@@ -212,16 +208,16 @@ void PtexTriangleFilter::apply(PtexTriangleKernel& k, int faceid, const Ptex::Fa
     PtexPtr<PtexFaceData> dh ( _tx->getData(faceid, k.res) );
     if (!dh) return;
 
-    if (keven.valid) applyIter(keven, dh);
-    if (kodd.valid) applyIter(kodd, dh);
+    if (keven.valid) applyIter(ctx, keven, dh);
+    if (kodd.valid) applyIter(ctx, kodd, dh);
 }
 
 
-void PtexTriangleFilter::applyIter(PtexTriangleKernelIter& k, PtexFaceData* dh)
+void PtexTriangleFilter::applyIter(Context& ctx, PtexTriangleKernelIter& k, PtexFaceData* dh) const
 {
     if (dh->isConstant()) {
-        k.applyConst(_result, (char*)dh->getData()+_firstChanOffset, _dt, _nchan);
-        _weight += k.weight;
+        k.applyConst(ctx.result, (char*)dh->getData()+ctx.firstChanOffset, _dt, ctx.nchan);
+        ctx.weight += k.weight;
     }
     else if (dh->isTiled()) {
         Ptex::Res tileres = dh->tileRes();
@@ -248,17 +244,17 @@ void PtexTriangleFilter::applyIter(PtexTriangleKernelIter& k, PtexFaceData* dh)
                 if (th) {
                     kt.weight = 0;
                     if (th->isConstant())
-                        kt.applyConst(_result, (char*)th->getData()+_firstChanOffset, _dt, _nchan);
+                        kt.applyConst(ctx.result, (char*)th->getData()+ctx.firstChanOffset, _dt, ctx.nchan);
                     else
-                        kt.apply(_result, (char*)th->getData()+_firstChanOffset, _dt, _nchan, _ntxchan);
-                    _weight += kt.weight;
+                        kt.apply(ctx.result, (char*)th->getData()+ctx.firstChanOffset, _dt, ctx.nchan, _ntxchan);
+                    ctx.weight += kt.weight;
                 }
             }
         }
     }
     else {
-        k.apply(_result, (char*)dh->getData()+_firstChanOffset, _dt, _nchan, _ntxchan);
-        _weight += k.weight;
+        k.apply(ctx.result, (char*)dh->getData()+ctx.firstChanOffset, _dt, ctx.nchan, _ntxchan);
+        ctx.weight += k.weight;
     }
 }
 
@@ -47,9 +47,8 @@ class PtexTriangleFilter : public PtexFilter
 {
  public:
     PtexTriangleFilter(PtexTexture* tx, const PtexFilter::Options& opts ) :
-        _tx(tx), _options(opts), _result(0), _weight(0),
-        _firstChanOffset(0), _nchan(0), _ntxchan(0),
-        _dt((DataType)0) {}
+        _tx(tx), _options(opts), _ntxchan(tx->numChannels()),
+        _dt(tx->dataType()) {}
     virtual void release() { delete this; }
     virtual void eval(float* result, int firstchan, int nchannels,
                       int faceid, float u, float v,
@@ -57,23 +56,28 @@ class PtexTriangleFilter : public PtexFilter
                       float width, float blur);
 
  protected:
+    // state of an evaluation, kept on the stack (rather than in the filter)
+    // so that one filter can be used by any number of threads at once
+    struct Context {
+        float* result;          // temp result
+        float weight;           // accumulated weight of data in result
+        int firstChanOffset;    // byte offset of first channel to eval
+        int nchan;              // number of channels to eval
+    };
+
     void buildKernel(PtexTriangleKernel& k, float u, float v,
                      float uw1, float vw1, float uw2, float vw2,
-                     float width, float blur, Res faceRes);
+                     float width, float blur, Res faceRes) const;
 
-    void splitAndApply(PtexTriangleKernel& k, int faceid, const Ptex::FaceInfo& f);
-    void applyAcrossEdge(PtexTriangleKernel& k, const Ptex::FaceInfo& f, int eid);
-    void apply(PtexTriangleKernel& k, int faceid, const Ptex::FaceInfo& f);
-    void applyIter(PtexTriangleKernelIter& k, PtexFaceData* dh);
+    void splitAndApply(Context& ctx, PtexTriangleKernel& k, int faceid, const Ptex::FaceInfo& f) const;
+    void applyAcrossEdge(Context& ctx, PtexTriangleKernel& k, const Ptex::FaceInfo& f, int eid) const;
+    void apply(Context& ctx, PtexTriangleKernel& k, int faceid, const Ptex::FaceInfo& f) const;
+    void applyIter(Context& ctx, PtexTriangleKernelIter& k, PtexFaceData* dh) const;
 
     virtual ~PtexTriangleFilter() {}
 
     PtexTexture* _tx;           // texture being evaluated
     Options _options;           // options
-    float* _result;             // temp result
-    float _weight;              // accumulated weight of data in _result
-    int _firstChanOffset;       // byte offset of first channel to eval
-    int _nchan;                 // number of channels to eval
     int _ntxchan;               // number of channels in texture
     DataType _dt;               // data type of texture
 };
@@ -53,6 +53,9 @@ namespace {
     void Apply(PtexTriangleKernelIter& k, float* result, void* data, int /*nChan*/, int /*nTxChan*/)
     {
         int nTxChan = nChan;
+        typedef typename PtexUtils::FilterRow<T>::Type R;
+        int maxlen = PtexUtils::max(k.u2-k.u1, 0) * nTxChan;
+        float* rowBuf = (float*) alloca(PtexUtils::FilterRow<T>::converted * maxlen * sizeof(float));
         float DDQ = 2.0f*k.A;
         for (int vi = k.v1; vi != k.v2; vi++) {
             int xw = k.rowlen - vi;
@@ -62,13 +65,15 @@ namespace {
             float V = (float)vi - k.v;
             float DQ = k.A*(2.0f*U+1.0f)+k.B*V;
             float Q = k.A*U*U + (k.B*U + k.C*V)*V;
-            T* p = static_cast<T*>(data) + (vi * k.rowlen + x1) * nTxChan;
-            T* pEnd = p + (x2-x1)*nTxChan;
+            int len = (x2-x1)*nTxChan;
+            const R* p = PtexUtils::FilterRow<T>::get(static_cast<T*>(data) + (vi * k.rowlen + x1) * nTxChan,
+                                                      len - nTxChan + nChan, rowBuf);
+            const R* pEnd = p + len;
             for (; p < pEnd; p += nTxChan) {
                 if (Q < 1.0f) {
                     float weight = gaussian(Q)*k.wscale;
                     k.weight += weight;
-                    PtexUtils::VecAccum<T,nChan>()(result, p, weight);
+                    PtexUtils::VecAccum<R,nChan>()(result, p, weight);
                 }
                 Q += DQ;
                 DQ += DDQ;
@@ -80,6 +85,9 @@ namespace {
     template<class T, int nChan>
     void ApplyS(PtexTriangleKernelIter& k, float* result, void* data, int /*nChan*/, int nTxChan)
     {
+        typedef typename PtexUtils::FilterRow<T>::Type R;
+        int maxlen = PtexUtils::max(k.u2-k.u1, 0) * nTxChan;
+        float* rowBuf = (float*) alloca(PtexUtils::FilterRow<T>::converted * maxlen * sizeof(float));
         float DDQ = 2.0f*k.A;
         for (int vi = k.v1; vi != k.v2; vi++) {
             int xw = k.rowlen - vi;
@@ -89,13 +97,15 @@ namespace {
             float V = (float)vi - k.v;
             float DQ = k.A*(2.0f*U+1.0f)+k.B*V;
             float Q = k.A*U*U + (k.B*U + k.C*V)*V;
-            T* p = static_cast<T*>(data) + (vi * k.rowlen + x1) * nTxChan;
-            T* pEnd = p + (x2-x1)*nTxChan;
+            int len = (x2-x1)*nTxChan;
+            const R* p = PtexUtils::FilterRow<T>::get(static_cast<T*>(data) + (vi * k.rowlen + x1) * nTxChan,
+                                                      len - nTxChan + nChan, rowBuf);
+            const R* pEnd = p + len;
             for (; p < pEnd; p += nTxChan) {
                 if (Q < 1.0f) {
                     float weight = gaussian(Q)*k.wscale;
                     k.weight += weight;
-                    PtexUtils::VecAccum<T,nChan>()(result, p, weight);
+                    PtexUtils::VecAccum<R,nChan>()(result, p, weight);
                 }
                 Q += DQ;
                 DQ += DDQ;
@@ -107,6 +117,9 @@ namespace {
     template<class T>
     void ApplyN(PtexTriangleKernelIter& k, float* result, void* data, int nChan, int nTxChan)
     {
+        typedef typename PtexUtils::FilterRow<T>::Type R;
+        int maxlen = PtexUtils::max(k.u2-k.u1, 0) * nTxChan;
+        float* rowBuf = (float*) alloca(PtexUtils::FilterRow<T>::converted * maxlen * sizeof(float));
         float DDQ = 2.0f*k.A;
         for (int vi = k.v1; vi != k.v2; vi++) {
             int xw = k.rowlen - vi;
@@ -116,13 +129,15 @@ namespace {
             float V = (float)vi - k.v;
             float DQ = k.A*(2.0f*U+1.0f)+k.B*V;
             float Q = k.A*U*U + (k.B*U + k.C*V)*V;
-            T* p = static_cast<T*>(data) + (vi * k.rowlen + x1) * nTxChan;
-            T* pEnd = p + (x2-x1)*nTxChan;
+            int len = (x2-x1)*nTxChan;
+            const R* p = PtexUtils::FilterRow<T>::get(static_cast<T*>(data) + (vi * k.rowlen + x1) * nTxChan,
+                                                      len - nTxChan + nChan, rowBuf);
+            const R* pEnd = p + len;
             for (; p < pEnd; p += nTxChan) {
                 if (Q < 1.0f) {
                     float weight = gaussian(Q)*k.wscale;
                     k.weight += weight;
-                    PtexUtils::VecAccumN<T>()(result, p, nChan, weight);
+                    PtexUtils::VecAccumN<R>()(result, p, nChan, weight);
                 }
                 Q += DQ;
                 DQ += DDQ;
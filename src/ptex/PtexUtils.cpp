@@ -40,6 +40,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <string.h>
 
 #include "PtexHalf.h"
+#include "PtexSIMD.h"
 #include "PtexUtils.h"
 
 
@@ -104,6 +105,36 @@ const char* MetaDataTypeName(MetaDataType mdt)
 }
 
 
+const char* FaceCodecName(FaceCodec fc)
+{
+    static const char* names[] = { "zlib", "lz4" };
+    const int codec = static_cast<int>(fc);
+    if (codec < 0 || codec >= int(sizeof(names)/sizeof(const char*)))
+        return "(invalid face codec)";
+    return names[codec];
+}
+
+
+const char* SimdLevelName(SimdLevel level)
+{
+    static const char* names[] = { "none", "sse4.1", "avx2" };
+    const int lvl = static_cast<int>(level);
+    if (lvl < 0 || lvl >= int(sizeof(names)/sizeof(const char*)))
+        return "(invalid simd level)";
+    return names[lvl];
+}
+
+
+const char* ZipBackendName(ZipBackend zb)
+{
+    static const char* names[] = { "zlibstream", "zlib", "libdeflate" };
+    const int backend = static_cast<int>(zb);
+    if (backend < 0 || backend >= int(sizeof(names)/sizeof(const char*)))
+        return "(invalid zip backend)";
+    return names[backend];
+}
+
+
 namespace {
     template<typename DST, typename SRC>
     void ConvertArrayClamped(DST* dst, SRC* src, int numChannels, float scale, float round=0)
@@ -122,10 +153,16 @@ namespace {
 
 void ConvertToFloat(float* dst, const void* src, DataType dt, int numChannels)
 {
+    // vector kernels aren't worth calling for a few values
+    PtexSIMD::ToFloatFn* fn = numChannels >= 16 ? PtexSIMD::toFloatFn(dt) : 0;
+    if (fn) {
+        fn(dst, src, numChannels);
+        return;
+    }
     switch (dt) {
     case dt_uint8:  ConvertArray(dst, static_cast<const uint8_t*>(src),  numChannels, 1.f/255.f); break;
     case dt_uint16: ConvertArray(dst, static_cast<const uint16_t*>(src), numChannels, 1.f/65535.f); break;
-    case dt_half:   ConvertArray(dst, static_cast<const PtexHalf*>(src), numChannels, 1.f); break;
+    case dt_half:   PtexHalf::toFloat(dst, static_cast<const PtexHalf*>(src), numChannels); break;
     case dt_float:  memcpy(dst, src, sizeof(float)*numChannels); break;
     }
 }
@@ -133,15 +170,99 @@ void ConvertToFloat(float* dst, const void* src, DataType dt, int numChannels)
 
 void ConvertFromFloat(void* dst, const float* src, DataType dt, int numChannels)
 {
+    PtexSIMD::FromFloatFn* fn = numChannels >= 16 ? PtexSIMD::fromFloatFn(dt) : 0;
+    if (fn) {
+        fn(dst, src, numChannels);
+        return;
+    }
     switch (dt) {
     case dt_uint8:  ConvertArrayClamped(static_cast<uint8_t*>(dst),  src, numChannels, 255.0, 0.5); break;
     case dt_uint16: ConvertArrayClamped(static_cast<uint16_t*>(dst), src, numChannels, 65535.0, 0.5); break;
-    case dt_half:   ConvertArray(static_cast<PtexHalf*>(dst), src, numChannels, 1.0); break;
+    case dt_half:   PtexHalf::fromFloat(static_cast<PtexHalf*>(dst), src, numChannels); break;
     case dt_float:  memcpy(dst, src, sizeof(float)*numChannels); break;
     }
 }
 
 
+namespace {
+    // clamp the channel range to the pixel; returns false if it's empty
+    bool channelRange(int numChannels, int& firstChan, int& nChannels)
+    {
+        if (firstChan < 0 || firstChan >= numChannels) return false;
+        if (nChannels < 0 || nChannels > numChannels - firstChan) nChannels = numChannels - firstChan;
+        return nChannels > 0;
+    }
+}
+
+
+void ConvertToFloat(float* dst, int dstride, const void* src, int sstride,
+                    int uw, int vw, DataType dt, int numChannels,
+                    int firstChan, int nChannels)
+{
+    if (uw <= 0 || vw <= 0 || !channelRange(numChannels, firstChan, nChannels)) return;
+    int size = DataSize(dt);
+    int rowlen = uw * numChannels * size, dstrowlen = uw * nChannels * int(sizeof(float));
+    if (!sstride) sstride = rowlen;
+    if (!dstride) dstride = dstrowlen;
+    const char* s = static_cast<const char*>(src);
+    char* d = reinterpret_cast<char*>(dst);
+
+    if (nChannels == numChannels) {
+        // all channels: convert whole rows, or the whole block if packed
+        if (sstride == rowlen && dstride == dstrowlen) {
+            ConvertToFloat(dst, src, dt, uw * vw * numChannels);
+            return;
+        }
+        for (int v = 0; v < vw; v++, s += sstride, d += dstride)
+            ConvertToFloat(reinterpret_cast<float*>(d), s, dt, uw * numChannels);
+        return;
+    }
+
+    // channel subset: convert whole rows, then copy out the channels
+    std::vector<float> row(uw * numChannels);
+    for (int v = 0; v < vw; v++, s += sstride, d += dstride) {
+        ConvertToFloat(&row[0], s, dt, uw * numChannels);
+        float* dp = reinterpret_cast<float*>(d);
+        for (int u = 0; u < uw; u++, dp += nChannels)
+            memcpy(dp, &row[u * numChannels + firstChan], nChannels * sizeof(float));
+    }
+}
+
+
+void ConvertFromFloat(void* dst, int dstride, const float* src, int sstride,
+                      int uw, int vw, DataType dt, int numChannels,
+                      int firstChan, int nChannels)
+{
+    if (uw <= 0 || vw <= 0 || !channelRange(numChannels, firstChan, nChannels)) return;
+    int size = DataSize(dt), pixelsize = numChannels * size;
+    int rowlen = uw * pixelsize, srcrowlen = uw * nChannels * int(sizeof(float));
+    if (!sstride) sstride = srcrowlen;
+    if (!dstride) dstride = rowlen;
+    const char* s = reinterpret_cast<const char*>(src);
+    char* d = static_cast<char*>(dst);
+
+    if (nChannels == numChannels) {
+        if (sstride == srcrowlen && dstride == rowlen) {
+            ConvertFromFloat(dst, src, dt, uw * vw * numChannels);
+            return;
+        }
+        for (int v = 0; v < vw; v++, s += sstride, d += dstride)
+            ConvertFromFloat(d, reinterpret_cast<const float*>(s), dt, uw * nChannels);
+        return;
+    }
+
+    // channel subset: convert whole rows, then copy in the channels
+    int chansize = nChannels * size;
+    std::vector<char> row(uw * chansize);
+    for (int v = 0; v < vw; v++, s += sstride, d += dstride) {
+        ConvertFromFloat(&row[0], reinterpret_cast<const float*>(s), dt, uw * nChannels);
+        char* dp = d + firstChan * size;
+        for (int u = 0; u < uw; u++, dp += pixelsize)
+            memcpy(dp, &row[u * chansize], chansize);
+    }
+}
+
+
 namespace PtexUtils {
 
 bool isConstant(const void* data, int stride, int ures, int vres,
@@ -189,6 +310,20 @@ namespace {
 void interleave(const void* src, int sstride, int uw, int vw,
                 void* dst, int dstride, DataType dt, int nchan)
 {
+    int size = DataSize(dt);
+    if (PtexSIMD::InterleaveFn* fn = PtexSIMD::interleaveFn(size, nchan)) {
+        int planestride = sstride * vw;
+        if (sstride == uw * size && dstride == uw * size * nchan) {
+            // rows are contiguous, process as a single row
+            fn(src, planestride, dst, uw * vw);
+        }
+        else {
+            for (int v = 0; v < vw; v++)
+                fn((const char*) src + v * sstride, planestride, (char*) dst + v * dstride, uw);
+        }
+        return;
+    }
+
     switch (dt) {
     case dt_uint8:     interleave((const uint8_t*) src, sstride, uw, vw,
                                   (uint8_t*) dst, dstride, nchan); break;
@@ -226,6 +361,20 @@ namespace {
 void deinterleave(const void* src, int sstride, int uw, int vw,
                   void* dst, int dstride, DataType dt, int nchan)
 {
+    int size = DataSize(dt);
+    if (PtexSIMD::DeinterleaveFn* fn = PtexSIMD::deinterleaveFn(size, nchan)) {
+        int planestride = dstride * vw;
+        if (dstride == uw * size && sstride == uw * size * nchan) {
+            // rows are contiguous, process as a single row
+            fn(src, dst, planestride, uw * vw);
+        }
+        else {
+            for (int v = 0; v < vw; v++)
+                fn((const char*) src + v * sstride, (char*) dst + v * dstride, planestride, uw);
+        }
+        return;
+    }
+
     switch (dt) {
     case dt_uint8:     deinterleave((const uint8_t*) src, sstride, uw, vw,
                                     (uint8_t*) dst, dstride, nchan); break;
@@ -250,6 +399,13 @@ namespace {
 
 void encodeDifference(void* data, int size, DataType dt)
 {
+    if (dt == dt_uint8 || dt == dt_uint16) {
+        if (PtexSIMD::DifferenceFn* fn = PtexSIMD::encodeDifferenceFn(DataSize(dt))) {
+            fn(data, size);
+            return;
+        }
+    }
+
     switch (dt) {
     case dt_uint8:    encodeDifference(static_cast<uint8_t*>(data), size); break;
     case dt_uint16:   encodeDifference(static_cast<uint16_t*>(data), size); break;
@@ -270,6 +426,13 @@ namespace {
 
 void decodeDifference(void* data, int size, DataType dt)
 {
+    if (dt == dt_uint8 || dt == dt_uint16) {
+        if (PtexSIMD::DifferenceFn* fn = PtexSIMD::decodeDifferenceFn(DataSize(dt))) {
+            fn(data, size);
+            return;
+        }
+    }
+
     switch (dt) {
     case dt_uint8:    decodeDifference(static_cast<uint8_t*>(data), size); break;
     case dt_uint16:   decodeDifference(static_cast<uint16_t*>(data), size); break;
@@ -299,6 +462,11 @@ namespace {
 void reduce(const void* src, int sstride, int uw, int vw,
             void* dst, int dstride, DataType dt, int nchan)
 {
+    if (PtexSIMD::ReduceFn* fn = PtexSIMD::reduceFn(PtexSIMD::reduce_uv, dt, nchan)) {
+        fn(src, sstride, uw, vw, dst, dstride, nchan);
+        return;
+    }
+
     switch (dt) {
     case dt_uint8:     reduce(static_cast<const uint8_t*>(src), sstride, uw, vw,
                               static_cast<uint8_t*>(dst), dstride, nchan); break;
@@ -333,6 +501,11 @@ namespace {
 void reduceu(const void* src, int sstride, int uw, int vw,
              void* dst, int dstride, DataType dt, int nchan)
 {
+    if (PtexSIMD::ReduceFn* fn = PtexSIMD::reduceFn(PtexSIMD::reduce_u, dt, nchan)) {
+        fn(src, sstride, uw, vw, dst, dstride, nchan);
+        return;
+    }
+
     switch (dt) {
     case dt_uint8:     reduceu(static_cast<const uint8_t*>(src), sstride, uw, vw,
                                static_cast<uint8_t*>(dst), dstride, nchan); break;
@@ -366,6 +539,11 @@ namespace {
 void reducev(const void* src, int sstride, int uw, int vw,
              void* dst, int dstride, DataType dt, int nchan)
 {
+    if (PtexSIMD::ReduceFn* fn = PtexSIMD::reduceFn(PtexSIMD::reduce_v, dt, nchan)) {
+        fn(src, sstride, uw, vw, dst, dstride, nchan);
+        return;
+    }
+
     switch (dt) {
     case dt_uint8:     reducev(static_cast<const uint8_t*>(src), sstride, uw, vw,
                                static_cast<uint8_t*>(dst), dstride, nchan); break;
@@ -406,6 +584,11 @@ namespace {
 void reduceTri(const void* src, int sstride, int w, int /*vw*/,
                void* dst, int dstride, DataType dt, int nchan)
 {
+    if (PtexSIMD::ReduceFn* fn = PtexSIMD::reduceFn(PtexSIMD::reduce_tri, dt, nchan)) {
+        fn(src, sstride, w, 0, dst, dstride, nchan);
+        return;
+    }
+
     switch (dt) {
     case dt_uint8:     reduceTri(static_cast<const uint8_t*>(src), sstride, w, 0,
                                  static_cast<uint8_t*>(dst), dstride, nchan); break;
@@ -274,6 +274,28 @@ struct VecMultN {
     }
 };
 
+// row of n values for the filter kernels: half data is converted to float
+// in bulk (into buf, which must hold n floats when converted), which is
+// much faster than converting each value; other types are used as they are.
+// Only the channels used from the last pixel may be read, as data can start
+// at a channel offset within the pixel.
+template<typename T>
+struct FilterRow {
+    typedef T Type;
+    enum { converted = 0 };
+    static const T* get(const T* p, int /*n*/, float* /*buf*/) { return p; }
+};
+template<>
+struct FilterRow<PtexHalf> {
+    typedef float Type;
+    enum { converted = 1 };
+    static const float* get(const PtexHalf* p, int n, float* buf)
+    {
+        PtexHalf::toFloat(buf, p, n);
+        return buf;
+    }
+};
+
 typedef void (*ApplyConstFn)(float weight, float* dst, void* data, int nChan);
 extern ApplyConstFn applyConstFunctions[20];
 inline void applyConst(float weight, float* dst, void* data, Ptex::DataType dt, int nChan)
@@ -73,6 +73,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 
 #include "Ptexture.h"
 #include "PtexUtils.h"
+#include "PtexCodec.h"
 #include "PtexWriter.h"
 
 PTEX_NAMESPACE_BEGIN
@@ -268,7 +269,10 @@ PtexWriterBase::PtexWriterBase(const char* path,
                                bool compress)
     : _ok(true),
       _path(path),
-      _tilefp(0)
+      _tilefp(0),
+      _compress(compress),
+      _faceCodec(fc_zlib),
+      _hasLz4(false)
 {
     memset(&_header, 0, sizeof(_header));
     _header.magic = Magic;
@@ -514,6 +518,12 @@ int PtexWriterBase::writeBlock(FILE* fp, const void* data, int size)
 int PtexWriterBase::writeZipBlock(FILE* fp, const void* data, int size, bool finishArg)
 {
     if (!_ok) return 0;
+    if (finishArg && _zstream.total_in == 0) {
+        // compress whole block at once if the zip backend supports it
+        std::vector<char> zipdata;
+        int zipsize = PtexCodec::deflateBlock(zipdata, data, size, _compress);
+        if (zipsize >= 0) return writeBlock(fp, &zipdata[0], zipsize);
+    }
     void* buff = alloca(BlockSize);
     _zstream.next_in = (Bytef*) const_cast<void*>(data);
     _zstream.avail_in = size;
@@ -622,7 +632,14 @@ void PtexWriterBase::writeFaceBlock(FILE* fp, const void* data, int stride,
     if (diff) PtexUtils::encodeDifference(buff, blockSize, datatype());
 
     // compress and stream data to file, and record size in header
-    int zippedsize = writeZipBlock(fp, buff, blockSize);
+    int zippedsize;
+    if (_faceCodec == fc_lz4) {
+        std::vector<char> zipdata;
+        int zipsize = PtexCodec::compressLz4(zipdata, buff, blockSize);
+        zippedsize = writeBlock(fp, &zipdata[0], zipsize);
+        _hasLz4 = true;
+    }
+    else zippedsize = writeZipBlock(fp, buff, blockSize);
 
     // record compressed size and encoding in data header
     fdh.set(zippedsize, diff ? enc_diffzipped : enc_zipped);
@@ -765,6 +782,9 @@ PtexMainWriter::PtexMainWriter(const char* path, PtexTexture* tex,
         // copy edge filter mode
         setEdgeFilterMode(tex->edgeFilterMode());
 
+        // keep face codec
+        if (_reader->extheader().facecodec == fc_lz4) setFaceCodec(fc_lz4);
+
         // copy meta data from existing file
         PtexPtr<PtexMetaData> meta ( _reader->getMetaData() );
         writeMeta(meta);
@@ -984,6 +1004,10 @@ void PtexMainWriter::finish()
 
     // update extheader for edit data position
     _extheader.editdatapos = ftello(newfp);
+    _extheader.facecodec = _faceCodec;
+
+    // files with lz4 data can't be read by older versions
+    if (_hasLz4) _header.minorversion = Lz4MinorVersion;
 
     // rewrite level info block
     fseeko(newfp, levelInfoPos, SEEK_SET);
@@ -1413,6 +1437,13 @@ void PtexIncrWriter::finish()
     // write meta data edit block (if any)
     if (!_metadata.empty()) writeMetaDataEdit();
 
+    // files with lz4 data can't be read by older versions
+    if (_hasLz4 && _header.minorversion < Lz4MinorVersion) {
+        _header.minorversion = Lz4MinorVersion;
+        fseeko(_fp, 0, SEEK_SET);
+        fwrite(&_header, HeaderSize, 1, _fp);
+    }
+
     // rewrite extheader for updated editdatasize
     if (_extheader.editdatapos) {
         _extheader.editdatasize = uint64_t(ftello(_fp)) - _extheader.editdatapos;
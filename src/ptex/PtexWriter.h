@@ -67,6 +67,10 @@ public:
     virtual void writeMeta(PtexMetaData* data);
     virtual bool close(Ptex::String& error);
     virtual void release();
+    virtual void setFaceCodec(Ptex::FaceCodec faceCodec)
+    {
+        _faceCodec = faceCodec;
+    }
 
     bool ok(Ptex::String& error) {
         if (!_ok) getError(error);
@@ -121,6 +125,9 @@ protected:
     std::vector<MetaEntry> _metadata;        // meta data waiting to be written
     std::map<std::string,int> _metamap;      // for preventing duplicate keys
     z_stream_s _zstream;                     // libzip compression stream
+    bool _compress;                          // true if data should be compressed
+    Ptex::FaceCodec _faceCodec;              // codec for face data blocks
+    bool _hasLz4;                            // true if any face data was written with lz4
 
     PtexUtils::ReduceFn* _reduceFn;
 };
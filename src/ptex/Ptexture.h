@@ -108,6 +108,35 @@ enum MetaDataType {
     mdt_double		///< Double-precision (32-bit) floating point.
 };
 
+/** Implementation used to compress and decompress zip blocks.
+    All backends read and write the same (zlib) format. */
+enum ZipBackend {
+    zb_zlibStream,	///< zlib, decompressing data not already in memory in small chunks.
+    zb_zlib,		///< zlib, decompressing whole blocks at once.
+    zb_libdeflate	///< libdeflate, whole blocks at once (only if built with libdeflate).
+};
+
+/** SIMD instruction set used for data conversion kernels.  Levels are
+    cumulative; the highest level supported by the cpu is used by default. */
+enum SimdLevel {
+    simd_none,		///< Portable scalar code only.
+    simd_sse41,		///< SSE4.1.
+    simd_avx2		///< AVX2 (and F16C).
+};
+
+/** Codec used to compress face data. */
+enum FaceCodec {
+    fc_zlib,		///< zlib (deflate), readable by all library versions.
+    fc_lz4		///< LZ4, several times faster to decode but larger.  Requires file version 1.5 support.
+};
+
+/** Policy used by PtexCache to choose which face data to free when over its memory limit. */
+enum CachePolicy {
+    cp_recency,		///< Free data that hasn't been used recently.
+    cp_frequency	///< Also weigh how often data is used, so that data used only once
+                        ///< (e.g. by a pass over every face) doesn't displace frequently used data.
+};
+
 /** Look up name of given mesh type. */
 PTEXAPI const char* MeshTypeName(MeshType mt);
 
@@ -126,6 +155,33 @@ PTEXAPI const char* EdgeIdName(EdgeId eid);
 /** Look up name of given meta data type. */
 PTEXAPI const char* MetaDataTypeName(MetaDataType mdt);
 
+/** Look up name of given face codec. */
+PTEXAPI const char* FaceCodecName(FaceCodec fc);
+
+/** Look up name of given zip backend. */
+PTEXAPI const char* ZipBackendName(ZipBackend zb);
+
+/** Select the zip backend used by all readers and writers.  The default
+    is libdeflate if available, otherwise zlib, and can be overridden by
+    setting $PTEX_ZIP_BACKEND to a backend name.  Returns false (and
+    leaves the backend unchanged) if the backend isn't available. */
+PTEXAPI bool SetZipBackend(ZipBackend zb);
+
+/** Get the current zip backend. */
+PTEXAPI ZipBackend GetZipBackend();
+
+/** Look up name of given simd level. */
+PTEXAPI const char* SimdLevelName(SimdLevel level);
+
+/** Select the simd level used by all readers, writers, and filters.  The
+    default is the highest level supported by the cpu, and can be
+    overridden by setting $PTEX_SIMD to a level name.  Returns false (and
+    leaves the level unchanged) if the level isn't supported. */
+PTEXAPI bool SetSimdLevel(SimdLevel level);
+
+/** Get the current simd level. */
+PTEXAPI SimdLevel GetSimdLevel();
+
 /** Look up size of given data type (in bytes). */
 inline int DataSize(DataType dt) {
     static const int sizes[] = { 1,2,2,4 };
@@ -152,6 +208,26 @@ PTEXAPI void ConvertToFloat(float* dst, const void* src,
 PTEXAPI void ConvertFromFloat(void* dst, const float* src,
                               Ptex::DataType dt, int numChannels);
 
+/** Convert a block of pixels (such as a whole face or tile) from the
+    given data type to float.  Each of the vw rows of src has uw pixels
+    of numChannels values, and the rows are sstride bytes apart.
+    Channels firstChan to firstChan+nChannels-1 of each pixel are
+    written to dst as pixels of nChannels floats, with rows dstride
+    bytes apart.  A stride of 0 means the rows are packed, and a
+    negative nChannels means all the channels from firstChan on. */
+PTEXAPI void ConvertToFloat(float* dst, int dstride, const void* src, int sstride,
+                            int uw, int vw, Ptex::DataType dt, int numChannels,
+                            int firstChan=0, int nChannels=-1);
+
+/** Convert a block of pixels from float to the given data type, the
+    reverse of the block ConvertToFloat.  Pixels of nChannels floats from
+    src are written to channels firstChan to firstChan+nChannels-1 of the
+    pixels of numChannels values in dst; the other channels in dst are
+    left as they are. */
+PTEXAPI void ConvertFromFloat(void* dst, int dstride, const float* src, int sstride,
+                              int uw, int vw, Ptex::DataType dt, int numChannels,
+                              int firstChan=0, int nChannels=-1);
+
 /** Pixel resolution of a given texture.
     The resolution is stored in log form: ulog2 = log2(ures), vlog2 = log2(vres)).
     Note: negative ulog2 or vlog2 values are reserved for internal use.
@@ -606,6 +682,31 @@ class PtexTexture {
     virtual void getPixel(int faceid, int u, int v,
                           float* result, int firstchan, int nchannels,
                           Ptex::Res res) = 0;
+
+    /** Access texture data for many faces at once.
+
+        This is equivalent to calling getData(faceid, buffer, stride, res)
+        for each face, but the implementation may read the faces in file
+        order and combine the reads of adjacent faces which is
+        considerably faster when reading many faces of a file.
+
+        @param nfaces Number of faces
+        @param faceids Face indices [0..numFaces-1]
+        @param buffers User-supplied buffer for each face
+        @param strides Row stride for each buffer (see getData()).  If null,
+        all strides are zero.
+        @param res Resolution for each face.  If null, faces are accessed
+        at their highest resolution.
+     */
+    virtual void getData(int nfaces, const int* faceids, void* const* buffers,
+                         const int* strides, const Ptex::Res* res)
+    {
+        for (int i = 0; i < nfaces; i++) {
+            int stride = strides ? strides[i] : 0;
+            if (res) getData(faceids[i], buffers[i], stride, res[i]);
+            else getData(faceids[i], buffers[i], stride);
+        }
+    }
 };
 
 
@@ -615,6 +716,12 @@ class PtexTexture {
     A custom instance of this class can be defined and supplied to the PtexCache class.
     Files accessed through the cache will have their input streams redirected through this
     interface.
+
+    When no handler is supplied, files on local filesystems are memory-mapped (unless
+    Ptex is built with PTEX_USE_MMAP=OFF).  Files on network filesystems are read with
+    buffered stdio instead, since a mapped file that is truncated or replaced raises
+    SIGBUS when read.  Local files must likewise not be truncated or rewritten in place
+    while open; replacing them by renaming a new file into place is safe.
  */
 class PtexInputHandler {
  protected:
@@ -645,6 +752,24 @@ class PtexInputHandler {
 
     /** Return the last error message encountered. */
     virtual const char* lastError() = 0;
+
+    /** Read a number of bytes starting at an absolute byte position.
+
+        Unlike seek() and read(), this must neither depend on nor
+        modify the stream position, and it must be safe to call from
+        multiple threads at once with the same handle.  Handlers that
+        implement this must also override supportsReadAt() to return
+        true, in which case the reader will use it exclusively and
+        different faces of the same file can be read and decompressed
+        concurrently.
+
+        Returns the number of bytes successfully read.
+    */
+    virtual size_t readAt(void* /*buffer*/, size_t /*size*/, int64_t /*pos*/, Handle /*handle*/)
+    { return 0; }
+
+    /** True if the handler implements readAt(). */
+    virtual bool supportsReadAt() { return false; }
 };
 
 
@@ -664,6 +789,30 @@ class PtexErrorHandler {
 };
 
 
+/**
+   @class PtexPrefetch
+   @brief Handle for an asynchronous prefetch request
+
+   Returned by PtexCache::prefetch.  Releasing the handle does not
+   cancel the request.
+ */
+class PtexPrefetch {
+ protected:
+    /// Destructor not for public use.  Use release() instead.
+    virtual ~PtexPrefetch() {}
+
+ public:
+    /// Release the handle (pointer becomes invalid).
+    virtual void release() = 0;
+
+    /** True if all of the requested face data has been loaded. */
+    virtual bool isDone() = 0;
+
+    /** Block until all of the requested face data has been loaded. */
+    virtual void wait() = 0;
+};
+
+
 /**
    @class PtexCache
    @brief File-handle and memory cache for reading ptex files
@@ -788,6 +937,145 @@ class PtexCache {
 
     /** Get stats. */
     virtual void getStats(Stats& stats) = 0;
+
+    /** Stats for the optional cache tiers.  Unlike Stats, this struct
+        may grow; fields are only filled in if the caller was compiled
+        with them. */
+    struct TierStats {
+        int __structSize;               ///< (for internal use only)
+        uint64_t blockCacheMemUsed;     ///< Memory used by compressed face data (see setBlockCacheSize)
+        uint64_t blockCacheHits;        ///< Face data decompressed without reading the file
+        uint64_t sharedCacheHits;       ///< Face data found in the shared cache (see setSharedCache)
+        uint64_t diskCacheHits;         ///< Face data read from the disk cache (see setDiskCache)
+
+        TierStats() : __structSize(sizeof(TierStats)), blockCacheMemUsed(0), blockCacheHits(0),
+                      sharedCacheHits(0), diskCacheHits(0) {}
+    };
+
+    /** Asynchronously load face data into the cache.
+
+        The texture is opened (if needed) in the calling thread and
+        the face data are then read and decompressed by the cache's
+        worker threads.  Subsequent calls to PtexTexture::getData for
+        the same faces and resolutions will find the data already
+        loaded.  For tiled faces, all tiles are loaded.  Note: as with
+        any cached data, prefetched data may be pruned before use if
+        the cache memory limit is exceeded.
+
+        @param path File path (as passed to get()).
+
+        @param nfaces Number of faces to load.
+
+        @param faceids Face ids to load.
+
+        @param res Resolution to load for each face.  If null, faces are
+        loaded at full resolution.
+
+        @return A handle that can be used to wait for or query
+        completion, or null if the texture could not be opened (the
+        error is reported through the error handler).  The handle must
+        be released.
+     */
+    virtual PtexPrefetch* prefetch(const char* path, int nfaces, const int* faceids,
+                                   const Ptex::Res* res=0) = 0;
+
+    /** Set the number of worker threads used for asynchronous requests
+        such as prefetch.  The default is 2.  If zero, requests are
+        completed synchronously in the calling thread.  Changing the
+        number of threads waits for any outstanding requests to finish.
+     */
+    virtual void setNumWorkerThreads(int numThreads) = 0;
+
+    /** Enable loading the tiles of large (tiled) faces in parallel.  When
+        enabled, PtexTexture::getData into a buffer decompresses the tiles
+        of a face using the cache's worker threads as well as the calling
+        thread and copies them directly into the buffer.  Has no effect if
+        the number of worker threads is zero.  The default is disabled.
+     */
+    virtual void setParallelTileLoading(bool enable) = 0;
+
+    /** Set a directory for caching the decoded file info of textures
+        (face info, constant data and level headers).  Files with many
+        faces (at least 256) can then be opened without decoding this info
+        again, including by other processes sharing the directory.  Entries are
+        keyed by file path, size and modification time; stale entries are
+        ignored and replaced.  Only used with the default input handler and
+        for files first accessed after the call.  If null or empty (the
+        default), no file info is cached.
+     */
+    virtual void setIndexCachePath(const char* path) = 0;
+
+    /** Set the size of the speculative read made when a file is opened.
+        The file info (headers, face info, constant data and level
+        headers) is usually at the start of the file, so reading this
+        much at once normally opens a file with a single read; if the
+        info is larger, the rest is read with one more read sized from
+        the header.  Larger sizes suit files with many faces on storage
+        where each read is expensive (e.g. NFS).  Only used for files
+        read (without memory mapping) by the default input handler, where
+        the read can be limited to the file size; other handlers read the
+        header first.  Zero disables the speculative read.  The default
+        is 64KB, and the size is limited to 16MB.  Applies to files first
+        accessed after the call.
+     */
+    virtual void setOpenReadSize(size_t size) = 0;
+
+    /** Set the policy for choosing which face data to free when the
+        memory limit is exceeded.  The default is cp_recency.  With
+        cp_frequency, data that has been used only once since it was
+        loaded is freed first, which protects frequently used data from
+        passes that stream through every face of many textures.
+     */
+    virtual void setCachePolicy(Ptex::CachePolicy policy) = 0;
+
+    /** Set the memory limit for compressed face data.  When non-zero,
+        the compressed blocks of faces and tiles read from files are kept
+        (in lru order, within this limit and separate from maxMem) so that
+        face data freed to stay within maxMem can be decompressed again
+        without reading the file.  Compressed data is typically several
+        times smaller than decoded data, which makes this worthwhile when
+        reads are expensive, e.g. from network storage.  Files memory
+        mapped by the default input handler don't use it.  The default is
+        zero (disabled).
+     */
+    virtual void setBlockCacheSize(size_t maxMem) = 0;
+
+    /** Share decoded face data with other processes through the named
+        shared memory segment, creating it with the given size if it
+        doesn't exist.  Faces loaded by any process using the segment are
+        used in place by the others instead of being read and decoded
+        again, so the node holds one copy of each face rather than one
+        per process.  Faces used in place still count toward each
+        process's maxMem (which limits how much of the segment each
+        process keeps in use), and are copied instead when the segment
+        has no room or more than 64 caches are attached.  Data in the
+        segment outlives the processes (until the segment is removed,
+        e.g. with shm_unlink).  The segment is only
+        accessible by the user that created it, and an existing segment
+        owned by another user, or accessible by others, is rejected.
+        Must be called before any files are opened.  Only files read by
+        the default input handler are shared.  Returns false, with an
+        error, if the segment can't be used.  Not supported on Windows or
+        macOS: the segment's lock must be recoverable when a process dies
+        holding it, which needs robust mutexes.
+     */
+    virtual bool setSharedCache(const char* name, size_t size, Ptex::String& error) = 0;
+
+    /** Set a local directory (which must exist) for a persistent cache
+        of decoded face data, limited to maxSize bytes.  Faces loaded from
+        files are also written there, and are read back from there
+        (instead of being read from the file and decoded) by later opens
+        and runs, until the file changes size or modification time.  This
+        is intended for textures on network storage.  Least recently used
+        data is deleted to stay within the limit.  The directory may be
+        shared by several processes.  Only files read by the default
+        input handler, and opened after this is set, are cached.  An
+        empty path disables the cache.
+     */
+    virtual void setDiskCache(const char* path, size_t maxSize) = 0;
+
+    /** Get stats for the optional cache tiers. */
+    virtual void getTierStats(TierStats& stats) = 0;
 };
 
 
@@ -922,6 +1210,11 @@ class PtexWriter {
     virtual bool writeFaceReduction(int faceid, const Ptex::Res& res, const void* data, int stride=0) = 0;
     virtual bool writeConstantFaceReduction(int faceid, const Ptex::Res& res, const void* data) = 0;
 #endif
+
+    /** Set the codec used to compress face data written after this call.
+        The default is fc_zlib, or the codec of the existing file when
+        editing.  Files can contain data written with different codecs. */
+    virtual void setFaceCodec(Ptex::FaceCodec faceCodec) = 0;
 };
 
 
@@ -932,7 +1225,8 @@ class PtexWriter {
    PtexFilter instances are obtained by calling one of the particular static methods.  When finished using
    the filter, it must be returned to the library using release().
 
-   To apply the filter to a ptex data file, use the eval() method.
+   To apply the filter to a ptex data file, use the eval() method.  Filters aren't modified by
+   evaluation, so a filter may be used by any number of threads at once.
  */
 class PtexFilter {
  protected:
@@ -959,17 +1253,37 @@ class PtexFilter {
         bool lerp;              ///< Interpolate between mipmap levels.
         float sharpness;        ///< Filter sharpness, 0..1 (for general bi-cubic filter only).
         bool noedgeblend;       ///< Disable cross-face filtering.  Useful for debugging or rendering on polys.
+        char __pad[3];          ///< (for internal use only) options added below must extend the struct size
+        bool kerneltable;       ///< Interpolate kernel weights from a precomputed table (gaussian and bi-cubic
+                                ///< filters only).  Faster; weights are within 1e-5 of the exact kernel.
 
         /// Constructor - sets defaults
-        Options(FilterType filter_=f_box, bool lerp_=0, float sharpness_=0, bool noedgeblend_=0) :
+        Options(FilterType filter_=f_box, bool lerp_=0, float sharpness_=0, bool noedgeblend_=0,
+                bool kerneltable_=0) :
             __structSize(sizeof(Options)),
-            filter(filter_), lerp(lerp_), sharpness(sharpness_), noedgeblend(noedgeblend_) {}
+            filter(filter_), lerp(lerp_), sharpness(sharpness_), noedgeblend(noedgeblend_),
+            __pad(), kerneltable(kerneltable_) {}
     };
 
     /* Construct a filter for the given texture.
     */
     PTEXAPI static PtexFilter* getFilter(PtexTexture* tx, const Options& opts);
 
+    /** Get a filter from a small cache of filters kept with the texture.
+
+        Filters can be shared by threads, so this returns the same filter
+        to every caller asking for the same texture and options, which
+        avoids creating a filter per thread or per lookup.  The filter
+        remains valid as long as the texture does (for a texture from a
+        PtexCache, until the cache is deleted), but must not be used
+        after the texture is purged from its cache: get the filter again
+        for the reopened file.  If the texture wasn't opened with
+        PtexTexture::open or a PtexCache, or the cache is full, a new
+        filter is returned, as from getFilter().  Either way, call
+        release() when done (for a cached filter it does nothing).
+    */
+    PTEXAPI static PtexFilter* getCachedFilter(PtexTexture* tx, const Options& opts);
+
     /** Release resources held by this pointer (pointer becomes invalid). */
     virtual void release() = 0;
 
@@ -997,6 +1311,40 @@ class PtexFilter {
     virtual void eval(float* result, int firstchan, int nchannels,
                       int faceid, float u, float v, float uw1, float vw1, float uw2, float vw2,
                       float width=1, float blur=0) = 0;
+
+    /** Apply filter to a batch of n lookups.
+
+        Each lookup gives the same result as calling eval() with the
+        corresponding array elements.  The lookup parameters are separate
+        arrays of n values each, and the results are stored one channel
+        after another: channel c of lookup i is written to result[c*n+i].
+        Where eval() would leave a result unchanged (e.g. for an invalid
+        face id) the corresponding elements are left unchanged.
+
+        Filters may sort lookups by face internally, hold on to face
+        data for the duration of the call, and evaluate repeated lookups
+        (or lookups on faces with a constant neighborhood) only once,
+        which is faster than calling eval() for each lookup.
+    */
+    virtual void evalMany(float* result, int firstchan, int nchannels, int n,
+                          const int* faceid, const float* u, const float* v,
+                          const float* uw1, const float* vw1, const float* uw2, const float* vw2,
+                          float width=1, float blur=0)
+    {
+        // evaluate in groups of channels and scatter into the result planes
+        const int maxchan = 16;
+        float tmp[maxchan];
+        for (int c1 = 0; c1 < nchannels; c1 += maxchan) {
+            int nc = nchannels - c1 < maxchan ? nchannels - c1 : maxchan;
+            for (int i = 0; i < n; i++) {
+                float* dst = result + c1 * n + i;
+                for (int c = 0; c < nc; c++) tmp[c] = dst[c * n];
+                eval(tmp, firstchan + c1, nc, faceid[i], u[i], v[i],
+                     uw1[i], vw1[i], uw2[i], vw2[i], width, blur);
+                for (int c = 0; c < nc; c++) dst[c * n] = tmp[c];
+            }
+        }
+    }
 };
 
 
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Ptexture.h"
+#include "PtexUtils.h"
+
+// Times filter eval for the width-4 (gaussian and bi-cubic) filters with
+// exact and table-driven kernels, for random lookups on the given file
+// (default "test.ptx", as written by wtest).
+
+static const char* names[] = { "gaussian", "bicubic", "bspline", "catmullrom", "mitchell" };
+static const PtexFilter::FilterType types[] = { PtexFilter::f_gaussian, PtexFilter::f_bicubic,
+                                                PtexFilter::f_bspline, PtexFilter::f_catmullrom,
+                                                PtexFilter::f_mitchell };
+
+struct Lookup { int faceid; float u, v, uw, vw; };
+
+
+double timeFilter(PtexTexture* tx, PtexFilter::FilterType type, bool lerp, bool kerneltable,
+                  const std::vector<Lookup>& lookups, int iterations, std::vector<float>& result)
+{
+    PtexFilter::Options opts(type, lerp, 0.5f, false, kerneltable);
+    PtexPtr<PtexFilter> f(PtexFilter::getFilter(tx, opts));
+    int nchan = tx->numChannels();
+    clock_t start = clock();
+    for (int iter = 0; iter < iterations; iter++) {
+        for (size_t i = 0; i < lookups.size(); i++) {
+            const Lookup& l = lookups[i];
+            f->eval(&result[i*nchan], 0, nchan, l.faceid, l.u, l.v, l.uw, 0, 0, l.vw);
+        }
+    }
+    return double(clock() - start) / CLOCKS_PER_SEC / iterations / double(lookups.size());
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* file = "test.ptx";
+    int iterations = 20, nlookups = 100000;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i+1 < argc) iterations = atoi(argv[++i]);
+        else file = argv[i];
+    }
+    if (iterations < 1) iterations = 1;
+
+    Ptex::String error;
+    PtexPtr<PtexTexture> tx(PtexTexture::open(file, error, true));
+    if (!tx) {
+        std::cerr << error.c_str() << std::endl;
+        return 1;
+    }
+
+    // random lookups, with filter widths from a fraction of a texel up to the whole face
+    std::vector<Lookup> lookups(nlookups);
+    for (int i = 0; i < nlookups; i++) {
+        Lookup& l = lookups[i];
+        l.faceid = rand() % tx->numFaces();
+        l.u = float(rand()) / float(RAND_MAX);
+        l.v = float(rand()) / float(RAND_MAX);
+        l.uw = PtexUtils::reciprocalPow2(rand() % 10) * (0.5f + float(rand()) / float(RAND_MAX));
+        l.vw = PtexUtils::reciprocalPow2(rand() % 10) * (0.5f + float(rand()) / float(RAND_MAX));
+    }
+
+    int nchan = tx->numChannels();
+    std::vector<float> exact(nlookups * nchan), table(nlookups * nchan);
+    printf("%-10s %4s %12s %12s %8s %10s\n", "filter", "lerp", "exact (ns)", "table (ns)", "speedup", "max diff");
+    for (int t = 0; t < 5; t++) {
+        for (int lerp = 0; lerp <= 1; lerp++) {
+            double t1 = timeFilter(tx, types[t], lerp != 0, false, lookups, iterations, exact);
+            double t2 = timeFilter(tx, types[t], lerp != 0, true, lookups, iterations, table);
+            float maxdiff = 0;
+            for (size_t i = 0; i < exact.size(); i++)
+                maxdiff = PtexUtils::max(maxdiff, PtexUtils::abs(exact[i] - table[i]));
+            printf("%-10s %4d %12.1f %12.1f %8.2f %10.2g\n", names[t], lerp, t1 * 1e9, t2 * 1e9,
+                   t1 / t2, maxdiff);
+        }
+    }
+    return 0;
+}
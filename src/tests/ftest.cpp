@@ -1,10 +1,149 @@
 #include <string>
 #include <iostream>
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "Ptexture.h"
 using namespace Ptex;
 
+// batched lookups must match single lookups for every filter
+bool checkEvalMany(PtexTexture* r)
+{
+    const int n = 200;
+    int nchan = r->numChannels();
+    std::vector<int> faceid(n);
+    std::vector<float> u(n), v(n), uw1(n), vw1(n), uw2(n), vw2(n);
+    for (int i = 0; i < n; i++) {
+        // faces interleaved so that the batch has to group them
+        faceid[i] = (i * 7) % (r->numFaces() + 1) - (i % 17 == 0);
+        u[i] = float(i % 11) / 10.0f;
+        v[i] = float(i % 13) / 12.0f;
+        uw1[i] = float(i % 5) / 16.0f; vw1[i] = float(i % 3) / 64.0f;
+        uw2[i] = float(i % 2) / 64.0f; vw2[i] = float(i % 7) / 16.0f;
+        if (i % 9 == 8) {
+            // repeat an earlier lookup
+            int j = i - 1 - i % 4;
+            faceid[i] = faceid[j]; u[i] = u[j]; v[i] = v[j];
+            uw1[i] = uw1[j]; vw1[i] = vw1[j]; uw2[i] = uw2[j]; vw2[i] = vw2[j];
+        }
+    }
+    for (int ft = PtexFilter::f_point; ft <= PtexFilter::f_mitchell; ft++) {
+        PtexFilter::Options opts(PtexFilter::FilterType(ft), ft % 2 == 0, 0.5);
+        PtexPtr<PtexFilter> f ( PtexFilter::getFilter(r, opts) );
+        std::vector<float> expected(n * nchan, -1.0f), result(n * nchan, -1.0f);
+        std::vector<float> pixel(nchan);
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < nchan; c++) pixel[c] = -1.0f;
+            f->eval(&pixel[0], 0, nchan, faceid[i], u[i], v[i], uw1[i], vw1[i], uw2[i], vw2[i], 1.5f, 0.01f);
+            for (int c = 0; c < nchan; c++) expected[c * n + i] = pixel[c];
+        }
+        f->evalMany(&result[0], 0, nchan, n, &faceid[0], &u[0], &v[0],
+                    &uw1[0], &vw1[0], &uw2[0], &vw2[0], 1.5f, 0.01f);
+        if (result != expected) {
+            std::cerr << "evalMany mismatch for filter type " << ft << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// cached filters are shared for the same options and match new filters
+bool checkCachedFilters(PtexTexture* r)
+{
+    int nchan = r->numChannels();
+    std::vector<float> expected(nchan), result(nchan);
+    for (int ft = PtexFilter::f_point; ft <= PtexFilter::f_mitchell; ft++) {
+        PtexFilter::Options opts(PtexFilter::FilterType(ft), 0, 0.5);
+        PtexPtr<PtexFilter> f ( PtexFilter::getFilter(r, opts) );
+        PtexPtr<PtexFilter> cf ( PtexFilter::getCachedFilter(r, opts) );
+        PtexPtr<PtexFilter> cf2 ( PtexFilter::getCachedFilter(r, opts) );
+        if (!cf || cf.get() != cf2.get()) {
+            std::cerr << "cached filter not shared for filter type " << ft << std::endl;
+            return false;
+        }
+        // new options are defaulted for callers built with an older struct
+        struct OptionsV1 { int structSize; PtexFilter::FilterType filter; bool lerp; float sharpness; bool noedgeblend; };
+        PtexFilter::Options oldopts(PtexFilter::FilterType(ft), 0, 0.5, false, true);
+        oldopts.__structSize = int(sizeof(OptionsV1));
+        PtexPtr<PtexFilter> of ( PtexFilter::getCachedFilter(r, oldopts) );
+        if (of.get() != cf.get()) {
+            std::cerr << "new filter options not defaulted for filter type " << ft << std::endl;
+            return false;
+        }
+        for (int i = 0; i < 50; i++) {
+            int faceid = i % r->numFaces();
+            float u = float(i % 7) / 6.0f, v = float(i % 5) / 4.0f, w = float(i % 3) / 8.0f;
+            f->eval(&expected[0], 0, nchan, faceid, u, v, w, 0, 0, w);
+            cf->eval(&result[0], 0, nchan, faceid, u, v, w, 0, 0, w);
+            if (result != expected) {
+                std::cerr << "cached filter mismatch for filter type " << ft << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// cached filters made before a purge must not be returned for the new file
+bool checkCachedFiltersAfterPurge(PtexCache* c)
+{
+    const char* path = "ftestpurge.ptx";
+    float data[3] = { 0.25f, 0.5f, 0.75f };
+    Ptex::String error;
+    for (int nchan = 1; nchan <= 3; nchan += 2) {
+        PtexPtr<PtexWriter> w ( PtexWriter::open(path, mt_quad, dt_float, nchan, -1, 1, error) );
+        if (!w || !w->writeConstantFace(0, FaceInfo(Res(2, 2)), data) || !w->close(error)) {
+            std::cerr << error.c_str() << std::endl;
+            return false;
+        }
+        c->purge(path);
+        PtexPtr<PtexTexture> r ( c->get(path, error) );
+        if (!r) {
+            std::cerr << error.c_str() << std::endl;
+            return false;
+        }
+        PtexPtr<PtexFilter> f ( PtexFilter::getCachedFilter(r, PtexFilter::Options(PtexFilter::f_box)) );
+        float result[3] = { -1, -1, -1 };
+        f->eval(result, 0, nchan, 0, 0.5f, 0.5f, 0.25f, 0, 0, 0.25f);
+        for (int i = 0; i < nchan; i++) {
+            if (result[i] != data[i]) {
+                std::cerr << "stale cached filter after purge" << std::endl;
+                return false;
+            }
+        }
+    }
+    remove(path);
+    return true;
+}
+
+// table-driven kernels must stay close to the exact kernels
+bool checkKernelTable(PtexTexture* r)
+{
+    int nchan = r->numChannels();
+    std::vector<float> exact(nchan), table(nchan);
+    for (int ft = PtexFilter::f_gaussian; ft <= PtexFilter::f_mitchell; ft++) {
+        for (int lerp = 0; lerp <= 1; lerp++) {
+            PtexPtr<PtexFilter> f ( PtexFilter::getFilter(r, PtexFilter::Options(PtexFilter::FilterType(ft), lerp != 0, 0.5)) );
+            PtexPtr<PtexFilter> tf ( PtexFilter::getFilter(r, PtexFilter::Options(PtexFilter::FilterType(ft), lerp != 0, 0.5, false, true)) );
+            for (int i = 0; i < 200; i++) {
+                int faceid = i % r->numFaces();
+                float u = float(i % 11) / 10.0f, v = float(i % 13) / 12.0f;
+                float uw = float(i % 9 + 1) / 32.0f, vw = float(i % 7 + 1) / 64.0f;
+                f->eval(&exact[0], 0, nchan, faceid, u, v, uw, 0, 0, vw);
+                tf->eval(&table[0], 0, nchan, faceid, u, v, uw, 0, 0, vw);
+                for (int c = 0; c < nchan; c++) {
+                    if (fabsf(table[c] - exact[c]) > 1e-4f) {
+                        std::cerr << "kernel table mismatch for filter type " << ft << std::endl;
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
 int main(int argc, char** argv)
 {
     int maxmem = argc >= 2 ? atoi(argv[1]) : 1024*1024;
@@ -30,5 +169,6 @@ int main(int argc, char** argv)
         }
     }
 
-    return 0;
+    return checkEvalMany(r) && checkCachedFilters(r) &&
+        checkCachedFiltersAfterPurge(c) && checkKernelTable(r) ? 0 : 1;
 }
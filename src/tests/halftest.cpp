@@ -42,6 +42,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <stdio.h>
 #include <iostream>
 #include <string.h>
+#include <algorithm>
 
 #if defined(_WIN32) || defined(_WINDOWS) || defined(_MSC_VER)
 #include <float.h>
@@ -68,6 +69,7 @@ typedef half H;
 #else
 
 #include "PtexHalf.h"
+#include "Ptexture.h"
 using namespace Ptex;
 
 float h2f(uint16_t h)
@@ -349,6 +351,81 @@ int overflowtestall()
 }
 
 
+#ifndef OPEN_EXR
+// convert in pieces of varying length to cover the vector tails
+static const int piecelens[] = { 1, 7, 8, 9, 15, 16, 17, 31, 64, 100, 1000 };
+static const int npiecelens = sizeof(piecelens)/sizeof(piecelens[0]);
+
+int bulkcheckfloats(const float* f, int n)
+{
+    int count = 0;
+    H* h = new H[n];
+    for (int i = 0, j = 0; i < n; i += piecelens[j++ % npiecelens])
+        PtexHalf::fromFloat(h + i, f + i, std::min(piecelens[j % npiecelens], n - i));
+    for (int i = 0; i < n; i++) {
+        if (h[i].bits != f2h(f[i]) && count++ < 10)
+            printf("error: %g(0x%0x)->0x%x, expected 0x%x\n",
+                   f[i], floatToBits(f[i]), h[i].bits, f2h(f[i]));
+    }
+    delete [] h;
+    return count;
+}
+
+
+int bulkcheck()
+{
+    int count = 0;
+    // every half, compared with the table
+    const int n = 65536;
+    H* h = new H[n];
+    float* f = new float[n];
+    for (int i = 0; i < n; i++) h[i].bits = uint16_t(i);
+    for (int i = 0, j = 0; i < n; i += piecelens[j++ % npiecelens])
+        PtexHalf::toFloat(f + i, h + i, std::min(piecelens[j % npiecelens], n - i));
+    for (int i = 0; i < n; i++) {
+        if (floatToBits(f[i]) != PtexHalf::h2fTable[i] && count++ < 10)
+            printf("error: 0x%x->0x%0x, expected 0x%0x\n", i, floatToBits(f[i]), PtexHalf::h2fTable[i]);
+    }
+
+    // every half value and the midpoints (rounding ties) to the next
+    float* mid = new float[n];
+    for (int i = 0; i < n; i++)
+        mid[i] = (i & 0x7fff) < 0x7bff ? (h2f(i) + h2f(i+1)) * 0.5f : h2f(i);
+    count += bulkcheckfloats(f, n);
+    count += bulkcheckfloats(mid, n);
+    delete [] mid;
+    delete [] f;
+    delete [] h;
+
+    // a dense sampling of all floats (including denormals, inf and nan)
+    const int nsample = 1 << 20;
+    float* sample = new float[nsample];
+    for (uint64_t i = 0; i < (uint64_t(1) << 32); ) {
+        int ns = 0;
+        for (; ns < nsample && i < (uint64_t(1) << 32); ns++, i += 97)
+            sample[ns] = bitsToFloat(uint32_t(i));
+        count += bulkcheckfloats(sample, ns);
+    }
+    delete [] sample;
+    return count;
+}
+
+
+int bulkcheckall()
+{
+    // the bulk conversions must match the tables at every simd level
+    int count = 0;
+    SimdLevel maxLevel = GetSimdLevel();
+    for (int level = simd_none; level <= simd_avx2; level++) {
+        if (!SetSimdLevel(SimdLevel(level))) continue;
+        count += bulkcheck();
+    }
+    SetSimdLevel(maxLevel);
+    return count;
+}
+#endif
+
+
 int test(const char* name, int (*fn)())
 {
     printf("%s...\n", name);
@@ -368,6 +445,9 @@ int testall(bool fulltest)
     total += test("Nan conversion", nancheck);
     total += test("Overflow", overflowtestall);
     total += test("Rounding", fulltest ? testroundall : testroundsome);
+#ifndef OPEN_EXR
+    total += test("Bulk conversion", bulkcheckall);
+#endif
     if (!total)
         printf("halftest: all tests passed.\n");
     else
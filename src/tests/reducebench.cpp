@@ -0,0 +1,73 @@
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Ptexture.h"
+#include "PtexUtils.h"
+
+// Times the mipmap reductions at each available simd level, for every
+// data type and 1, 3 and 4 channels, on a 256x256 face (or -r res).
+
+static const char* names[] = { "reduce", "reduceu", "reducev", "reduceTri" };
+static PtexUtils::ReduceFn* const fns[] = { PtexUtils::reduce, PtexUtils::reduceu,
+                                             PtexUtils::reducev, PtexUtils::reduceTri };
+
+
+double timeReduce(int fn, Ptex::DataType dt, int nchan, int res, int iterations,
+                  const std::vector<float>& values, std::vector<char>& dst)
+{
+    int stride = res * Ptex::DataSize(dt) * nchan;
+    std::vector<char> src(stride * res);
+    Ptex::ConvertFromFloat(&src[0], &values[0], dt, res * res * nchan);
+    clock_t start = clock();
+    for (int i = 0; i < iterations; i++)
+        fns[fn](&src[0], stride, res, res, &dst[0], stride, dt, nchan);
+    return double(clock() - start) / CLOCKS_PER_SEC / iterations;
+}
+
+
+int main(int argc, char** argv)
+{
+    int res = 256, iterations = 200;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i+1 < argc) iterations = atoi(argv[++i]);
+        else if (argv[i][0] == '-' && argv[i][1] == 'r' && i+1 < argc) res = atoi(argv[++i]);
+    }
+    if (iterations < 1) iterations = 1;
+    if (res < 2) res = 2;
+    res &= ~1;
+
+    Ptex::SimdLevel maxLevel = Ptex::GetSimdLevel();
+    // random values in [0,1] for each channel
+    std::vector<float> values(res * res * 4);
+    for (size_t i = 0; i < values.size(); i++) values[i] = float(rand()) / float(RAND_MAX);
+    std::vector<char> dst(res * res * 16), expected(dst.size());
+
+    printf("%-10s %-8s %5s", "function", "type", "nchan");
+    for (int level = Ptex::simd_none; level <= maxLevel; level++)
+        printf(" %9s (us)", Ptex::SimdLevelName(Ptex::SimdLevel(level)));
+    printf("\n");
+    for (int fn = 0; fn < 4; fn++) {
+        for (int dt = Ptex::dt_uint8; dt <= Ptex::dt_float; dt++) {
+            for (int nchan = 1; nchan <= 4; nchan++) {
+                if (nchan == 2) continue;
+                printf("%-10s %-8s %5d", names[fn], Ptex::DataTypeName(Ptex::DataType(dt)), nchan);
+                for (int level = Ptex::simd_none; level <= maxLevel; level++) {
+                    Ptex::SetSimdLevel(Ptex::SimdLevel(level));
+                    double t = timeReduce(fn, Ptex::DataType(dt), nchan, res, iterations, values, dst);
+                    printf(" %14.2f", t * 1e6);
+                    if (level == Ptex::simd_none) expected = dst;
+                    else if (dst != expected) {
+                        std::cerr << "\nresult mismatch at level "
+                                  << Ptex::SimdLevelName(Ptex::SimdLevel(level)) << std::endl;
+                        return 1;
+                    }
+                }
+                printf("\n");
+            }
+        }
+    }
+    Ptex::SetSimdLevel(maxLevel);
+    return 0;
+}
@@ -1,9 +1,26 @@
 #include <string>
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <iostream>
 #include "Ptexture.h"
+#include "PtexSharedCache.h"
 #include <cstdlib>
 #include <cstdio> // printf()
+#include <cstring>
+#include <fstream>
+#include <ctime>
+#ifndef _WIN32
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
 using namespace Ptex;
 
 void DumpData(Ptex::Res res, Ptex::DataType dt, int nchan, void* data, std::string prefix)
@@ -92,6 +109,761 @@ void DumpMetaData(PtexMetaData* meta)
     }
 }
 
+#ifndef _WIN32
+class PreadInputHandler : public PtexInputHandler
+{
+    // reads with pread, or with seek and read if positional reads are
+    // disabled; never memory-maps
+public:
+    PreadInputHandler(bool readAt) : _readAt(readAt) {}
+    virtual Handle open(const char* path)
+    {
+        int fd = ::open(path, O_RDONLY);
+        return fd < 0 ? 0 : (Handle) new int(fd);
+    }
+    virtual void seek(Handle handle, int64_t pos) { lseek(*(int*)handle, off_t(pos), SEEK_SET); }
+    virtual size_t read(void* buffer, size_t size, Handle handle)
+    {
+        ssize_t n = ::read(*(int*)handle, buffer, size);
+        return n < 0 ? 0 : size_t(n);
+    }
+    virtual bool close(Handle handle)
+    {
+        int fd = *(int*)handle;
+        delete (int*)handle;
+        return ::close(fd) == 0;
+    }
+    virtual const char* lastError() { return "read error"; }
+    virtual size_t readAt(void* buffer, size_t size, int64_t pos, Handle handle)
+    {
+        ssize_t n = pread(*(int*)handle, buffer, size, off_t(pos));
+        return n < 0 ? 0 : size_t(n);
+    }
+    virtual bool supportsReadAt() { return _readAt; }
+private:
+    bool _readAt;
+};
+
+struct ConcurrentReader {
+    PtexCache* cache;
+    const char* paths[2];
+    int thread;
+    const std::vector<std::vector<char> >* expected;  // per face, full res then half res
+    const std::vector<float>* expectedPixels;         // 4 channels per face
+    bool ok;
+};
+
+void* ReadConcurrently(void* arg)
+{
+    ConcurrentReader* r = (ConcurrentReader*) arg;
+    Ptex::String error;
+    int nfaces = int(r->expected->size()) / 2;
+    for (int pass = 0; pass < 200 && r->ok; pass++) {
+        for (int j = 0; j < nfaces && r->ok; j++) {
+            // alternate between two copies of the texture so that, with one
+            // file allowed open, the cache closes files while other threads
+            // read them; releasing the texture after each face lets the cache
+            // evict faces under its small memory limit
+            PtexPtr<PtexTexture> tx(r->cache->get(r->paths[(pass + j + r->thread) % 2], error));
+            if (!tx) { r->ok = false; break; }
+            // half the threads go in reverse, so threads meet on the same faces
+            int i = r->thread % 2 ? nfaces - 1 - j : j;
+            int half = pass % 2;
+            const std::vector<char>& expected = (*r->expected)[i * 2 + half];
+            Ptex::Res res = tx->getFaceInfo(i).res;
+            if (half) { res.ulog2--; res.vlog2--; }
+            std::vector<char> data(expected.size());
+            tx->getData(i, &data[0], 0, res);
+            float pixel[4];
+            tx->getPixel(i, 1, 1, pixel, 0, 4);
+            r->ok = data == expected && std::equal(pixel, pixel + 4, &(*r->expectedPixels)[i * 4]);
+        }
+    }
+    return 0;
+}
+
+struct CacheChurner {
+    PtexCache* cache;
+    const char* paths[2];
+    volatile bool done;
+};
+
+void* ChurnCache(void* arg)
+{
+    // get and release textures without reading them; the cache processes
+    // its recently used list (and closes extra files) every 50 releases
+    CacheChurner* churner = (CacheChurner*) arg;
+    Ptex::String error;
+    for (int i = 0; !churner->done; i++) {
+        PtexTexture* tx = churner->cache->get(churner->paths[i % 2], error);
+        if (tx) tx->release();
+    }
+    return 0;
+}
+#endif
+
+bool CheckConcurrentReads()
+{
+#ifdef _WIN32
+    return true;
+#else
+    // threads reading the same faces and tiles through a cache must get the
+    // data read by a single thread, with the default input handler (memory
+    // mapped where supported), with positional reads, and with seek and
+    // read, while faces are evicted and another thread makes the cache
+    // close files under them
+    char tmpdir[] = "/tmp/ptex_rtest_XXXXXX";
+    if (!mkdtemp(tmpdir)) return false;
+    std::string paths[2] = { std::string(tmpdir) + "/a.ptx", std::string(tmpdir) + "/b.ptx" };
+    const int nfaces = 6;
+    Ptex::String error;
+    bool ok = true;
+    for (int p = 0; p < 2 && ok; p++) {
+        // large faces are tiled (4 tiles of 64KB), odd faces are small
+        PtexPtr<PtexWriter> w(PtexWriter::open(paths[p].c_str(), Ptex::mt_quad, Ptex::dt_uint8,
+                                               4, -1, nfaces, error));
+        for (int i = 0; i < nfaces && w; i++) {
+            Ptex::FaceInfo f(i % 2 ? Ptex::Res(3, 2) : Ptex::Res(8, 8));
+            std::vector<uint8_t> data(f.res.size() * 4);
+            for (size_t k = 0; k < data.size(); k++) data[k] = uint8_t((k * 7 + i * 13) ^ (k >> 9));
+            w->writeFace(i, f, &data[0]);
+        }
+        ok = w && w->close(error);
+    }
+
+    std::vector<std::vector<char> > expected(nfaces * 2);
+    std::vector<float> expectedPixels(nfaces * 4);
+    if (ok) {
+        PtexPtr<PtexTexture> tx(PtexTexture::open(paths[0].c_str(), error));
+        ok = tx.get() != 0;
+        for (int i = 0; i < nfaces && ok; i++) {
+            Ptex::Res res = tx->getFaceInfo(i).res;
+            for (int half = 0; half < 2; half++) {
+                expected[i * 2 + half].resize(res.size() * 4);
+                tx->getData(i, &expected[i * 2 + half][0], 0, res);
+                res.ulog2--; res.vlog2--;
+            }
+            tx->getPixel(i, 1, 1, &expectedPixels[i * 4], 0, 4);
+        }
+    }
+
+    // fail rather than hang if the threads deadlock
+    alarm(120);
+    PreadInputHandler preadio(true), seekio(false);
+    PtexInputHandler* handlers[] = { 0, &preadio, &seekio };
+    for (int h = 0; h < 3 && ok; h++) {
+        PtexPtr<PtexCache> c(PtexCache::create(1, 16*1024, false, handlers[h]));
+        const int nthreads = 4;
+        ConcurrentReader readers[nthreads];
+        pthread_t threads[nthreads], churnThread;
+        CacheChurner churner;
+        churner.cache = c.get();
+        churner.paths[0] = paths[0].c_str();
+        churner.paths[1] = paths[1].c_str();
+        churner.done = false;
+        pthread_create(&churnThread, 0, ChurnCache, &churner);
+        for (int t = 0; t < nthreads; t++) {
+            ConcurrentReader& r = readers[t];
+            r.cache = c.get();
+            r.paths[0] = paths[0].c_str();
+            r.paths[1] = paths[1].c_str();
+            r.thread = t;
+            r.expected = &expected;
+            r.expectedPixels = &expectedPixels;
+            r.ok = true;
+            pthread_create(&threads[t], 0, ReadConcurrently, &r);
+        }
+        for (int t = 0; t < nthreads; t++) {
+            pthread_join(threads[t], 0);
+            ok = ok && readers[t].ok;
+        }
+        churner.done = true;
+        pthread_join(churnThread, 0);
+    }
+    alarm(0);
+    unlink(paths[0].c_str());
+    unlink(paths[1].c_str());
+    rmdir(tmpdir);
+    return ok;
+#endif
+}
+
+bool CheckBatchedData(const char* path)
+{
+    // batched reads must match face-at-a-time reads
+    Ptex::String error;
+    PtexPtr<PtexTexture> batched(PtexTexture::open(path, error));
+    PtexPtr<PtexTexture> single(PtexTexture::open(path, error));
+    if (!batched || !single) return false;
+
+    int nfaces = batched->numFaces();
+    int pixelsize = Ptex::DataSize(batched->dataType()) * batched->numChannels();
+    for (int reduce = 0; reduce < 2; reduce++) {
+        std::vector<int> faceids(nfaces);
+        std::vector<Ptex::Res> res(nfaces);
+        std::vector<int> offsets(nfaces + 1, 0);
+        for (int i = 0; i < nfaces; i++) {
+            // request faces in reverse order to exercise sorting
+            faceids[i] = nfaces - 1 - i;
+            res[i] = batched->getFaceInfo(faceids[i]).res;
+            if (reduce && res[i].ulog2 && res[i].vlog2) { res[i].ulog2--; res[i].vlog2--; }
+            offsets[i+1] = offsets[i] + pixelsize * res[i].size();
+        }
+        std::vector<char> data(offsets[nfaces]), expected(offsets[nfaces]);
+        std::vector<void*> buffers(nfaces);
+        for (int i = 0; i < nfaces; i++) buffers[i] = &data[offsets[i]];
+        batched->getData(nfaces, &faceids[0], &buffers[0], 0, &res[0]);
+        for (int i = 0; i < nfaces; i++)
+            single->getData(faceids[i], &expected[offsets[i]], 0, res[i]);
+        if (data != expected) return false;
+    }
+    return true;
+}
+
+bool CheckFaceData(PtexTexture* tx, PtexTexture* expected)
+{
+    // all faces must match at every resolution
+    int nfaces = tx->numFaces();
+    if (nfaces != expected->numFaces()) return false;
+    int pixelsize = Ptex::DataSize(tx->dataType()) * tx->numChannels();
+    for (int i = 0; i < nfaces; i++) {
+        const Ptex::FaceInfo& f = tx->getFaceInfo(i);
+        if (memcmp(&f, &expected->getFaceInfo(i), sizeof(f)) != 0) return false;
+        Ptex::Res res = f.res;
+        while (1) {
+            std::vector<char> data(pixelsize * res.size()), expdata(data.size());
+            tx->getData(i, &data[0], 0, res);
+            expected->getData(i, &expdata[0], 0, res);
+            if (data != expdata) return false;
+            if (!res.ulog2 && !res.vlog2) break;
+            if (res.ulog2) res.ulog2--;
+            if (res.vlog2) res.vlog2--;
+        }
+    }
+    return true;
+}
+
+#ifndef _WIN32
+size_t DirSize(const std::string& dir, bool remove)
+{
+    // total size of files in dir, optionally removing them
+    size_t total = 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return 0;
+    while (struct dirent* entry = readdir(d)) {
+        std::string path = dir + "/" + entry->d_name;
+        struct stat st;
+        if (entry->d_name[0] == '.' || stat(path.c_str(), &st) != 0) continue;
+        total += size_t(st.st_size);
+        if (remove) unlink(path.c_str());
+    }
+    closedir(d);
+    return total;
+}
+
+size_t DirFiles(const std::string& dir)
+{
+    // number of files in dir
+    size_t count = 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return 0;
+    while (struct dirent* entry = readdir(d)) {
+        if (entry->d_name[0] != '.') count++;
+    }
+    closedir(d);
+    return count;
+}
+#endif
+
+bool WriteRepeatedFaces(const char* path, const char* outpath, int nfaces)
+{
+    // write a texture with nfaces faces, cycling through the faces of path
+    Ptex::String error;
+    PtexPtr<PtexTexture> src(PtexTexture::open(path, error));
+    if (!src) return false;
+    PtexPtr<PtexWriter> w(PtexWriter::open(outpath, src->meshType(), src->dataType(),
+                                           src->numChannels(), src->alphaChannel(), nfaces, error));
+    if (!w) return false;
+    bool ok = true;
+    for (int i = 0; i < nfaces && ok; i++) {
+        Ptex::FaceInfo f(src->getFaceInfo(i % src->numFaces()).res);
+        std::vector<char> data(Ptex::DataSize(src->dataType()) * src->numChannels() * f.res.size());
+        src->getData(i % src->numFaces(), &data[0], 0);
+        ok = w->writeFace(i, f, &data[0]);
+    }
+    return w->close(error) && ok;
+}
+
+bool CheckIndexCache(const char* path)
+{
+#ifdef _WIN32
+    (void) path;
+    return true;
+#else
+    // file info written to (first pass) and read from (second pass) the
+    // index cache must match the file; files with under 256 faces aren't
+    // worth caching and must not be written
+    char tmpdir[] = "/tmp/ptex_rtest_XXXXXX";
+    if (!mkdtemp(tmpdir)) return false;
+    std::string dir = tmpdir, cachedir = dir + "/index", bigpath = dir + "/big.ptx";
+    mkdir(cachedir.c_str(), 0777);
+    Ptex::String error;
+    bool ok = WriteRepeatedFaces(path, bigpath.c_str(), 256);
+    if (ok) {
+        PtexPtr<PtexCache> c(PtexCache::create(0, 0));
+        c->setIndexCachePath(cachedir.c_str());
+        PtexPtr<PtexTexture> tx(c->get(path, error));
+        ok = tx && DirSize(cachedir, false) == 0;
+    }
+    for (int premultiply = 0; premultiply < 2 && ok; premultiply++) {
+        PtexPtr<PtexTexture> expected(PtexTexture::open(bigpath.c_str(), error, premultiply));
+        ok = expected.get() != 0;
+        for (int pass = 0; pass < 2 && ok; pass++) {
+            PtexPtr<PtexCache> c(PtexCache::create(0, 0, premultiply));
+            c->setIndexCachePath(cachedir.c_str());
+            PtexPtr<PtexTexture> tx(c->get(bigpath.c_str(), error));
+            ok = tx && CheckFaceData(tx.get(), expected.get()) && DirSize(cachedir, false) != 0;
+        }
+    }
+    DirSize(cachedir, true);
+    rmdir(cachedir.c_str());
+    DirSize(dir, true);
+    rmdir(dir.c_str());
+    return ok;
+#endif
+}
+
+bool CheckParallelTiles(const char* path)
+{
+    // tiles loaded by worker threads must match tiles loaded serially
+    Ptex::String error;
+    PtexPtr<PtexTexture> expected(PtexTexture::open(path, error));
+    if (!expected) return false;
+    PtexPtr<PtexCache> c(PtexCache::create(0, 0));
+    c->setParallelTileLoading(true);
+    for (int pass = 0; pass < 2; pass++) {
+        PtexPtr<PtexTexture> tx(c->get(path, error));
+        if (!tx || !CheckFaceData(tx.get(), expected.get())) return false;
+        c->purgeAll();
+    }
+    return true;
+}
+
+bool CheckEviction(const char* path, Ptex::CachePolicy policy)
+{
+    // data must be intact when faces are evicted and reloaded, which
+    // happens as textures are released under a small memory limit
+    Ptex::String error;
+    PtexPtr<PtexTexture> expected(PtexTexture::open(path, error));
+    if (!expected) return false;
+    PtexPtr<PtexCache> c(PtexCache::create(0, 16*1024));
+    c->setCachePolicy(policy);
+    for (int pass = 0; pass < 20; pass++) {
+        for (int i = 0; i < 50; i++) {
+            PtexPtr<PtexTexture> tx(c->get(path, error));
+            if (!tx) return false;
+            // face 0 is hot, the rest are visited in turn
+            int faceid = i % 2 ? 0 : (pass * 25 + i / 2) % tx->numFaces();
+            Ptex::Res res = tx->getFaceInfo(faceid).res;
+            int size = Ptex::DataSize(tx->dataType()) * tx->numChannels() * res.size();
+            std::vector<char> data(size), expdata(size);
+            tx->getData(faceid, &data[0], 0, res);
+            expected->getData(faceid, &expdata[0], 0, res);
+            if (data != expdata) return false;
+        }
+        PtexPtr<PtexTexture> tx(c->get(path, error));
+        if (!tx || !CheckFaceData(tx.get(), expected.get())) return false;
+    }
+    return true;
+}
+
+// plain stdio input (the default handler maps files, which bypasses the block cache)
+class StdioInputHandler : public PtexInputHandler
+{
+public:
+    virtual Handle open(const char* path) { return (Handle) fopen(path, "rb"); }
+    virtual void seek(Handle handle, int64_t pos) { fseek((FILE*)handle, long(pos), SEEK_SET); }
+    virtual size_t read(void* buffer, size_t size, Handle handle)
+    {
+        return fread(buffer, size, 1, (FILE*)handle) == 1 ? size : 0;
+    }
+    virtual bool close(Handle handle) { return fclose((FILE*)handle) == 0; }
+    virtual const char* lastError() { return "read error"; }
+};
+
+bool ReadThroughCache(const char* path, PtexTexture* expected, size_t blockCacheSize,
+                      PtexCache::Stats& stats, PtexCache::TierStats& tiers)
+{
+    // read every face repeatedly, releasing the texture between reads so
+    // that face data is freed under the small memory limit
+    StdioInputHandler io;
+    PtexPtr<PtexCache> c(PtexCache::create(0, 16*1024, false, &io));
+    c->setBlockCacheSize(blockCacheSize);
+    Ptex::String error;
+    for (int pass = 0; pass < 100; pass++) {
+        for (int i = 0; i < expected->numFaces(); i++) {
+            PtexPtr<PtexTexture> tx(c->get(path, error));
+            if (!tx) return false;
+            Ptex::Res res = tx->getFaceInfo(i).res;
+            int size = Ptex::DataSize(tx->dataType()) * tx->numChannels() * res.size();
+            std::vector<char> data(size), expdata(size);
+            tx->getData(i, &data[0], 0, res);
+            expected->getData(i, &expdata[0], 0, res);
+            if (data != expdata) return false;
+        }
+    }
+    PtexPtr<PtexTexture> tx(c->get(path, error));
+    if (!tx || !CheckFaceData(tx.get(), expected)) return false;
+    c->getStats(stats);
+    c->getTierStats(tiers);
+    return true;
+}
+
+class CapturingErrorHandler : public PtexErrorHandler
+{
+public:
+    virtual void reportError(const char* error) { errors += error; }
+    std::string errors;
+};
+
+void GetStatsAfterReleases(PtexCache* c, const char* path, PtexCache::Stats& stats)
+{
+    // stats are gathered from textures released to the cache in batches
+    Ptex::String error;
+    for (int i = 0; i < 64; i++) {
+        PtexTexture* tx = c->get(path, error);
+        if (tx) tx->release();
+    }
+    c->getStats(stats);
+}
+
+bool CheckPrefetch(const char* path)
+{
+    // prefetched faces must be loaded by the workers, so that reading them
+    // afterwards needs no more reads, and prefetching a missing file must
+    // fail with an error
+    Ptex::String error;
+    PtexPtr<PtexTexture> expected(PtexTexture::open(path, error));
+    if (!expected) return false;
+    std::vector<int> faceids(expected->numFaces());
+    for (size_t i = 0; i < faceids.size(); i++) faceids[i] = int(i);
+
+    CapturingErrorHandler err;
+    PtexPtr<PtexCache> c(PtexCache::create(0, 0, false, 0, &err));
+    PtexCache::Stats opened, prefetched, read;
+    GetStatsAfterReleases(c.get(), path, opened);
+    PtexPtr<PtexPrefetch> prefetch(c->prefetch(path, int(faceids.size()), &faceids[0]));
+    if (!prefetch) return false;
+    prefetch->wait();
+    if (!prefetch->isDone()) return false;
+    GetStatsAfterReleases(c.get(), path, prefetched);
+    if (prefetched.memUsed <= opened.memUsed || prefetched.blockReads <= opened.blockReads)
+        return false;
+
+    PtexPtr<PtexTexture> tx(c->get(path, error));
+    if (!tx) return false;
+    int pixelsize = Ptex::DataSize(tx->dataType()) * tx->numChannels();
+    for (size_t i = 0; i < faceids.size(); i++) {
+        Ptex::Res res = tx->getFaceInfo(int(i)).res;
+        std::vector<char> data(pixelsize * res.size()), expdata(data.size());
+        tx->getData(int(i), &data[0], 0);
+        expected->getData(int(i), &expdata[0], 0);
+        if (data != expdata) return false;
+    }
+    tx.reset(0);
+    GetStatsAfterReleases(c.get(), path, read);
+    if (read.blockReads != prefetched.blockReads) return false;
+
+    PtexPrefetch* missing = c->prefetch("missing.ptx", int(faceids.size()), &faceids[0]);
+    if (missing) {
+        missing->release();
+        return false;
+    }
+    return !err.errors.empty();
+}
+
+bool CheckOpenReadSize(const char* path)
+{
+    // with the speculative read at open, opening takes fewer reads than
+    // without it (for files the default handler doesn't map)
+    Ptex::String error;
+    size_t reads[2];
+    for (int i = 0; i < 2; i++) {
+        PtexPtr<PtexCache> c(PtexCache::create(0, 0));
+        c->setOpenReadSize(i ? 65536 : 0);
+        // (stats are gathered from textures released to the cache in batches)
+        for (int j = 0; j < 64; j++) {
+            PtexTexture* tx = c->get(path, error);
+            if (!tx) return false;
+            tx->release();
+        }
+        PtexCache::Stats stats;
+        c->getStats(stats);
+        reads[i] = size_t(stats.blockReads);
+    }
+#ifdef PTEX_NO_MMAP
+    return reads[1] < reads[0];
+#else
+    return reads[1] <= reads[0];
+#endif
+}
+
+bool CheckBlockCache(const char* path)
+{
+    // faces freed under a small memory limit must be reloaded intact from
+    // the block cache, with fewer reads than without it
+    Ptex::String error;
+    PtexPtr<PtexTexture> expected(PtexTexture::open(path, error));
+    if (!expected) return false;
+    PtexCache::Stats stats, nocache;
+    PtexCache::TierStats tiers, nocachetiers;
+    if (!ReadThroughCache(path, expected.get(), 1024*1024, stats, tiers) ||
+        !ReadThroughCache(path, expected.get(), 0, nocache, nocachetiers)) return false;
+    return tiers.blockCacheHits && stats.blockReads < nocache.blockReads &&
+        tiers.blockCacheMemUsed <= 1024*1024 && !nocachetiers.blockCacheHits && !nocachetiers.blockCacheMemUsed;
+}
+
+bool CheckSharedCache(const char* path)
+{
+#if defined(_WIN32) || defined(__APPLE__)
+    (void) path;
+    return true;
+#else
+    // faces loaded through one cache must be found by another cache
+    // (standing in for another process) attached to the same segment
+    Ptex::String error;
+    PtexPtr<PtexTexture> expected(PtexTexture::open(path, error));
+    if (!expected) return false;
+    char name[64];
+    snprintf(name, sizeof(name), "/ptex_rtest_%d", int(getpid()));
+    bool ok = true;
+    for (int i = 0; i < 2 && ok; i++) {
+        PtexPtr<PtexCache> c(PtexCache::create(0, 16*1024));
+        if (!c->setSharedCache(name, 16*1024*1024, error)) {
+            std::cerr << error.c_str() << std::endl;
+            ok = false;
+            break;
+        }
+        PtexPtr<PtexTexture> tx(c->get(path, error));
+        ok = tx && CheckFaceData(tx.get(), expected.get());
+        PtexCache::TierStats stats;
+        c->getTierStats(stats);
+        if (i == 1 && !stats.sharedCacheHits) ok = false;
+    }
+
+    // the segment must be private to its owner, and must not be used once
+    // other users can access it
+    int fd = shm_open(name, O_RDWR, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (st.st_mode & 0777) != 0600 || fchmod(fd, 0666) != 0)
+        ok = false;
+    else {
+        PtexPtr<PtexCache> c(PtexCache::create(0, 16*1024));
+        if (c->setSharedCache(name, 16*1024*1024, error)) ok = false;
+    }
+    if (fd >= 0) close(fd);
+    shm_unlink(name);
+    return ok;
+#endif
+}
+
+bool CheckSharedCacheOwnerDied(const char* path)
+{
+    // needs the library internals to take the lock from another process
+#if defined(_WIN32) || defined(__APPLE__) || !defined(PTEX_STATIC)
+    (void) path;
+    return true;
+#else
+    // a process killed while holding the segment's lock must not block the
+    // others (the next to lock it resets the cache and carries on)
+    Ptex::String error;
+    PtexPtr<PtexTexture> expected(PtexTexture::open(path, error));
+    if (!expected) return false;
+    char name[64];
+    snprintf(name, sizeof(name), "/ptex_rtest_%d", int(getpid()));
+    PtexPtr<PtexCache> c(PtexCache::create(0, 16*1024));
+    if (!c->setSharedCache(name, 16*1024*1024, error)) {
+        std::cerr << error.c_str() << std::endl;
+        return false;
+    }
+    int fds[2] = { -1, -1 };
+    bool ok = pipe(fds) == 0;
+    pid_t pid = ok ? fork() : -1;
+    if (pid == 0) {
+        // take the lock, tell the parent, and wait to be killed
+        std::string err;
+        PtexSharedCache* shared = PtexSharedCache::open(name, 16*1024*1024, err);
+        if (!shared) _exit(1);
+        shared->lockForTesting();
+        char locked = 1;
+        if (write(fds[1], &locked, 1) != 1) _exit(1);
+        for (;;) pause();
+    }
+    char locked = 0;
+    ok = pid > 0 && read(fds[0], &locked, 1) == 1 && locked;
+    if (pid > 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, 0, 0);
+    }
+    if (fds[0] >= 0) { close(fds[0]); close(fds[1]); }
+    if (ok) {
+        // fail rather than hang if the lock isn't recovered
+        alarm(60);
+        PtexPtr<PtexTexture> tx(c->get(path, error));
+        ok = tx && CheckFaceData(tx.get(), expected.get());
+        alarm(0);
+    }
+    shm_unlink(name);
+    return ok;
+#endif
+}
+
+bool CheckSharedCachePins()
+{
+    // needs the library internals to pin data directly
+#if defined(_WIN32) || defined(__APPLE__) || !defined(PTEX_STATIC)
+    return true;
+#else
+    // data pinned by one cache (standing in for a process) must stay in
+    // place while another cycles the segment, and the pins of a process
+    // that dies must not block the segment forever
+    char name[64];
+    snprintf(name, sizeof(name), "/ptex_rtest_pins_%d", int(getpid()));
+    shm_unlink(name);
+    std::string err;
+    PtexSharedCache* a = PtexSharedCache::open(name, 1024*1024, err);
+    PtexSharedCache* b = a ? PtexSharedCache::open(name, 1024*1024, err) : 0;
+    bool ok = a && b;
+    std::vector<char> data(1000), other(1000, 'x');
+    for (size_t i = 0; i < data.size(); i++) data[i] = char(i * 7);
+    const void* pinned = 0;
+    if (ok) {
+        a->add(1, 0, &data[0], int(data.size()));
+        pinned = b->pin(1, 0, int(data.size()));
+        ok = pinned != 0;
+    }
+    for (int i = 1; ok && i < 10000; i++) a->add(2, i, &other[0], int(other.size()));
+    if (ok) {
+        ok = memcmp(pinned, &data[0], data.size()) == 0 && a->contains(2, 9999, int(other.size()));
+        b->unpin(pinned);
+    }
+    delete b;
+
+    // a child process fills the segment with pinned data and is killed
+    std::vector<char> big(64*1024 - 64, 'y');
+    int fds[2] = { -1, -1 };
+    ok = ok && pipe(fds) == 0;
+    pid_t pid = ok ? fork() : -1;
+    if (pid == 0) {
+        std::string childErr;
+        PtexSharedCache* c = PtexSharedCache::open(name, 1024*1024, childErr);
+        if (!c) _exit(1);
+        for (int i = 0; i < 64; i++) {
+            c->add(3, i, &big[0], int(big.size()));
+            c->pin(3, i, int(big.size()));
+        }
+        char full = 1;
+        if (write(fds[1], &full, 1) != 1) _exit(1);
+        for (;;) pause();
+    }
+    char full = 0;
+    ok = pid > 0 && read(fds[0], &full, 1) == 1 && full;
+    if (ok) {
+        // no room while the child is alive
+        a->add(4, 0, &big[0], int(big.size()));
+        ok = !a->contains(4, 0, int(big.size()));
+    }
+    if (pid > 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, 0, 0);
+    }
+    if (fds[0] >= 0) { close(fds[0]); close(fds[1]); }
+    if (ok) {
+        a->add(4, 0, &big[0], int(big.size()));
+        ok = a->contains(4, 0, int(big.size()));
+    }
+    delete a;
+    shm_unlink(name);
+    return ok;
+#endif
+}
+
+bool CheckDiskCache(const char* path)
+{
+#ifdef _WIN32
+    (void) path;
+    return true;
+#else
+    // faces written to the disk cache by one run must be read back by the
+    // next (a new cache standing in for a restart), unless the file changes
+    char tmpdir[] = "/tmp/ptex_rtest_XXXXXX";
+    if (!mkdtemp(tmpdir)) return false;
+    std::string dir = tmpdir, cachedir = dir + "/cache", texpath = dir + "/test.ptx";
+    mkdir(cachedir.c_str(), 0777);
+    {
+        // copy the texture so that its modification time can be changed
+        std::ifstream in(path, std::ios::binary);
+        std::ofstream out(texpath.c_str(), std::ios::binary);
+        out << in.rdbuf();
+    }
+    Ptex::String error;
+    PtexPtr<PtexTexture> expected(PtexTexture::open(path, error));
+    bool ok = expected.get() != 0;
+    for (int run = 0; run < 3 && ok; run++) {
+        if (run == 2) {
+            struct utimbuf times;
+            times.actime = times.modtime = time(0) + 100;
+            utime(texpath.c_str(), &times);
+        }
+        PtexPtr<PtexCache> c(PtexCache::create(0, 16*1024));
+        c->setDiskCache(cachedir.c_str(), 64*1024*1024);
+        PtexPtr<PtexTexture> tx(c->get(texpath.c_str(), error));
+        ok = tx && CheckFaceData(tx.get(), expected.get());
+        PtexCache::TierStats stats;
+        c->getTierStats(stats);
+        if (ok && (run == 1) != (stats.diskCacheHits != 0)) ok = false;
+    }
+    if (ok) {
+        // older data is deleted to stay within the limit
+        size_t maxSize = DirSize(cachedir, false) / 2;
+        PtexPtr<PtexCache> c(PtexCache::create(0, 0));
+        c->setDiskCache(cachedir.c_str(), maxSize);
+        ok = DirSize(cachedir, false) <= maxSize;
+    }
+    DirSize(cachedir, true);
+    if (ok) {
+        // faces much smaller than a disk block are counted as a whole block,
+        // so a limit of 16 blocks keeps the 16 most recent faces
+        std::string smallpath = dir + "/small.ptx";
+        PtexPtr<PtexWriter> w(PtexWriter::open(smallpath.c_str(), Ptex::mt_quad, Ptex::dt_uint8,
+                                               3, -1, 256, error));
+        uint8_t data[8*8*3];
+        for (int i = 0; w && i < 256; i++) {
+            for (int j = 0; j < int(sizeof(data)); j++) data[j] = uint8_t(i + j * 7);
+            w->writeFace(i, Ptex::FaceInfo(Ptex::Res(3, 3)), data);
+        }
+        ok = w && w->close(error);
+        PtexPtr<PtexCache> c(PtexCache::create(0, 16*1024));
+        c->setDiskCache(cachedir.c_str(), 16*4096);
+        for (int pass = 0; pass < 2 && ok; pass++) {
+            // (the second pass reads the last faces again, from the disk cache)
+            PtexPtr<PtexTexture> tx(c->get(smallpath.c_str(), error));
+            for (int i = pass ? 248 : 0; tx && i < 256; i++) tx->getData(i, data, 0);
+            ok = tx && DirFiles(cachedir) <= 16;
+            c->purgeAll();
+        }
+        PtexCache::TierStats stats;
+        c->getTierStats(stats);
+        if (stats.diskCacheHits != 8) ok = false;
+    }
+    DirSize(cachedir, true);
+    rmdir(cachedir.c_str());
+    DirSize(dir, true);
+    rmdir(dir.c_str());
+    return ok;
+#endif
+}
+
 int main(int /*argc*/, char** /*argv*/)
 {
     Ptex::String error;
@@ -117,6 +889,81 @@ int main(int /*argc*/, char** /*argv*/)
     meta->release();
 
     int nfaces = r->numFaces();
+
+    if (!CheckConcurrentReads()) {
+        std::cerr << "concurrent reads don't match" << std::endl;
+        return 1;
+    }
+
+    if (!CheckBatchedData("test.ptx")) {
+        std::cerr << "batched getData doesn't match" << std::endl;
+        return 1;
+    }
+
+    if (!CheckIndexCache("test.ptx")) {
+        std::cerr << "index cache doesn't match" << std::endl;
+        return 1;
+    }
+
+    if (!CheckParallelTiles("test.ptx")) {
+        std::cerr << "parallel tile loading doesn't match" << std::endl;
+        return 1;
+    }
+
+    if (!CheckEviction("test.ptx", Ptex::cp_recency) || !CheckEviction("test.ptx", Ptex::cp_frequency)) {
+        std::cerr << "data doesn't match after eviction" << std::endl;
+        return 1;
+    }
+
+    if (!CheckOpenReadSize("test.ptx")) {
+        std::cerr << "open read size check failed" << std::endl;
+        return 1;
+    }
+
+    if (!CheckBlockCache("test.ptx")) {
+        std::cerr << "block cache check failed" << std::endl;
+        return 1;
+    }
+
+    if (!CheckSharedCache("test.ptx")) {
+        std::cerr << "shared cache check failed" << std::endl;
+        return 1;
+    }
+
+    if (!CheckSharedCacheOwnerDied("test.ptx")) {
+        std::cerr << "shared cache lock not recovered after its owner died" << std::endl;
+        return 1;
+    }
+
+    if (!CheckSharedCachePins()) {
+        std::cerr << "shared cache pins not kept or not released" << std::endl;
+        return 1;
+    }
+
+    if (!CheckDiskCache("test.ptx")) {
+        std::cerr << "disk cache check failed" << std::endl;
+        return 1;
+    }
+
+    if (!CheckPrefetch("test.ptx")) {
+        std::cerr << "prefetch check failed" << std::endl;
+        return 1;
+    }
+
+    // prefetch all faces and make sure the request completes
+    std::vector<int> faceids(nfaces);
+    for (int i = 0; i < nfaces; i++) faceids[i] = i;
+    PtexPtr<PtexPrefetch> prefetch(c->prefetch("test.ptx", nfaces, &faceids[0]));
+    if (!prefetch) {
+        std::cerr << "prefetch failed" << std::endl;
+        return 1;
+    }
+    prefetch->wait();
+    if (!prefetch->isDone()) {
+        std::cerr << "prefetch should be done" << std::endl;
+        return 1;
+    }
+
     for (int i = 0; i < nfaces; i++) {
         const Ptex::FaceInfo& f = r->getFaceInfo(i);
         std::cout << "face " << i << ":\n"
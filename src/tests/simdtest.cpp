@@ -0,0 +1,365 @@
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "Ptexture.h"
+#include "PtexUtils.h"
+using namespace Ptex;
+
+// Checks that every simd level produces exactly the same results as the
+// scalar code (simd_none), and the block conversions at every level.
+
+static const int widths[] = { 1, 2, 3, 5, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100 };
+static const int nwidths = sizeof(widths)/sizeof(widths[0]);
+
+void fillRandom(std::vector<char>& data)
+{
+    for (size_t i = 0; i < data.size(); i++) data[i] = char(rand());
+}
+
+
+bool checkInterleave(SimdLevel level)
+{
+    for (int dt = 0; dt <= dt_float; dt++) {
+        for (int nchan = 1; nchan <= 5; nchan++) {
+            for (int w = 0; w < nwidths; w++) {
+                for (int vw = 1; vw <= 3; vw++) {
+                    for (int pad = 0; pad <= 1; pad++) {
+                        int uw = widths[w];
+                        int size = DataSize(DataType(dt)), pixelsize = size * nchan;
+                        // padded strides force row at a time processing
+                        int planestride = uw * size + pad * 8;
+                        int pixelstride = uw * pixelsize + pad * 12;
+                        std::vector<char> planes(planestride * vw * nchan), pixels(pixelstride * vw);
+                        std::vector<char> expected(pixels.size()), result(pixels.size());
+                        fillRandom(planes);
+
+                        // interleave
+                        fillRandom(expected);
+                        result = expected;
+                        SetSimdLevel(simd_none);
+                        PtexUtils::interleave(&planes[0], planestride, uw, vw, &expected[0], pixelstride,
+                                              DataType(dt), nchan);
+                        SetSimdLevel(level);
+                        PtexUtils::interleave(&planes[0], planestride, uw, vw, &result[0], pixelstride,
+                                              DataType(dt), nchan);
+                        if (result != expected) {
+                            std::cerr << "interleave mismatch: " << SimdLevelName(level) << ' '
+                                      << DataTypeName(DataType(dt)) << " nchan=" << nchan
+                                      << " res=" << uw << 'x' << vw << " pad=" << pad << std::endl;
+                            return false;
+                        }
+
+                        // deinterleave
+                        std::vector<char> expplanes(planes.size()), resplanes(planes.size());
+                        fillRandom(expplanes);
+                        resplanes = expplanes;
+                        SetSimdLevel(simd_none);
+                        PtexUtils::deinterleave(&result[0], pixelstride, uw, vw, &expplanes[0], planestride,
+                                                DataType(dt), nchan);
+                        SetSimdLevel(level);
+                        PtexUtils::deinterleave(&result[0], pixelstride, uw, vw, &resplanes[0], planestride,
+                                                DataType(dt), nchan);
+                        if (resplanes != expplanes) {
+                            std::cerr << "deinterleave mismatch: " << SimdLevelName(level) << ' '
+                                      << DataTypeName(DataType(dt)) << " nchan=" << nchan
+                                      << " res=" << uw << 'x' << vw << " pad=" << pad << std::endl;
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+
+bool checkDifference(SimdLevel level)
+{
+    for (int dt = dt_uint8; dt <= dt_uint16; dt++) {
+        for (int w = 0; w < nwidths; w++) {
+            for (int scale = 1; scale <= 9; scale += 4) {
+                // odd byte counts leave a partial element at the end
+                int size = widths[w] * scale;
+                std::vector<char> data(size), expected, result;
+                fillRandom(data);
+
+                // encode
+                expected = result = data;
+                SetSimdLevel(simd_none);
+                PtexUtils::encodeDifference(&expected[0], size, DataType(dt));
+                SetSimdLevel(level);
+                PtexUtils::encodeDifference(&result[0], size, DataType(dt));
+                if (result != expected) {
+                    std::cerr << "encodeDifference mismatch: " << SimdLevelName(level) << ' '
+                              << DataTypeName(DataType(dt)) << " size=" << size << std::endl;
+                    return false;
+                }
+
+                // decode (both the random data and the encoded data)
+                for (int pass = 0; pass < 2; pass++) {
+                    if (pass) expected = result = data;
+                    SetSimdLevel(simd_none);
+                    PtexUtils::decodeDifference(&expected[0], size, DataType(dt));
+                    SetSimdLevel(level);
+                    PtexUtils::decodeDifference(&result[0], size, DataType(dt));
+                    if (result != expected || (!pass && result != data)) {
+                        std::cerr << "decodeDifference mismatch: " << SimdLevelName(level) << ' '
+                                  << DataTypeName(DataType(dt)) << " size=" << size << std::endl;
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+
+// random data without nans (the payload of a sum of two nans isn't defined)
+void fillRandom(std::vector<char>& data, DataType dt)
+{
+    fillRandom(data);
+    if (dt == dt_half) {
+        uint16_t* p = (uint16_t*) &data[0];
+        for (size_t i = 0; i < data.size() / 2; i++)
+            if ((p[i] & 0x7c00) == 0x7c00) p[i] &= 0xfc00;
+    }
+    else if (dt == dt_float) {
+        uint32_t* p = (uint32_t*) &data[0];
+        for (size_t i = 0; i < data.size() / 4; i++)
+            if ((p[i] & 0x7f800000) == 0x7f800000) p[i] &= 0xff800000;
+    }
+}
+
+
+bool checkReduce(SimdLevel level)
+{
+    static const char* names[] = { "reduce", "reduceu", "reducev", "reduceTri" };
+    static PtexUtils::ReduceFn* const fns[] = { PtexUtils::reduce, PtexUtils::reduceu,
+                                                 PtexUtils::reducev, PtexUtils::reduceTri };
+    for (int fn = 0; fn < 4; fn++) {
+        for (int dt = 0; dt <= dt_float; dt++) {
+            for (int nchan = 1; nchan <= 5; nchan++) {
+                for (int w = 0; w < nwidths; w++) {
+                    for (int pad = 0; pad <= 1; pad++) {
+                        // even sizes; triangles are square
+                        int uw = 2 * widths[w], vw = fn == 3 ? uw : 2 * (1 + w % 3);
+                        int pixelsize = DataSize(DataType(dt)) * nchan;
+                        int sstride = uw * pixelsize + pad * 8, dstride = uw * pixelsize + pad * 4;
+                        std::vector<char> src(sstride * vw), expected(dstride * vw), result;
+                        fillRandom(src, DataType(dt));
+                        fillRandom(expected);
+                        result = expected;
+                        SetSimdLevel(simd_none);
+                        fns[fn](&src[0], sstride, uw, vw, &expected[0], dstride, DataType(dt), nchan);
+                        SetSimdLevel(level);
+                        fns[fn](&src[0], sstride, uw, vw, &result[0], dstride, DataType(dt), nchan);
+                        if (result != expected) {
+                            std::cerr << names[fn] << " mismatch: " << SimdLevelName(level) << ' '
+                                      << DataTypeName(DataType(dt)) << " nchan=" << nchan
+                                      << " res=" << uw << 'x' << vw << " pad=" << pad << std::endl;
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+
+// floats in and around [0,1], and random bits (including nans and infs)
+void fillRandomFloats(std::vector<float>& data)
+{
+    for (size_t i = 0; i < data.size(); i++) {
+        if (rand() & 1) data[i] = float(rand()) / float(RAND_MAX) * 1.5f - 0.25f;
+        else {
+            uint32_t bits = uint32_t(rand()) ^ (uint32_t(rand()) << 16);
+            memcpy(&data[i], &bits, 4);
+        }
+    }
+}
+
+
+bool checkConvert(SimdLevel level)
+{
+    for (int dt = 0; dt <= dt_float; dt++) {
+        for (int w = 0; w < nwidths; w++) {
+            int n = widths[w] * 3, size = DataSize(DataType(dt));
+
+            // to float (compared as bits)
+            std::vector<char> src(n * size);
+            fillRandom(src);
+            std::vector<float> expected(n), result(n);
+            SetSimdLevel(simd_none);
+            ConvertToFloat(&expected[0], &src[0], DataType(dt), n);
+            SetSimdLevel(level);
+            ConvertToFloat(&result[0], &src[0], DataType(dt), n);
+            if (memcmp(&result[0], &expected[0], n * sizeof(float)) != 0) {
+                std::cerr << "ConvertToFloat mismatch: " << SimdLevelName(level) << ' '
+                          << DataTypeName(DataType(dt)) << " n=" << n << std::endl;
+                return false;
+            }
+
+            // from float
+            std::vector<float> values(n);
+            fillRandomFloats(values);
+            std::vector<char> expdata(n * size), resdata(n * size);
+            SetSimdLevel(simd_none);
+            ConvertFromFloat(&expdata[0], &values[0], DataType(dt), n);
+            SetSimdLevel(level);
+            ConvertFromFloat(&resdata[0], &values[0], DataType(dt), n);
+            if (resdata != expdata) {
+                std::cerr << "ConvertFromFloat mismatch: " << SimdLevelName(level) << ' '
+                          << DataTypeName(DataType(dt)) << " n=" << n << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+bool checkConvertBlock(SimdLevel level)
+{
+    // the block conversions, with padded strides and channel subsets,
+    // compared with converting a pixel at a time
+    SetSimdLevel(level);
+    for (int dt = 0; dt <= dt_float; dt++) {
+        for (int nchan = 1; nchan <= 5; nchan++) {
+            for (int first = 0; first < nchan; first++) {
+                for (int nc = 1; first + nc <= nchan; nc++) {
+                    for (int pad = 0; pad <= 1; pad++) {
+                        int uw = widths[(dt + nchan + first + nc) % nwidths], vw = 1 + nc;
+                        int size = DataSize(DataType(dt)), pixelsize = size * nchan;
+                        int stride = pad ? uw * pixelsize + 6 : 0, fstride = pad ? uw * nc * 4 + 8 : 0;
+                        int rowlen = stride ? stride : uw * pixelsize, frowlen = fstride ? fstride : uw * nc * 4;
+                        std::vector<char> data(rowlen * vw), result, expected;
+                        fillRandom(data);
+
+                        std::vector<char> floats(frowlen * vw), expfloats(floats.size());
+                        ConvertToFloat((float*) &floats[0], fstride, &data[0], stride, uw, vw,
+                                       DataType(dt), nchan, first, nc);
+                        for (int v = 0; v < vw; v++)
+                            for (int u = 0; u < uw; u++)
+                                ConvertToFloat((float*) &expfloats[v * frowlen + u * nc * 4],
+                                               &data[v * rowlen + u * pixelsize + first * size],
+                                               DataType(dt), nc);
+                        for (int v = 0; v < vw; v++) {
+                            if (memcmp(&floats[v * frowlen], &expfloats[v * frowlen], uw * nc * 4) != 0) {
+                                std::cerr << "block ConvertToFloat mismatch: " << SimdLevelName(level) << ' '
+                                          << DataTypeName(DataType(dt)) << " nchan=" << nchan
+                                          << " channels=" << first << '+' << nc << " pad=" << pad << std::endl;
+                                return false;
+                            }
+                        }
+
+                        // back to the data, overwriting only the converted channels
+                        std::vector<float> values(floats.size() / 4);
+                        fillRandomFloats(values);
+                        expected = result = data;
+                        ConvertFromFloat(&result[0], stride, &values[0], fstride, uw, vw,
+                                         DataType(dt), nchan, first, nc);
+                        for (int v = 0; v < vw; v++)
+                            for (int u = 0; u < uw; u++)
+                                ConvertFromFloat(&expected[v * rowlen + u * pixelsize + first * size],
+                                                 (const float*) ((const char*) &values[0] + v * frowlen) + u * nc,
+                                                 DataType(dt), nc);
+                        if (result != expected) {
+                            std::cerr << "block ConvertFromFloat mismatch: " << SimdLevelName(level) << ' '
+                                      << DataTypeName(DataType(dt)) << " nchan=" << nchan
+                                      << " channels=" << first << '+' << nc << " pad=" << pad << std::endl;
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+
+bool checkFilter(SimdLevel level)
+{
+    // filters of every type and a range of widths (giving kernels of every
+    // size), for each data type and channel range of a two face texture
+    static const char* path = "simdtest.ptx";
+    for (int dt = 0; dt <= dt_float; dt++) {
+        for (int nchan = 1; nchan <= 5; nchan++) {
+            Ptex::String error;
+            PtexWriter* w = PtexWriter::open(path, mt_quad, DataType(dt), nchan, -1, 2, error);
+            if (!w) {
+                std::cerr << error.c_str() << std::endl;
+                return false;
+            }
+            Res res(5, 4);
+            std::vector<char> data(res.size() * DataSize(DataType(dt)) * nchan);
+            // face 0 is to the left of face 1
+            int adjfaces[2][4] = { { -1, 1, -1, -1 }, { -1, -1, -1, 0 } };
+            int adjedges[2][4] = { { 0, 3, 0, 0 }, { 0, 0, 0, 1 } };
+            for (int f = 0; f < 2; f++) {
+                fillRandom(data, DataType(dt));
+                w->writeFace(f, FaceInfo(res, adjfaces[f], adjedges[f]), &data[0]);
+            }
+            bool ok = w->close(error);
+            w->release();
+            PtexTexture* tx = ok ? PtexTexture::open(path, error) : 0;
+            if (!tx) {
+                std::cerr << error.c_str() << std::endl;
+                return false;
+            }
+
+            for (int ft = PtexFilter::f_point; ft <= PtexFilter::f_mitchell; ft++) {
+                PtexFilter::Options opts(PtexFilter::FilterType(ft), 0, 0.5f);
+                PtexFilter* filter = PtexFilter::getFilter(tx, opts);
+                for (int i = 0; i < 200; i++) {
+                    int first = rand() % nchan, nc = 1 + rand() % (nchan - first);
+                    int face = rand() % 2;
+                    float u = float(rand()) / float(RAND_MAX), v = float(rand()) / float(RAND_MAX);
+                    float uw = float(rand() % 100) / 250.0f, vw = float(rand() % 100) / 250.0f;
+                    float expected[5], result[5];
+                    SetSimdLevel(simd_none);
+                    filter->eval(expected, first, nc, face, u, v, uw, 0, 0, vw);
+                    SetSimdLevel(level);
+                    filter->eval(result, first, nc, face, u, v, uw, 0, 0, vw);
+                    if (memcmp(result, expected, nc * sizeof(float)) != 0) {
+                        std::cerr << "filter mismatch: " << SimdLevelName(level) << ' '
+                                  << DataTypeName(DataType(dt)) << " nchan=" << nchan
+                                  << " channels=" << first << '+' << nc << " filter=" << ft
+                                  << " uv=" << u << ',' << v << " width=" << uw << ',' << vw << std::endl;
+                        filter->release();
+                        tx->release();
+                        return false;
+                    }
+                }
+                filter->release();
+            }
+            tx->release();
+        }
+    }
+    remove(path);
+    return true;
+}
+
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    SimdLevel maxLevel = GetSimdLevel();
+    if (!checkConvertBlock(simd_none)) return 1;
+    for (int level = simd_none + 1; level <= simd_avx2; level++) {
+        if (!SetSimdLevel(SimdLevel(level))) continue;
+        if (!checkInterleave(SimdLevel(level))) return 1;
+        if (!checkDifference(SimdLevel(level))) return 1;
+        if (!checkReduce(SimdLevel(level))) return 1;
+        if (!checkConvert(SimdLevel(level))) return 1;
+        if (!checkConvertBlock(SimdLevel(level))) return 1;
+        if (!checkFilter(SimdLevel(level))) return 1;
+    }
+    SetSimdLevel(maxLevel);
+    return 0;
+}
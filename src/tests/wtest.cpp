@@ -1,8 +1,13 @@
 #include <iostream>
 #include <stdlib.h>
+#include <stdio.h>
 #include <algorithm>
+#include <vector>
 #include "Ptexture.h"
 #include "PtexHalf.h"
+#ifdef PTEX_STATIC
+#include "PtexCodec.h"
+#endif
 #include <string.h>
 using namespace Ptex;
 
@@ -59,6 +64,216 @@ bool checkMeta(const char* path,
 }
 
 
+bool checkFaces(PtexTexture* tx, PtexTexture* ref, int skipface)
+{
+    int nfaces = tx->numFaces(), nchan = tx->numChannels();
+    int pixelsize = Ptex::DataSize(tx->dataType()) * nchan;
+    for (int i = 0; i < nfaces; i++) {
+        if (i == skipface) continue;
+        Ptex::Res res = tx->getFaceInfo(i).res;
+        int size = res.size() * pixelsize;
+        std::vector<char> data(size), refdata(size);
+        tx->getData(i, &data[0], 0);
+        ref->getData(i, &refdata[0], 0);
+        if (0 != memcmp(&data[0], &refdata[0], size)) {
+            std::cerr << "Face data readback failed for face " << i << std::endl;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+int fileMinorVersion(const char* path)
+{
+    // minor version from the file header (which follows 11 32-bit fields)
+    FILE* fp = fopen(path, "rb");
+    uint32_t header[12];
+    bool ok = fp && fread(header, sizeof(header), 1, fp) == 1;
+    if (fp) fclose(fp);
+    return ok ? int(header[11]) : -1;
+}
+
+bool checkLz4(const char* path, const char* lz4path)
+{
+    // copy the file using the lz4 codec and verify the data matches
+    Ptex::String error;
+    PtexPtr<PtexTexture> ref(PtexTexture::open(path, error));
+    if (!ref) {
+        std::cerr << error.c_str() << std::endl;
+        return 0;
+    }
+    Ptex::MeshType mt = ref->meshType();
+    Ptex::DataType dt = ref->dataType();
+    int nchan = ref->numChannels(), alpha = ref->alphaChannel(), nfaces = ref->numFaces();
+    int pixelsize = Ptex::DataSize(dt) * nchan;
+
+    PtexWriter* w = PtexWriter::open(lz4path, mt, dt, nchan, alpha, nfaces, error);
+    if (!w) {
+        std::cerr << error.c_str() << std::endl;
+        return 0;
+    }
+    w->setFaceCodec(Ptex::fc_lz4);
+    for (int i = 0; i < nfaces; i++) {
+        const Ptex::FaceInfo& f = ref->getFaceInfo(i);
+        std::vector<char> data(f.res.size() * pixelsize);
+        ref->getData(i, &data[0], 0);
+        w->writeFace(i, f, &data[0]);
+    }
+    if (!w->close(error)) {
+        std::cerr << error.c_str() << std::endl;
+        return 0;
+    }
+    w->release();
+
+    {
+        PtexPtr<PtexTexture> tx(PtexTexture::open(lz4path, error));
+        if (!tx || !checkFaces(tx, ref, -1)) return 0;
+    }
+
+    // only files with lz4 data need the newer minor version
+    if (fileMinorVersion(path) != PtexFileMinorVersion || fileMinorVersion(lz4path) != 5) {
+        std::cerr << "Wrong file minor version" << std::endl;
+        return 0;
+    }
+
+    // replace a face with an incremental zlib edit (mixed codecs in one file)
+    w = PtexWriter::edit(lz4path, true, mt, dt, nchan, alpha, nfaces, error);
+    if (!w) {
+        std::cerr << error.c_str() << std::endl;
+        return 0;
+    }
+    w->setFaceCodec(Ptex::fc_zlib);
+    const Ptex::FaceInfo& f = ref->getFaceInfo(0);
+    int size = f.res.size() * pixelsize;
+    std::vector<char> data(size);
+    for (int i = 0; i < size; i++) data[i] = char(i * 7);
+    w->writeFace(0, f, &data[0]);
+    if (!w->close(error)) {
+        std::cerr << error.c_str() << std::endl;
+        return 0;
+    }
+    w->release();
+
+    PtexPtr<PtexTexture> tx(PtexTexture::open(lz4path, error));
+    if (!tx || !checkFaces(tx, ref, 0)) return 0;
+    std::vector<char> edited(size);
+    tx->getData(0, &edited[0], 0);
+    if (0 != memcmp(&edited[0], &data[0], size)) {
+        std::cerr << "Face data readback failed for edited face" << std::endl;
+        return 0;
+    }
+    return 1;
+}
+
+
+unsigned char nextRandomByte(unsigned int& seed)
+{
+    // same generator as the one used to make the reference lz4 block
+    seed = seed * 1103515245u + 12345u;
+    return (unsigned char)(seed >> 16);
+}
+
+bool checkLz4Reference()
+{
+#ifdef PTEX_STATIC
+    // a block made by the reference encoder (LZ4_compress_default from lz4
+    // 1.9.4) must decode to the data it was made from: long literal runs and
+    // matches (with extra length bytes), an overlapping match and a short one
+    static const unsigned char ref[] = {
+        0xff, 0xff, 0x1e, 0xc6, 0x7e, 0x81, 0x6b, 0x4b, 0xfb, 0xe2, 0xfb, 0x54,
+        0xf6, 0xbd, 0xdf, 0x7c, 0x1c, 0xe1, 0x87, 0x01, 0xbf, 0x31, 0xde, 0x56,
+        0x72, 0x0f, 0x47, 0x67, 0x66, 0x87, 0x59, 0xaa, 0x88, 0x3c, 0x59, 0xea,
+        0x56, 0x13, 0x7b, 0xd2, 0x85, 0xa1, 0xd8, 0x3c, 0x54, 0x55, 0x2f, 0x37,
+        0xae, 0x65, 0x5b, 0xda, 0x02, 0x79, 0x98, 0xcc, 0xe3, 0x1a, 0x76, 0x8e,
+        0x5f, 0xd9, 0x99, 0x8f, 0x1f, 0x3f, 0x36, 0xee, 0x43, 0x78, 0x4d, 0x0d,
+        0xfa, 0xbe, 0xa6, 0xda, 0xe4, 0x86, 0x8e, 0xdc, 0x29, 0x6d, 0x4e, 0xff,
+        0x56, 0xe1, 0x70, 0x20, 0xfb, 0x8f, 0xb1, 0x58, 0x05, 0x90, 0xc5, 0x09,
+        0xdc, 0x53, 0xcd, 0xaa, 0x3b, 0x48, 0x99, 0x52, 0xd3, 0x52, 0x9d, 0x06,
+        0x9f, 0xea, 0xb5, 0xc2, 0x06, 0x13, 0x98, 0x49, 0xb2, 0x01, 0x1e, 0xac,
+        0x32, 0x88, 0x31, 0x9c, 0x52, 0x46, 0x95, 0x71, 0x36, 0x8f, 0x57, 0xf6,
+        0x39, 0x1d, 0x16, 0xfa, 0x88, 0x74, 0xf5, 0x98, 0x7c, 0x17, 0x5c, 0x41,
+        0xbb, 0x6d, 0x71, 0x8e, 0x0f, 0x70, 0x59, 0xc7, 0x01, 0x1b, 0x2f, 0x33,
+        0x3d, 0x91, 0xc0, 0x1d, 0xa5, 0x0d, 0x0d, 0xab, 0x33, 0x8d, 0x7e, 0x5e,
+        0x8f, 0x3e, 0xe6, 0x68, 0x74, 0xa6, 0x3a, 0xb1, 0xc3, 0x93, 0x11, 0xa8,
+        0x64, 0xc7, 0xdb, 0xca, 0xe0, 0x60, 0xe1, 0xf3, 0xbf, 0x09, 0x00, 0x67,
+        0xa2, 0xe3, 0x25, 0xa0, 0x21, 0x31, 0x87, 0xd5, 0x62, 0xc5, 0xa8, 0x4f,
+        0x7e, 0x2e, 0x09, 0x6b, 0x94, 0x9f, 0xb0, 0x6d, 0xa9, 0x9e, 0x5a, 0x0b,
+        0x46, 0x70, 0x80, 0xb6, 0xcf, 0x47, 0x0c, 0xa6, 0xa5, 0x2a, 0xd8, 0xac,
+        0xfb, 0xa0, 0xeb, 0xb7, 0x79, 0x24, 0x72, 0x23, 0x92, 0x48, 0x80, 0xc5,
+        0xa6, 0xa7, 0x85, 0xb7, 0xd7, 0x8c, 0x90, 0xe4, 0xab, 0x63, 0x44, 0x52,
+        0x66, 0xe3, 0x9c, 0x33, 0x25, 0xf9, 0x5e, 0xaa, 0xba, 0x73, 0x60, 0x5d,
+        0x4b, 0x71, 0x7e, 0xbe, 0xa9, 0x8c, 0x57, 0x19, 0x71, 0xc3, 0xca, 0x5e,
+        0xe5, 0x2a, 0x33, 0xac, 0x88, 0x51, 0x66, 0xa1, 0x7b, 0x75, 0x67, 0x64,
+        0x9a, 0x69, 0xef, 0x6f, 0x56, 0x42, 0xa0, 0x1d, 0x51, 0xc5, 0x02, 0xf7,
+        0xbb, 0x92, 0x45, 0x2c, 0x01, 0x51, 0x0f, 0x90, 0x01, 0x51, 0x0f, 0x64,
+        0x00, 0xff, 0xff, 0xff, 0x10, 0x1f, 0x61, 0x01, 0x00, 0xb4, 0xff, 0x55,
+        0xbe, 0x6f, 0x0d, 0xb6, 0x38, 0xcc, 0x10, 0xfd, 0xbb, 0x54, 0x51, 0x1c,
+        0x7b, 0x07, 0x94, 0x27, 0x93, 0x7d, 0x92, 0xc3, 0xd4, 0xc6, 0xa5, 0x61,
+        0x51, 0x01, 0x38, 0x38, 0xa7, 0xbf, 0xf1, 0x04, 0x0d, 0x15, 0x9b, 0x80,
+        0x1f, 0x83, 0xd5, 0xa4, 0x69, 0x88, 0x7c, 0x9f, 0xb6, 0x01, 0xda, 0x93,
+        0x17, 0x45, 0x8b, 0x12, 0xb2, 0x02, 0x33, 0x5c, 0x50, 0xd6, 0xe1, 0x56,
+        0xa4, 0xad, 0x42, 0x4a, 0x5c, 0xdd, 0x86, 0x61, 0xe9, 0x03, 0x12, 0xe1,
+        0x0f, 0x9b, 0xea, 0x26, 0x2c, 0x61, 0xdc, 0x62, 0x48, 0x6b, 0x6d, 0x14,
+        0xe0, 0x03, 0x85, 0x4a, 0x72, 0x46, 0xda, 0x96, 0xc8, 0x7d, 0x1c, 0xd1,
+        0x05, 0x3e, 0xe5, 0x92, 0x2b, 0x01, 0x01, 0x70, 0x70, 0x43, 0x5f, 0x6c,
+        0x03, 0x05, 0xb3
+    };
+    std::vector<unsigned char> expected;
+    unsigned int seed = 1;
+    for (int i = 0; i < 300; i++) expected.push_back(nextRandomByte(seed));
+    for (int i = 0; i < 1000; i++) expected.push_back(expected[i % 100]);
+    for (int i = 0; i < 200; i++) expected.push_back('a');
+    for (int i = 0; i < 100; i++) expected.push_back(nextRandomByte(seed));
+    for (int i = 0; i < 20; i++) expected.push_back(expected[1400 + i]);
+    for (int i = 0; i < 7; i++) expected.push_back(nextRandomByte(seed));
+
+    std::vector<char> block(1, char(PtexCodec::Lz4BlockMarker));
+    block.insert(block.end(), ref, ref + sizeof(ref));
+    std::vector<unsigned char> data(expected.size());
+    if (!PtexCodec::inflateBlock(&data[0], int(data.size()), &block[0], int(block.size())) ||
+        data != expected) {
+        std::cerr << "Reference lz4 block decode failed" << std::endl;
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+
+bool checkLz4Corrupt()
+{
+#ifdef PTEX_STATIC
+    // a literal length made of a long run of 255 bytes (enough to overflow an
+    // int if it were summed unchecked) must be rejected, not copied
+    std::vector<char> block(1, char(PtexCodec::Lz4BlockMarker));
+    block.push_back(char(0xf0));
+    block.insert(block.end(), 8500000, char(0xff));
+    block.push_back(0);
+    block.insert(block.end(), 64, 'x');
+    std::vector<char> data(64);
+    if (PtexCodec::inflateBlock(&data[0], int(data.size()), &block[0], int(block.size()))) {
+        std::cerr << "Corrupt lz4 literal length not rejected" << std::endl;
+        return 0;
+    }
+
+    // likewise for an overlong match length following a valid literal
+    block.resize(1);
+    block.push_back(char(0x1f));
+    block.push_back('x');
+    block.push_back(1);
+    block.push_back(0);
+    block.insert(block.end(), 8500000, char(0xff));
+    block.push_back(0);
+    if (PtexCodec::inflateBlock(&data[0], int(data.size()), &block[0], int(block.size()))) {
+        std::cerr << "Corrupt lz4 match length not rejected" << std::endl;
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+
 int main(int /*argc*/, char** /*argv*/)
 {
     static Ptex::Res res[] = { Ptex::Res(8,7),
@@ -175,5 +390,8 @@ int main(int /*argc*/, char** /*argv*/)
         return 1;
     free(dvals);
 
+    if (!checkLz4("test.ptx", "testlz4.ptx") || !checkLz4Reference() || !checkLz4Corrupt())
+        return 1;
+
     return 0;
 }
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Ptexture.h"
+
+// Compares the available zip backends by reading every face of the given
+// files (default "test.ptx", as written by wtest) at every resolution.
+
+// plain stdio input (so that data isn't already in memory when inflated)
+class StdioInputHandler : public PtexInputHandler
+{
+public:
+    virtual Handle open(const char* path) { return (Handle) fopen(path, "rb"); }
+    virtual void seek(Handle handle, int64_t pos) { fseek((FILE*)handle, long(pos), SEEK_SET); }
+    virtual size_t read(void* buffer, size_t size, Handle handle)
+    {
+        return fread(buffer, size, 1, (FILE*)handle) == 1 ? size : 0;
+    }
+    virtual bool close(Handle handle) { return fclose((FILE*)handle) == 0; }
+    virtual const char* lastError() { return "read error"; }
+};
+
+
+double readFiles(PtexInputHandler* io, const std::vector<const char*>& files,
+                 int iterations, unsigned int& checksum)
+{
+    PtexPtr<PtexCache> c(PtexCache::create(0, 0, false, io));
+    checksum = 0;
+    std::vector<char> data;
+    clock_t start = clock();
+    for (int iter = 0; iter < iterations; iter++) {
+        for (size_t f = 0; f < files.size(); f++) {
+            Ptex::String error;
+            PtexPtr<PtexTexture> tx(c->get(files[f], error));
+            if (!tx) {
+                std::cerr << error.c_str() << std::endl;
+                exit(1);
+            }
+            int pixelsize = Ptex::DataSize(tx->dataType()) * tx->numChannels();
+            for (int i = 0, nfaces = tx->numFaces(); i < nfaces; i++) {
+                Ptex::Res res = tx->getFaceInfo(i).res;
+                while (1) {
+                    data.resize(pixelsize * res.size());
+                    tx->getData(i, &data[0], 0, res);
+                    for (size_t j = 0; j < data.size(); j++)
+                        checksum = checksum * 31 + (unsigned char) data[j];
+                    if (!res.ulog2 && !res.vlog2) break;
+                    if (res.ulog2) res.ulog2--;
+                    if (res.vlog2) res.vlog2--;
+                }
+            }
+        }
+        // force all data to be read and decompressed again
+        c->purgeAll();
+    }
+    return double(clock() - start) / CLOCKS_PER_SEC / iterations;
+}
+
+
+int main(int argc, char** argv)
+{
+    std::vector<const char*> files;
+    int iterations = 100;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i+1 < argc) iterations = atoi(argv[++i]);
+        else files.push_back(argv[i]);
+    }
+    if (files.empty()) files.push_back("test.ptx");
+    if (iterations < 1) iterations = 1;
+
+    StdioInputHandler stdio;
+    unsigned int expected = 0;
+    bool first = true;
+    printf("%-12s %14s %14s\n", "backend", "stdio (ms)", "default (ms)");
+    for (int b = Ptex::zb_zlibStream; b <= Ptex::zb_libdeflate; b++) {
+        Ptex::ZipBackend backend = Ptex::ZipBackend(b);
+        if (!Ptex::SetZipBackend(backend)) continue;
+        unsigned int checksum1, checksum2;
+        double t1 = readFiles(&stdio, files, iterations, checksum1);
+        double t2 = readFiles(0, files, iterations, checksum2);
+        printf("%-12s %14.3f %14.3f\n", Ptex::ZipBackendName(backend), t1 * 1e3, t2 * 1e3);
+        if (first) { expected = checksum1; first = false; }
+        if (checksum1 != expected || checksum2 != expected) {
+            std::cerr << "data mismatch with backend " << Ptex::ZipBackendName(backend) << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -201,7 +201,8 @@ void DumpInternal(PtexTexture* tx)
               << "  lmdheadermemsize: " << eh.lmdheadermemsize << std::endl
               << "  lmddatasize: " << eh.lmddatasize << std::endl
               << "  editdatasize: " << eh.editdatasize << std::endl
-              << "  editdatapos: " << eh.editdatapos << std::endl;
+              << "  editdatapos: " << eh.editdatapos << std::endl
+              << "  facecodec: " << Ptex::FaceCodecName(Ptex::FaceCodec(eh.facecodec)) << std::endl;
 
     std::cout << "Level info:\n";
     for (int i = 0; i < h.nlevels; i++) {